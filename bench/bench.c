@@ -0,0 +1,132 @@
+/* SPDX-License-Identifier: AGPL-3.0-or-later */
+#define _POSIX_C_SOURCE 200809L
+
+#include "bench.h"
+
+#include <jansson.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BENCH_DEFAULT_MS 200
+#define BENCH_CALIBRATE_NS 10000000LL   /* grow n until one run takes 10 ms */
+
+volatile uint64_t bench_sink;
+
+static uint64_t allocs;
+static int64_t target_ns;
+
+#ifdef BENCH_WRAP_MALLOC
+/* linked with -Wl,--wrap=malloc,... (see meson.build): every allocation made from bmr code */
+void *__real_malloc(size_t n);
+void *__real_calloc(size_t n, size_t sz);
+void *__real_realloc(void *p, size_t n);
+
+void *
+__wrap_malloc(size_t n) {
+  allocs++;
+  return __real_malloc(n);
+}
+
+void *
+__wrap_calloc(size_t n, size_t sz) {
+  allocs++;
+  return __real_calloc(n, sz);
+}
+
+void *
+__wrap_realloc(void *p, size_t n) {
+  allocs++;
+  return __real_realloc(p, n);
+}
+
+#endif
+
+/* jansson allocates inside the shared library, out of reach of --wrap */
+static void *
+bench_json_malloc(size_t n) {
+#ifndef BENCH_WRAP_MALLOC
+  allocs++;
+#endif
+  return malloc(n);
+}
+
+static void
+bench_json_free(void *p) {
+  free(p);
+}
+
+int64_t
+bench_now_ns(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return (int64_t) ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+uint64_t
+bench_allocs(void) {
+  return allocs;
+}
+
+void
+bench_init(void) {
+  const char *ms = getenv("BMR_BENCH_MS");
+
+  target_ns = (int64_t) (ms ? atol(ms) : BENCH_DEFAULT_MS) * 1000000LL;
+  if (target_ns <= 0)
+    target_ns = BENCH_DEFAULT_MS * 1000000LL;
+
+  json_set_alloc_funcs(bench_json_malloc, bench_json_free);
+  setvbuf(stderr, NULL, _IOLBF, 0);
+  fprintf(stderr, "%-40s %12s %12s %12s\n", "benchmark", "iterations", "ns/op", "allocs/op");
+}
+
+void
+bench_quiet_stdout(void) {
+  fflush(stdout);
+  if (!freopen("/dev/null", "w", stdout))
+    perror("/dev/null");
+}
+
+/* no arguments: every group; otherwise only the groups named */
+bool
+bench_selected(int argc, char *const *argv, const char *group) {
+  if (argc < 2)
+    return true;
+
+  for (int i = 1; i < argc; i++)
+    if (!strcmp(argv[i], group))
+      return true;
+
+  return false;
+}
+
+void
+bench_run(const char *name, bench_fn fn, void *ctx) {
+  uint64_t n = 1;
+  int64_t t;
+
+  /* calibrate: double n until a run is long enough to time reliably */
+  for (;;) {
+    int64_t t0 = bench_now_ns();
+    fn(ctx, n);
+    t = bench_now_ns() - t0;
+    if (t >= BENCH_CALIBRATE_NS || n >= (UINT64_MAX >> 2))
+      break;
+    n <<= 1;
+  }
+  if (t > 0 && t < target_ns)
+    n = (uint64_t) ((double) n * (double) target_ns / (double) t);
+
+  uint64_t a0 = allocs;
+  int64_t t0 = bench_now_ns();
+  fn(ctx, n);
+  t = bench_now_ns() - t0;
+
+  /* results go to stderr: some cases print to stdout, which bench_quiet_stdout() discards */
+  fprintf(stderr, "%-40s %12llu %12.1f %12.2f\n", name, (unsigned long long) n,
+          (double) t / (double) n, (double) (allocs - a0) / (double) n);
+}
@@ -0,0 +1,37 @@
+/* SPDX-License-Identifier: AGPL-3.0-or-later */
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Minimal benchmark harness: each case is a function that runs its body n times. The harness
+ * grows n until one run lasts BMR_BENCH_MS (default 200 ms) and reports ns/op and
+ * allocations/op. Allocations are counted through jansson's allocator hooks and, when the
+ * linker supports --wrap, through malloc/calloc/realloc calls made by bmr's own code.
+ */
+typedef void (*bench_fn)(void *ctx, uint64_t n);
+
+void bench_init(void);
+/* stdout to /dev/null, so printing paths can be measured without a terminal in the loop */
+void bench_quiet_stdout(void);
+bool bench_selected(int argc, char *const *argv, const char *group);
+void bench_run(const char *name, bench_fn fn, void *ctx);
+uint64_t bench_allocs(void);
+int64_t bench_now_ns(void);
+
+/* keeps results alive without a memory barrier in the loop */
+extern volatile uint64_t bench_sink;
+
+static inline void
+bench_keep_double(double v) {
+  union { double d; uint64_t u; } x = { .d = v };
+
+  bench_sink ^= x.u;
+}
+
+static inline void
+bench_keep_ptr(const void *p) {
+  bench_sink ^= (uint64_t) (uintptr_t) p;
+}
@@ -0,0 +1,165 @@
+/* SPDX-License-Identifier: AGPL-3.0-or-later */
+#define _DEFAULT_SOURCE
+
+/*
+ * End-to-end throughput: the real cmd_read/cmd_status/cmd_snapshot against fake_bus.c, at
+ * each bus clock, in two modes:
+ *
+ *   in-process   the command called in a loop in one process (one fd, one jansson heap)
+ *   fork         one child per command, the closest in-tree stand-in for a shell loop of
+ *                single-shot `bmr` invocations (exec and dynamic loading not included)
+ *
+ * Reports samples/s (commands completed), transactions per command, bus utilization (wire
+ * time / wall time) and the CPU cost per command outside the wire time.
+ *
+ *   bench_bus [--khz N]... [--overhead-us N]
+ */
+#include "bench.h"
+#include "fake_bus.h"
+
+#include "read_cmd.h"
+#include "status_cmd.h"
+#include "mfr_snapshot.h"
+
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define BUS_DEFAULT_MS 500
+#define BUS_MIN_RUNS 3
+#define BUS_MAX_KHZ 8
+
+struct bus_case {
+  const char *name;
+  int (*cmd)(int fd, int argc, char *const *argv, int pretty);
+  int argc;
+  char *const *argv;
+};
+
+static char *const a_read_all[] = { "all" };
+static char *const a_read_vout[] = { "vout" };
+static char *const a_status_compact[] = { "--compact" };
+static char *const a_snapshot_decode[] = { "--decode", "--compact" };
+
+static const struct bus_case cases[] = {
+  { "read all",                    cmd_read,     1, a_read_all },
+  { "read vout",                   cmd_read,     1, a_read_vout },
+  { "status",                      cmd_status,   0, NULL },
+  { "status --compact",            cmd_status,   1, a_status_compact },
+  { "snapshot --decode --compact", cmd_snapshot, 2, a_snapshot_decode },
+};
+
+static int64_t
+cpu_ns(void) {
+  struct rusage self, children;
+
+  getrusage(RUSAGE_SELF, &self);
+  getrusage(RUSAGE_CHILDREN, &children);
+
+  return ((int64_t) self.ru_utime.tv_sec + self.ru_stime.tv_sec + children.ru_utime.tv_sec +
+          children.ru_stime.tv_sec) * 1000000000LL +
+         ((int64_t) self.ru_utime.tv_usec + self.ru_stime.tv_usec + children.ru_utime.tv_usec +
+          children.ru_stime.tv_usec) * 1000LL;
+}
+
+static void
+run_one(const struct bus_case *c, int fd, bool fork_each) {
+  if (!fork_each) {
+    c->cmd(fd, c->argc, c->argv, 0);
+    return;
+  }
+
+  fflush(stdout);
+  pid_t pid = fork();
+  if (pid == 0) {
+    c->cmd(fd, c->argc, c->argv, 0);
+    fflush(stdout);
+    _exit(0);
+  }
+  if (pid > 0)
+    waitpid(pid, NULL, 0);
+}
+
+static void
+run_case(const struct bus_case *c, int fd, unsigned khz, bool fork_each, int64_t target_ns) {
+  const struct fake_bus_stats *st = fake_bus_stats();
+  uint64_t n = 0;
+
+  fake_bus_reset();
+  int64_t c0 = cpu_ns();
+  int64_t t0 = bench_now_ns();
+  int64_t t;
+
+  do {
+    run_one(c, fd, fork_each);
+    n++;
+    t = bench_now_ns() - t0;
+  } while (t < target_ns || n < BUS_MIN_RUNS);
+
+  /* the wire time is busy-waited, so it shows up as CPU: take it out */
+  int64_t cpu = cpu_ns() - c0 - st->busy_ns;
+
+  fprintf(stderr, "%-28s %-10s %6u %12.1f %8.1f %8.1f %12.1f\n", c->name,
+          fork_each ? "fork" : "in-process", khz, (double) n * 1e9 / (double) t,
+          (double) st->tx / (double) n, 100.0 * (double) st->busy_ns / (double) t,
+          (double) (cpu > 0 ? cpu : 0) / 1000.0 / (double) n);
+}
+
+int
+main(int argc, char *const *argv) {
+  unsigned khz[BUS_MAX_KHZ] = { 0 };
+  int nkhz = 0;
+  unsigned overhead_us = 0;
+
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--khz") && i + 1 < argc && nkhz < BUS_MAX_KHZ)
+      khz[nkhz++] = (unsigned) strtoul(argv[++i], NULL, 0);
+    else if (!strcmp(argv[i], "--overhead-us") && i + 1 < argc)
+      overhead_us = (unsigned) strtoul(argv[++i], NULL, 0);
+    else {
+      fprintf(stderr, "bench_bus [--khz N]... [--overhead-us N]\n");
+      return 2;
+    }
+  }
+  if (!nkhz) {
+    khz[nkhz++] = 100;
+    khz[nkhz++] = 400;
+    khz[nkhz++] = 1000;
+  }
+
+  const char *ms = getenv("BMR_BENCH_MS");
+  int64_t target_ns = (int64_t) (ms && atol(ms) > 0 ? atol(ms) : BUS_DEFAULT_MS) * 1000000LL;
+
+  /* the fd only has to be valid: fake_bus.c never touches it */
+  int fd = open("/dev/null", O_RDWR);
+  if (fd < 0) {
+    perror("/dev/null");
+    return 1;
+  }
+  setvbuf(stderr, NULL, _IOLBF, 0);
+  bench_quiet_stdout();
+
+  fprintf(stderr, "overhead per transfer: %u us\n", overhead_us);
+  fprintf(stderr, "%-28s %-10s %6s %12s %8s %8s %12s\n", "command", "mode", "kHz", "samples/s",
+          "tx/cmd", "bus %", "cpu us/cmd");
+
+  for (int k = 0; k < nkhz; k++) {
+    if (!khz[k]) {
+      fprintf(stderr, "--khz must be > 0\n");
+      return 2;
+    }
+    fake_bus_init(khz[k], overhead_us);
+    for (size_t i = 0; i < sizeof cases / sizeof cases[0]; i++) {
+      run_case(&cases[i], fd, khz[k], false, target_ns);
+      run_case(&cases[i], fd, khz[k], true, target_ns);
+    }
+  }
+
+  close(fd);
+
+  return 0;
+}
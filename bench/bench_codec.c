@@ -0,0 +1,227 @@
+/* SPDX-License-Identifier: AGPL-3.0-or-later */
+
+/*
+ * Per-sample CPU cost of the decoders and serializers: linear-format conversions, status
+ * decoding, snapshot decoding and JSON output. No bus access.
+ *
+ *   bench_codec [lin] [status] [snapshot] [json]
+ */
+#include "bench.h"
+
+#include "pmbus_io.h"
+#include "decoders.h"
+#include "mfr_snapshot.h"
+#include "util_json.h"
+#include "util_lin.h"
+
+#include <jansson.h>
+#include <stdio.h>
+
+#define RAW_LEN 256                     /* power of two: index with & (RAW_LEN - 1) */
+
+static uint16_t raw_lin11[RAW_LEN];
+static uint16_t raw_lin16u[RAW_LEN];
+static double units[RAW_LEN];
+static uint8_t status_bytes[RAW_LEN];
+static uint8_t snapshot[32];
+
+/* inputs vary per iteration so nothing folds to a constant */
+static void
+fill_inputs(void) {
+  uint32_t x = 0x12345678;
+
+  for (int i = 0; i < RAW_LEN; i++) {
+    x = x * 1664525u + 1013904223u;
+    raw_lin11[i] = (uint16_t) (x >> 16);
+    raw_lin16u[i] = (uint16_t) (x >> 8);
+    units[i] = (double) (int16_t) (x >> 12) / 64.0;
+    status_bytes[i] = (uint8_t) (x >> 24);
+  }
+
+  static const uint8_t blk[32] = {
+    0x08, 0xF3, 0x00, 0x20, 0x40, 0xD2, 0x20, 0xD3, 0x10, 0xF3, 0x00, 0x20, 0x48, 0xD2,
+    0xB0, 0xE2, 0xA0, 0xE2, 0x34, 0x12, 0x41, 0x08, 0x40, 0x10, 0x80, 0x00, 0x40, 0x02,
+    0x64, 0x00, 0x00, 0x00,
+  };
+  for (size_t i = 0; i < sizeof snapshot; i++)
+    snapshot[i] = blk[i];
+}
+
+/* lin */
+
+static void
+b_pmbus_lin11_to_double(void *ctx, uint64_t n) {
+  (void) ctx;
+  for (uint64_t i = 0; i < n; i++)
+    bench_keep_double(pmbus_lin11_to_double(raw_lin11[i & (RAW_LEN - 1)]));
+}
+
+static void
+b_lin11_decode_n(void *ctx, uint64_t n) {
+  double out[RAW_LEN];
+
+  (void) ctx;
+  /* one op = one sample, as for the scalar version */
+  for (uint64_t i = 0; i < n; i += RAW_LEN) {
+    pmbus_lin11_decode_n(raw_lin11, out, RAW_LEN);
+    bench_keep_double(out[i & (RAW_LEN - 1)]);
+  }
+}
+
+static void
+b_lin16u_to_units(void *ctx, uint64_t n) {
+  (void) ctx;
+  for (uint64_t i = 0; i < n; i++)
+    bench_keep_double(lin16u_to_units(raw_lin16u[i & (RAW_LEN - 1)], -12));
+}
+
+static void
+b_units_to_lin16u(void *ctx, uint64_t n) {
+  (void) ctx;
+  for (uint64_t i = 0; i < n; i++)
+    bench_sink ^= units_to_lin16u(units[i & (RAW_LEN - 1)], -12);
+}
+
+static void
+b_units_to_lin11(void *ctx, uint64_t n) {
+  (void) ctx;
+  for (uint64_t i = 0; i < n; i++)
+    bench_sink ^= units_to_lin11(units[i & (RAW_LEN - 1)]);
+}
+
+/* status */
+
+struct status_case {
+  json_t *(*decode)(uint8_t v);
+};
+
+static void
+b_decode_status(void *ctx, uint64_t n) {
+  const struct status_case *c = ctx;
+
+  for (uint64_t i = 0; i < n; i++) {
+    json_t *o = c->decode(status_bytes[i & (RAW_LEN - 1)]);
+    bench_keep_ptr(o);
+    json_decref(o);
+  }
+}
+
+static void
+b_decode_status_word(void *ctx, uint64_t n) {
+  (void) ctx;
+  for (uint64_t i = 0; i < n; i++) {
+    json_t *o = decode_status_word(raw_lin16u[i & (RAW_LEN - 1)]);
+    bench_keep_ptr(o);
+    json_decref(o);
+  }
+}
+
+static void
+b_status_flags(void *ctx, uint64_t n) {
+  (void) ctx;
+  for (uint64_t i = 0; i < n; i++)
+    bench_keep_ptr(status_flags(SREG_VOUT, status_bytes[i & (RAW_LEN - 1)]));
+}
+
+static void
+b_status_word_flags(void *ctx, uint64_t n) {
+  char buf[STATUS_WORD_FLAGS_MAX];
+
+  (void) ctx;
+  for (uint64_t i = 0; i < n; i++)
+    bench_sink ^= status_word_flags(raw_lin16u[i & (RAW_LEN - 1)], buf, sizeof buf);
+}
+
+/* snapshot */
+
+static void
+b_decode_snapshot_block(void *ctx, uint64_t n) {
+  bool compact = ctx != NULL;
+
+  for (uint64_t i = 0; i < n; i++) {
+    snapshot[22] = status_bytes[i & (RAW_LEN - 1)];
+    json_t *o = decode_snapshot_block(snapshot, (int) sizeof snapshot, -12, compact);
+    bench_keep_ptr(o);
+    json_decref(o);
+  }
+}
+
+/* json */
+
+static void
+b_json_add_hex_ascii(void *ctx, uint64_t n) {
+  (void) ctx;
+  for (uint64_t i = 0; i < n; i++) {
+    json_t *o = json_object();
+    json_add_hex_ascii(o, "hex", snapshot, sizeof snapshot);
+    bench_keep_ptr(o);
+    json_decref(o);
+  }
+}
+
+/* a `read all`-sized document */
+static json_t *
+read_doc(uint64_t i) {
+  static const char *const keys[] = {
+    "vin_V", "vout_V", "iout_A", "temp1_C", "temp2_C", "duty_pct", "freq_kHz",
+  };
+  json_t *o = json_object();
+
+  for (size_t k = 0; k < sizeof keys / sizeof keys[0]; k++)
+    json_object_set_new(o, keys[k], json_real(pmbus_lin11_to_double(raw_lin11[(i + k) & (RAW_LEN - 1)])));
+
+  return o;
+}
+
+static void
+b_json_print_or_pretty(void *ctx, uint64_t n) {
+  int pretty = ctx != NULL;
+
+  for (uint64_t i = 0; i < n; i++)
+    json_print_or_pretty(read_doc(i), pretty);  /* takes ownership */
+}
+
+int
+main(int argc, char *const *argv) {
+  static const struct status_case byte = { decode_status_byte }, vout = { decode_status_vout },
+    iout = { decode_status_iout }, input = { decode_status_input },
+    temp = { decode_status_temperature }, cml = { decode_status_cml };
+  static int on = 1;
+
+  fill_inputs();
+  bench_init();
+
+  if (bench_selected(argc, argv, "lin")) {
+    bench_run("pmbus_lin11_to_double", b_pmbus_lin11_to_double, NULL);
+    bench_run("pmbus_lin11_decode_n (per sample)", b_lin11_decode_n, NULL);
+    bench_run("lin16u_to_units", b_lin16u_to_units, NULL);
+    bench_run("units_to_lin16u", b_units_to_lin16u, NULL);
+    bench_run("units_to_lin11", b_units_to_lin11, NULL);
+  }
+
+  if (bench_selected(argc, argv, "status")) {
+    bench_run("decode_status_byte", b_decode_status, (void *) &byte);
+    bench_run("decode_status_word", b_decode_status_word, NULL);
+    bench_run("decode_status_vout", b_decode_status, (void *) &vout);
+    bench_run("decode_status_iout", b_decode_status, (void *) &iout);
+    bench_run("decode_status_input", b_decode_status, (void *) &input);
+    bench_run("decode_status_temperature", b_decode_status, (void *) &temp);
+    bench_run("decode_status_cml", b_decode_status, (void *) &cml);
+    bench_run("status_flags (compact)", b_status_flags, NULL);
+    bench_run("status_word_flags (compact)", b_status_word_flags, NULL);
+  }
+
+  if (bench_selected(argc, argv, "snapshot")) {
+    bench_run("decode_snapshot_block", b_decode_snapshot_block, NULL);
+    bench_run("decode_snapshot_block (compact)", b_decode_snapshot_block, &on);
+  }
+
+  if (bench_selected(argc, argv, "json")) {
+    bench_run("json_add_hex_ascii (32 B)", b_json_add_hex_ascii, NULL);
+    bench_quiet_stdout();
+    bench_run("json_print_or_pretty (read all)", b_json_print_or_pretty, NULL);
+    bench_run("json_print_or_pretty (read all, pretty)", b_json_print_or_pretty, &on);
+  }
+
+  return 0;
+}
@@ -0,0 +1,185 @@
+/* SPDX-License-Identifier: AGPL-3.0-or-later */
+#define _DEFAULT_SOURCE
+
+#include "fake_bus.h"
+#include "bench.h"
+
+#include "pmbus_io.h"
+#include "pmbus_regs.h"
+
+#include <i2c/smbus.h>
+#include <sys/mman.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define FAKE_BLOCK_MAX 32
+
+static uint16_t word[256];
+static uint8_t block[256][FAKE_BLOCK_MAX];
+static uint8_t block_len[256];
+static enum pmbus_xfer xfer[256];
+static bool present[256];
+
+static struct fake_bus_stats *stats;
+static int64_t bit_ps;                  /* one SCL period in picoseconds */
+static int64_t overhead_ns;
+
+static void
+set_word(uint8_t cmd, uint16_t v) {
+  word[cmd] = v;
+}
+
+static void
+set_block(uint8_t cmd, const void *p, uint8_t n) {
+  memcpy(block[cmd], p, n);
+  block_len[cmd] = n;
+  xfer[cmd] = XFER_BLOCK;
+  present[cmd] = true;
+}
+
+static void
+fake_bus_regs(void) {
+  /* every register this tool knows answers with its own transfer type */
+  for (int c = 0; c < 256; c++) {
+    xfer[c] = pmbus_regs[c].xfer;
+    present[c] = pmbus_regs[c].name != NULL && pmbus_regs[c].xfer != XFER_BLOCK;
+  }
+
+  set_word(PMBUS_VOUT_MODE, 0x14);                  /* linear, 2^-12 */
+  set_word(PMBUS_VOUT_COMMAND, 0x1000);
+  set_word(PMBUS_READ_VIN, 0xD360);                 /* 12.0 V */
+  set_word(PMBUS_READ_VOUT, 0x1001);
+  set_word(PMBUS_READ_IOUT, 0xDA40);                /* 18.0 A */
+  set_word(PMBUS_READ_TEMPERATURE_1, 0xE2D0);
+  set_word(PMBUS_READ_TEMPERATURE_2, 0xE2A0);
+  set_word(PMBUS_READ_DUTY_CYCLE, 0xC2A0);
+  set_word(PMBUS_READ_FREQUENCY, 0x0190);
+  set_word(PMBUS_STATUS_WORD, 0x0000);
+
+  set_block(MFR_MODEL, "BMR685", 6);
+  set_block(MFR_SERIAL, "SN0000001", 9);
+
+  uint8_t snap[32] = { 0 };
+  snap[28] = 100;
+  set_block(MFR_GET_SNAPSHOT, snap, sizeof snap);
+  xfer[MFR_SNAPSHOT_CYCLES_SELECT] = XFER_BYTE;
+  present[MFR_SNAPSHOT_CYCLES_SELECT] = true;
+}
+
+void
+fake_bus_init(unsigned khz, unsigned overhead_us) {
+  if (!stats) {
+    stats = mmap(NULL, sizeof *stats, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (stats == MAP_FAILED) {
+      perror("mmap");
+      exit(1);
+    }
+    fake_bus_regs();
+  }
+
+  bit_ps = 1000000000LL / khz;
+  overhead_ns = (int64_t) overhead_us * 1000;
+  fake_bus_reset();
+}
+
+const struct fake_bus_stats *
+fake_bus_stats(void) {
+  return stats;
+}
+
+void
+fake_bus_reset(void) {
+  memset(stats, 0, sizeof *stats);
+}
+
+/* bytes on the wire (address bytes included) plus START/repeated START/STOP */
+static void
+wire(unsigned bytes, unsigned conditions) {
+  unsigned bits = 9 * bytes + conditions;
+  int64_t t = (int64_t) bits * bit_ps / 1000 + overhead_ns;
+  int64_t end = bench_now_ns() + t;
+
+  while (bench_now_ns() < end)
+    ;
+
+  stats->tx++;
+  stats->bits += bits;
+  stats->busy_ns += t;
+}
+
+static int
+nack(void) {
+  errno = ENXIO;
+  return -1;
+}
+
+/* write: address, command [, data] */
+#define WR(n) wire(2 + (n), 2)
+/* read: address, command, repeated start, address, data */
+#define RD(n) wire(3 + (n), 3)
+
+__s32
+i2c_smbus_write_byte(int file, __u8 value) {
+  (void) file;
+  WR(0);
+  return present[value] && xfer[value] == XFER_SEND ? 0 : nack();
+}
+
+__s32
+i2c_smbus_read_byte_data(int file, __u8 command) {
+  (void) file;
+  RD(1);
+  return present[command] && xfer[command] == XFER_BYTE ? word[command] & 0xFF : nack();
+}
+
+__s32
+i2c_smbus_write_byte_data(int file, __u8 command, __u8 value) {
+  (void) file;
+  WR(1);
+  if (!present[command] || xfer[command] != XFER_BYTE)
+    return nack();
+  word[command] = value;
+  return 0;
+}
+
+__s32
+i2c_smbus_read_word_data(int file, __u8 command) {
+  (void) file;
+  RD(2);
+  return present[command] && xfer[command] == XFER_WORD ? word[command] : nack();
+}
+
+__s32
+i2c_smbus_write_word_data(int file, __u8 command, __u16 value) {
+  (void) file;
+  WR(2);
+  if (!present[command] || xfer[command] != XFER_WORD)
+    return nack();
+  word[command] = value;
+  return 0;
+}
+
+__s32
+i2c_smbus_read_block_data(int file, __u8 command, __u8 *values) {
+  (void) file;
+  if (!present[command] || xfer[command] != XFER_BLOCK) {
+    RD(1);
+    return nack();
+  }
+  RD(1 + block_len[command]);
+  memcpy(values, block[command], block_len[command]);
+  return block_len[command];
+}
+
+__s32
+i2c_smbus_write_block_data(int file, __u8 command, __u8 length, const __u8 *values) {
+  (void) file;
+  WR(1 + length);
+  if (!present[command] || xfer[command] != XFER_BLOCK || length > FAKE_BLOCK_MAX)
+    return nack();
+  memcpy(block[command], values, length);
+  block_len[command] = length;
+  return 0;
+}
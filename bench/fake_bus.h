@@ -0,0 +1,23 @@
+/* SPDX-License-Identifier: AGPL-3.0-or-later */
+#pragma once
+
+#include <stdint.h>
+
+/*
+ * Emulated BMR685 behind the libi2c calls pmbus_io.c makes: the bench executable defines
+ * i2c_smbus_*() itself, so the real command code runs unchanged against it.
+ *
+ * Every transaction costs its SMBus bit count (9 bits per byte including ACK, plus START,
+ * repeated START and STOP) at the configured clock, plus a fixed per-transfer overhead for
+ * the driver, and is busy-waited so the timing is exact even at 1 MHz.
+ */
+struct fake_bus_stats {
+  uint64_t tx;                  /* transactions */
+  uint64_t bits;
+  int64_t busy_ns;              /* time spent "on the wire", including overhead */
+};
+
+/* stats live in shared memory so they survive fork() */
+void fake_bus_init(unsigned khz, unsigned overhead_us);
+const struct fake_bus_stats *fake_bus_stats(void);
+void fake_bus_reset(void);
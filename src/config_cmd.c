@@ -0,0 +1,898 @@
+/* SPDX-License-Identifier: AGPL-3.0-or-later */
+
+#include "pmbus_io.h"
+#include "pmbus_regs.h"
+#include "mfr_save_restore.h"
+#include "util_json.h"
+#include "util_lin.h"
+
+#include <jansson.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <ctype.h>
+#include <errno.h>
+#include <math.h>
+#include <pthread.h>
+
+/*
+ * Declarative configuration.
+ *
+ * A config file is a JSON object whose "registers" member (or the object itself) maps table
+ * names to values: engineering units for LIN11/LIN16U registers, the raw integer otherwise, or
+ * a "0xHHHH" string for an exact raw code. Desired values are converted to raw codes with the
+ * device's own VOUT_MODE before diffing, so a value that quantizes to what is already stored
+ * is not rewritten.
+ */
+
+#define CONFIG_FORMAT "bmr-config"
+#define CONFIG_VERSION 1
+
+struct cfg_item {
+  uint8_t cmd;
+  uint16_t want;
+  int cur;                      /* <0: read failed */
+  int stage;
+};
+
+/* write stages, lowest first */
+enum {
+  STAGE_RELAX,                  /* limits moving away from the operating point, write-protect off */
+  STAGE_CONFIG,
+  STAGE_VOUT,
+  STAGE_TIGHTEN,                /* limits moving towards the operating point */
+  STAGE_CONTROL,                /* ON_OFF_CONFIG, OPERATION */
+  STAGE_PROTECT,                /* write-protect on */
+};
+
+static const uint8_t cfg_upper_limits[] = {
+  PMBUS_VOUT_MAX, PMBUS_VOUT_OV_FAULT_LIMIT, PMBUS_VOUT_OV_WARN_LIMIT,
+  PMBUS_IOUT_OC_FAULT_LIMIT, PMBUS_IOUT_OC_WARN_LIMIT, PMBUS_OT_FAULT_LIMIT, PMBUS_OT_WARN_LIMIT,
+  PMBUS_VIN_OV_FAULT_LIMIT, PMBUS_VIN_OV_WARN_LIMIT,
+};
+
+static const uint8_t cfg_lower_limits[] = {
+  PMBUS_VOUT_UV_WARN_LIMIT, PMBUS_VOUT_UV_FAULT_LIMIT, PMBUS_IOUT_OC_LV_FAULT_LIMIT,
+  PMBUS_UT_WARN_LIMIT, PMBUS_UT_FAULT_LIMIT, PMBUS_VIN_UV_WARN_LIMIT, PMBUS_VIN_UV_FAULT_LIMIT,
+};
+
+static void
+usage_config(void) {
+  fprintf(stderr,
+"config apply FILE.json [--dry-run] [--save]\n"
+"config dump [--out FILE | --out-dir DIR]\n"
+"config verify --golden FILE [--device BUS:ADDR]... [--devices LIST] [--tolerance PCT]\n"
+  );
+}
+
+static bool
+in_list(uint8_t cmd, const uint8_t *l, size_t n) {
+  for (size_t i = 0; i < n; i++)
+    if (l[i] == cmd)
+      return true;
+
+  return false;
+}
+
+/*
+ * Limits are relaxed before VOUT_COMMAND moves and tightened after, so no intermediate
+ * state trips a fault; output control goes last.
+ */
+static int
+cfg_stage(const struct cfg_item *it, int exp5) {
+  double from = it->cur >= 0 ? pmbus_reg_to_units(it->cmd, (uint16_t) it->cur, exp5) : 0.0;
+  double to = pmbus_reg_to_units(it->cmd, it->want, exp5);
+
+  if (it->cmd == PMBUS_WRITE_PROTECT)
+    return it->want ? STAGE_PROTECT : STAGE_RELAX;
+  if (it->cmd == PMBUS_OPERATION || it->cmd == PMBUS_ON_OFF_CONFIG)
+    return STAGE_CONTROL;
+  if (it->cmd == PMBUS_VOUT_COMMAND)
+    return STAGE_VOUT;
+  if (in_list(it->cmd, cfg_upper_limits, sizeof cfg_upper_limits))
+    return to > from ? STAGE_RELAX : STAGE_TIGHTEN;
+  if (in_list(it->cmd, cfg_lower_limits, sizeof cfg_lower_limits))
+    return to < from ? STAGE_RELAX : STAGE_TIGHTEN;
+
+  return STAGE_CONFIG;
+}
+
+static int
+cfg_item_cmp(const void *a, const void *b) {
+  const struct cfg_item *x = a, *y = b;
+
+  if (x->stage != y->stage)
+    return x->stage - y->stage;
+
+  return (int) x->cmd - (int) y->cmd;
+}
+
+/*
+ * LIN11 has several codes per value (3.5 is 448*2^-7 and 896*2^-8): a register holds the
+ * wanted setting when the values match, whatever code the device chose to keep.
+ */
+static bool
+cfg_same(uint8_t cmd, int cur, uint16_t want, int exp5) {
+  if (cur < 0)
+    return false;
+  if ((uint16_t) cur == want)
+    return true;
+
+  const struct pmbus_reg *r = pmbus_reg(cmd);
+
+  return r && r->fmt == FMT_LIN11 &&
+         pmbus_reg_to_units(cmd, (uint16_t) cur, exp5) == pmbus_reg_to_units(cmd, want, exp5);
+}
+
+static json_t *
+cfg_value_json(uint8_t cmd, uint16_t raw, int exp5) {
+  const struct pmbus_reg *r = pmbus_reg(cmd);
+
+  if (r && (r->fmt == FMT_LIN11 || r->fmt == FMT_LIN16U))
+    return json_real(pmbus_reg_to_units(cmd, raw, exp5));
+
+  return json_integer(raw);
+}
+
+/* file value -> raw code; <0 with a message on stderr if the value is unusable */
+static int
+cfg_want(uint8_t cmd, json_t *v, int exp5, uint16_t *out) {
+  const struct pmbus_reg *r = pmbus_reg(cmd);
+
+  if (json_is_string(v)) {
+    if (parse_u16(json_string_value(v), out) < 0)
+      return -1;
+    return r->xfer == XFER_BYTE && *out > 0xFF ? -1 : 0;
+  }
+
+  if (!json_is_number(v))
+    return -1;
+
+  double d = json_number_value(v);
+  if (r->fmt == FMT_LIN16U && d < 0)
+    return -1;
+  if (r->fmt != FMT_LIN11 && r->fmt != FMT_LIN16U &&
+      (d < 0 || d > (r->xfer == XFER_BYTE ? 0xFF : 0xFFFF)))
+    return -1;
+
+  *out = pmbus_units_to_reg(cmd, d, exp5);
+
+  /*
+   * The encoders saturate silently (20 V in LIN16U with exp5 = -12 comes out as 15.9998 V):
+   * the code must decode back to within one LSB of the value asked for. For LIN11 the LSB
+   * is 2^E of the chosen code; 0 carries E = 0, so it gets the finest step instead.
+   */
+  if (r->fmt == FMT_LIN11 || r->fmt == FMT_LIN16U) {
+    double got = pmbus_reg_to_units(cmd, *out, exp5);
+    double lsb = r->fmt == FMT_LIN16U ? ldexp(1.0, exp5) :
+                 *out ? lin11_exp2[*out >> 11] : ldexp(1.0, -16);
+
+    if (fabs(got - d) > lsb) {
+      fprintf(stderr, "%s: %g is out of range (would be written as %g)\n", r->name, d, got);
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+/* CRC-32 (IEEE 802.3), bitwise: dump files are a few kB */
+static uint32_t
+crc32_ieee(const char *p, size_t n) {
+  uint32_t c = 0xFFFFFFFFu;
+
+  for (size_t i = 0; i < n; i++) {
+    c ^= (uint8_t) p[i];
+    for (int k = 0; k < 8; k++)
+      c = (c >> 1) ^ (0xEDB88320u & (0u - (c & 1u)));
+  }
+
+  return ~c;
+}
+
+/* over the compact, key-sorted serialization of everything but "checksum" itself */
+static uint32_t
+config_checksum(json_t *root) {
+  json_t *copy = json_copy(root);
+  uint32_t crc = 0;
+
+  json_object_del(copy, "checksum");
+
+  char *s = json_dumps(copy, JSON_COMPACT | JSON_SORT_KEYS);
+  if (s) {
+    crc = crc32_ieee(s, strlen(s));
+    free(s);
+  }
+  json_decref(copy);
+
+  return crc;
+}
+
+/* parsed config file, or NULL (with a message) if unreadable or its checksum does not match */
+static json_t *
+config_read_file(const char *path) {
+  json_error_t err;
+  json_t *root = json_load_file(path, 0, &err);
+
+  if (!root) {
+    fprintf(stderr, "%s:%d: %s\n", path, err.line, err.text);
+    return NULL;
+  }
+
+  json_t *sum = json_object_get(root, "checksum");
+  if (sum) {
+    char want[16];
+
+    snprintf(want, sizeof want, "%08x", config_checksum(root));
+    if (!json_is_string(sum) || strcmp(json_string_value(sum), want)) {
+      fprintf(stderr, "%s: checksum mismatch\n", path);
+      json_decref(root);
+      return NULL;
+    }
+  }
+
+  return root;
+}
+
+static int
+config_load(const char *path, int exp5, unsigned model, struct cfg_item *items, int *count,
+            json_t *skipped) {
+  json_t *root = config_read_file(path);
+
+  if (!root)
+    return -1;
+
+  json_t *regs = json_object_get(root, "registers");
+  if (!regs)
+    regs = root;
+
+  const char *name;
+  json_t *v;
+  int n = 0, rc = 0;
+
+  json_object_foreach(regs, name, v) {
+    int cmd = pmbus_reg_by_name(name);
+    const struct pmbus_reg *r = cmd >= 0 ? pmbus_reg((uint8_t) cmd) : NULL;
+
+    if (!r || !(r->flags & REG_W) || (r->flags & REG_CMD) ||
+        (r->xfer != XFER_BYTE && r->xfer != XFER_WORD)) {
+      fprintf(stderr, "%s: not a configurable byte/word register\n", name);
+      rc = -1;
+      continue;
+    }
+    if (!pmbus_reg_supported((uint8_t) cmd, model)) {
+      json_array_append_new(skipped, json_string(name));
+      continue;
+    }
+
+    struct cfg_item *it = &items[n];
+    it->cmd = (uint8_t) cmd;
+    if (cfg_want(it->cmd, v, exp5, &it->want) < 0) {
+      fprintf(stderr, "%s: invalid value\n", name);
+      rc = -1;
+      continue;
+    }
+    n++;
+  }
+
+  json_decref(root);
+  *count = n;
+
+  return rc;
+}
+
+static int
+config_apply(int fd, const char *path, bool dry_run, bool save, int pretty) {
+  struct cfg_item items[256];
+  int n = 0;
+  int exp5 = 0;
+  unsigned model = pmbus_model(fd);
+  json_t *skipped = json_array();
+
+  pmbus_get_vout_mode_exp(fd, &exp5);
+
+  if (config_load(path, exp5, model, items, &n, skipped) < 0) {
+    json_decref(skipped);
+    return 2;
+  }
+
+  /* one readback sweep, then diff on quantized values */
+  for (int i = 0; i < n; i++)
+    items[i].cur = pmbus_reg_rd(fd, items[i].cmd);
+
+  int nw = 0;
+  for (int i = 0; i < n; i++) {
+    if (cfg_same(items[i].cmd, items[i].cur, items[i].want, exp5))
+      continue;
+    items[i].stage = cfg_stage(&items[i], exp5);
+    items[nw++] = items[i];
+  }
+  qsort(items, (size_t) nw, sizeof items[0], cfg_item_cmp);
+
+  json_t *out = json_object();
+  json_t *changed = json_object();
+  json_t *order = json_array();
+  int rc = 0;
+
+  json_object_set_new(out, "registers", json_integer(n));
+  json_object_set_new(out, "skipped", skipped);
+
+  for (int i = 0; i < nw; i++) {
+    const struct cfg_item *it = &items[i];
+    json_t *c = json_object();
+
+    json_object_set_new(c, "from", it->cur >= 0 ? cfg_value_json(it->cmd, (uint16_t) it->cur, exp5) : json_null());
+    json_object_set_new(c, "to", cfg_value_json(it->cmd, it->want, exp5));
+    json_object_set_new(changed, pmbus_regs[it->cmd].name, c);
+
+    if (dry_run || rc)
+      continue;
+    /* stop at the first failure: later stages assume the earlier ones landed */
+    if (pmbus_reg_wr(fd, it->cmd, it->want) < 0) {
+      perror(pmbus_regs[it->cmd].name);
+      json_object_set_new(c, "error", json_string("write failed"));
+      rc = 1;
+      continue;
+    }
+    json_array_append_new(order, json_string(pmbus_regs[it->cmd].name));
+  }
+  json_object_set_new(out, "changed", changed);
+  json_object_set_new(out, "written", order);
+
+  if (!dry_run && nw) {
+    json_t *bad = json_object();
+
+    for (int i = 0; i < nw; i++) {
+      int got = pmbus_reg_rd(fd, items[i].cmd);
+
+      if (cfg_same(items[i].cmd, got, items[i].want, exp5))
+        continue;
+      json_object_set_new(bad, pmbus_regs[items[i].cmd].name,
+                          got >= 0 ? cfg_value_json(items[i].cmd, (uint16_t) got, exp5) : json_null());
+    }
+    if (json_object_size(bad))
+      rc = 1;
+    json_object_set_new(out, "verify_failed", bad);
+  }
+
+  /* even with nothing written here, earlier unsaved changes may still need the store */
+  bool saved = false;
+  if (save && !dry_run && !rc) {
+    int64_t ready_us;
+    int s = store_user_all_coalesced(fd, model, false, &ready_us);
+
+    if (s < 0)
+      rc = 1;
+    saved = s > 0;
+    if (saved)
+      json_object_set_new(out, "store_ready_ms", json_real((double) ready_us / 1000.0));
+  }
+  json_object_set_new(out, "saved", json_boolean(saved));
+  json_object_set_new(out, "dry_run", json_boolean(dry_run));
+
+  json_print_or_pretty(out, pretty);
+
+  return rc;
+}
+
+/* MFR id block as a trimmed printable string ("" if unreadable) */
+static void
+rd_id_string(int fd, uint8_t cmd, char *out, size_t len) {
+  uint8_t b[64];
+  int n = pmbus_rd_block(fd, cmd, b, (int) sizeof b);
+  size_t k = 0;
+
+  for (int i = 0; i < n && k + 1 < len; i++)
+    if (isprint(b[i]))
+      out[k++] = (char) b[i];
+  while (k && out[k - 1] == ' ')
+    k--;
+  out[k] = '\0';
+}
+
+/*
+ * Byte/word registers go under "registers" in the same form config apply takes, so a dump
+ * can be applied to another unit as-is; block registers are kept as hex under "blocks".
+ */
+static int
+config_dump(int fd, const char *out, const char *out_dir, int pretty) {
+  unsigned model = pmbus_model(fd);
+  int exp5 = 0;
+  char mdl[32], rev[32], sn[32];
+
+  pmbus_get_vout_mode_exp(fd, &exp5);
+  rd_id_string(fd, MFR_MODEL, mdl, sizeof mdl);
+  rd_id_string(fd, MFR_REVISION, rev, sizeof rev);
+  rd_id_string(fd, MFR_SERIAL, sn, sizeof sn);
+
+  json_t *root = json_object();
+  json_t *dev = json_object();
+  json_t *regs = json_object();
+  json_t *blocks = json_object();
+  json_t *failed = json_array();
+
+  json_object_set_new(dev, "model", json_string(mdl));
+  json_object_set_new(dev, "revision", json_string(rev));
+  json_object_set_new(dev, "serial", json_string(sn));
+
+  for (int c = 0; c < 256; c++) {
+    if (!pmbus_reg_config((uint8_t) c, model))
+      continue;
+
+    const struct pmbus_reg *r = &pmbus_regs[c];
+    if (r->xfer == XFER_BLOCK) {
+      uint8_t b[255];
+      int n = pmbus_rd_block(fd, (uint8_t) c, b, (int) sizeof b);
+
+      if (n < 0)
+        json_array_append_new(failed, json_string(r->name));
+      else
+        json_add_hex_ascii(blocks, r->name, b, (size_t) n);
+      continue;
+    }
+
+    int v = pmbus_reg_rd(fd, (uint8_t) c);
+    if (v < 0)
+      json_array_append_new(failed, json_string(r->name));
+    else
+      json_object_set_new(regs, r->name, cfg_value_json((uint8_t) c, (uint16_t) v, exp5));
+  }
+
+  json_object_set_new(root, "format", json_string(CONFIG_FORMAT));
+  json_object_set_new(root, "version", json_integer(CONFIG_VERSION));
+  json_object_set_new(root, "device", dev);
+  json_object_set_new(root, "vout_mode_exp", json_integer(exp5));
+  json_object_set_new(root, "registers", regs);
+  json_object_set_new(root, "blocks", blocks);
+  json_object_set_new(root, "unreadable", failed);
+
+  char sum[16];
+  snprintf(sum, sizeof sum, "%08x", config_checksum(root));
+  json_object_set_new(root, "checksum", json_string(sum));
+
+  char path[512];
+  if (out_dir) {
+    snprintf(path, sizeof path, "%s/%s_%s_%s.json", out_dir, mdl[0] ? mdl : "unknown",
+             rev[0] ? rev : "unknown", sn[0] ? sn : "unknown");
+    for (char *p = path + strlen(out_dir) + 1; *p; p++)
+      if (*p == '/' || *p == ' ')
+        *p = '_';
+    out = path;
+  }
+
+  if (!out) {
+    json_print_or_pretty(root, pretty);
+    return 0;
+  }
+
+  int rc = json_dump_file(root, out, (pretty ? JSON_INDENT(2) : JSON_COMPACT) | JSON_SORT_KEYS);
+  json_decref(root);
+  if (rc < 0) {
+    perror(out);
+    return 1;
+  }
+  puts(out);
+
+  return 0;
+}
+
+/*
+ * config verify: golden image vs. live registers on many devices, read-only.
+ *
+ * The golden file is flattened into gold_reg[] before any thread starts, so workers only
+ * touch their own fds and result objects. Devices are grouped by bus and each bus gets one
+ * worker: transfers on one adapter serialize anyway, different adapters run in parallel.
+ */
+struct gold_reg {
+  uint8_t cmd;
+  bool exact;                   /* "0xHHHH" in the file: compare codes */
+  uint16_t code;                /* golden code (for exact, and for its LIN11 exponent) */
+  double units;
+  const char *hex;              /* block registers */
+};
+
+struct golden {
+  struct gold_reg *regs;
+  int n;
+  int exp5;                     /* VOUT_MODE exponent the image was taken with */
+  double tol_pct;
+};
+
+struct vdev {
+  const char *bus;
+  int addr;
+  json_t *result;
+};
+
+struct vbus {
+  const struct golden *g;
+  struct vdev *devs;
+  int n;
+  pthread_t tid;
+  bool started;
+};
+
+static double
+cfg_lsb(uint8_t cmd, uint16_t code, int exp5) {
+  const struct pmbus_reg *r = pmbus_reg(cmd);
+
+  if (r->fmt == FMT_LIN16U)
+    return ldexp(1.0, exp5);
+
+  return ldexp(1.0, lin11_exponent(code));
+}
+
+static int
+golden_load(const char *path, struct golden *g) {
+  json_t *root = config_read_file(path);
+
+  if (!root)
+    return -1;
+
+  json_t *regs = json_object_get(root, "registers");
+  json_t *blocks = json_object_get(root, "blocks");
+  json_t *e = json_object_get(root, "vout_mode_exp");
+  if (!regs)
+    regs = root;
+
+  g->exp5 = json_is_integer(e) ? (int) json_integer_value(e) : 0;
+  g->n = 0;
+  g->regs = calloc(json_object_size(regs) + json_object_size(blocks), sizeof g->regs[0]);
+
+  const char *name;
+  json_t *v;
+  int rc = 0;
+
+  json_object_foreach(regs, name, v) {
+    int cmd = pmbus_reg_by_name(name);
+    const struct pmbus_reg *r = cmd >= 0 ? pmbus_reg((uint8_t) cmd) : NULL;
+    struct gold_reg *gr = &g->regs[g->n];
+
+    if (!r || r->xfer == XFER_BLOCK || r->xfer == XFER_SEND ||
+        (!json_is_number(v) && !json_is_string(v))) {
+      fprintf(stderr, "%s: not a byte/word register value\n", name);
+      rc = -1;
+      continue;
+    }
+    gr->cmd = (uint8_t) cmd;
+    if (json_is_string(v)) {
+      if (parse_u16(json_string_value(v), &gr->code) < 0) {
+        fprintf(stderr, "%s: invalid value\n", name);
+        rc = -1;
+        continue;
+      }
+      gr->exact = true;
+    } else {
+      gr->units = json_number_value(v);
+      gr->code = pmbus_units_to_reg(gr->cmd, gr->units, g->exp5);
+    }
+    g->n++;
+  }
+
+  json_object_foreach(blocks, name, v) {
+    int cmd = pmbus_reg_by_name(name);
+
+    if (cmd < 0 || !json_is_string(v))
+      continue;
+    g->regs[g->n].cmd = (uint8_t) cmd;
+    g->regs[g->n].hex = strdup(json_string_value(v));
+    g->n++;
+  }
+
+  json_decref(root);
+
+  return rc;
+}
+
+static void
+verify_fd(const struct golden *g, int fd, json_t *o) {
+  unsigned model = pmbus_model(fd);
+  int exp5 = 0;
+  char sn[32];
+
+  pmbus_get_vout_mode_exp(fd, &exp5);
+  rd_id_string(fd, MFR_SERIAL, sn, sizeof sn);
+  json_object_set_new(o, "serial", json_string(sn));
+
+  json_t *bad = json_object();
+  json_t *unreadable = json_array();
+
+  for (int i = 0; i < g->n; i++) {
+    const struct gold_reg *gr = &g->regs[i];
+    const char *name = pmbus_regs[gr->cmd].name;
+
+    if (!pmbus_reg_supported(gr->cmd, model))
+      continue;
+
+    if (gr->hex) {
+      uint8_t b[255];
+      int n = pmbus_rd_block(fd, gr->cmd, b, (int) sizeof b);
+      if (n < 0) {
+        json_array_append_new(unreadable, json_string(name));
+        continue;
+      }
+
+      json_t *t = json_object();
+      json_add_hex_ascii(t, "live", b, (size_t) n);
+      if (strcmp(json_string_value(json_object_get(t, "live")), gr->hex)) {
+        json_object_set_new(t, "golden", json_string(gr->hex));
+        json_object_set_new(bad, name, t);
+      } else {
+        json_decref(t);
+      }
+      continue;
+    }
+
+    int v = pmbus_reg_rd(fd, gr->cmd);
+    if (v < 0) {
+      json_array_append_new(unreadable, json_string(name));
+      continue;
+    }
+
+    bool ok;
+    const struct pmbus_reg *r = &pmbus_regs[gr->cmd];
+    if (gr->exact || (r->fmt != FMT_LIN11 && r->fmt != FMT_LIN16U)) {
+      ok = cfg_same(gr->cmd, v, gr->code, exp5);
+    } else {
+      /* both sides are quantized: allow half an LSB of each, plus the relative tolerance */
+      double live = pmbus_reg_to_units(gr->cmd, (uint16_t) v, exp5);
+      double tol = (cfg_lsb(gr->cmd, (uint16_t) v, exp5) + cfg_lsb(gr->cmd, gr->code, g->exp5)) / 2 +
+                   fabs(gr->units) * g->tol_pct / 100.0;
+
+      ok = fabs(live - gr->units) <= tol;
+    }
+    if (ok)
+      continue;
+
+    json_t *t = json_object();
+    json_object_set_new(t, "golden", gr->exact ? json_integer(gr->code) : cfg_value_json(gr->cmd, gr->code, g->exp5));
+    json_object_set_new(t, "live", gr->exact ? json_integer(v) : cfg_value_json(gr->cmd, (uint16_t) v, exp5));
+    json_object_set_new(bad, name, t);
+  }
+
+  json_object_set_new(o, "ok", json_boolean(!json_object_size(bad) && !json_array_size(unreadable)));
+  json_object_set_new(o, "mismatches", bad);
+  json_object_set_new(o, "unreadable", unreadable);
+}
+
+static json_t *
+verify_device(const struct golden *g, const char *bus, int addr) {
+  json_t *o = json_object();
+  char id[300];
+
+  snprintf(id, sizeof id, "%s:0x%02x", bus, addr);
+  json_object_set_new(o, "device", json_string(id));
+
+  int fd = pmbus_open(bus, addr);
+  if (fd < 0) {
+    json_object_set_new(o, "error", json_string(strerror(errno)));
+    json_object_set_new(o, "ok", json_false());
+    return o;
+  }
+  verify_fd(g, fd, o);
+  pmbus_close(fd);
+
+  return o;
+}
+
+static void *
+verify_bus(void *arg) {
+  struct vbus *b = arg;
+
+  for (int i = 0; i < b->n; i++)
+    b->devs[i].result = verify_device(b->g, b->devs[i].bus, b->devs[i].addr);
+
+  return NULL;
+}
+
+static int
+parse_device(char *s, struct vdev *d) {
+  if (pmbus_parse_dev(s, &d->bus, &d->addr) < 0)
+    return -1;
+  d->result = NULL;
+
+  return 0;
+}
+
+static int
+vdev_cmp(const void *a, const void *b) {
+  const struct vdev *x = a, *y = b;
+  int c = strcmp(x->bus, y->bus);
+
+  return c ? c : x->addr - y->addr;
+}
+
+static int
+verify_print(json_t *arr, int pretty) {
+  int rc = 0;
+  size_t i;
+  json_t *v;
+
+  json_array_foreach(arr, i, v)
+    if (!json_is_true(json_object_get(v, "ok")))
+      rc = 1;
+
+  json_print_or_pretty(arr, pretty);
+
+  return rc;
+}
+
+static int
+config_verify(struct vdev *devs, int ndev, const struct golden *g, int pretty) {
+  qsort(devs, (size_t) ndev, sizeof devs[0], vdev_cmp);
+
+  struct vbus *buses = calloc((size_t) ndev, sizeof buses[0]);
+  int nb = 0;
+
+  for (int i = 0; i < ndev; i++) {
+    if (!nb || strcmp(buses[nb - 1].devs[0].bus, devs[i].bus)) {
+      buses[nb].g = g;
+      buses[nb].devs = &devs[i];
+      nb++;
+    }
+    buses[nb - 1].n++;
+  }
+
+  for (int i = 0; i < nb; i++) {
+    buses[i].started = !pthread_create(&buses[i].tid, NULL, verify_bus, &buses[i]);
+    if (!buses[i].started)
+      verify_bus(&buses[i]);    /* no thread: do it inline */
+  }
+  for (int i = 0; i < nb; i++)
+    if (buses[i].started)
+      pthread_join(buses[i].tid, NULL);
+  free(buses);
+
+  json_t *arr = json_array();
+  for (int i = 0; i < ndev; i++)
+    json_array_append_new(arr, devs[i].result);
+
+  return verify_print(arr, pretty);
+}
+
+/* one BUS:ADDR per line, blank lines and '#' comments ignored */
+static int
+read_device_list(const char *path, struct vdev **devs, int *n, int *cap) {
+  FILE *f = fopen(path, "r");
+
+  if (!f) {
+    perror(path);
+    return -1;
+  }
+
+  char line[300];
+  int rc = 0;
+
+  while (fgets(line, sizeof line, f)) {
+    char *p = line + strspn(line, " \t");
+    p[strcspn(p, " \t\r\n#")] = '\0';
+    if (!*p)
+      continue;
+
+    if (*n == *cap) {
+      *cap = *cap ? *cap * 2 : 64;
+      *devs = realloc(*devs, (size_t) *cap * sizeof **devs);
+    }
+    char *copy = strdup(p);
+    if (parse_device(copy, &(*devs)[*n]) < 0) {
+      fprintf(stderr, "%s: bad device '%s'\n", path, p);
+      free(copy);
+      rc = -1;
+      continue;
+    }
+    (*n)++;
+  }
+  fclose(f);
+
+  return rc;
+}
+
+static int
+cmd_config_verify(int fd, int argc, char *const *argv, int pretty) {
+  const char *golden = NULL;
+  struct golden g = { .tol_pct = 0.0 };
+  struct vdev *devs = NULL;
+  int ndev = 0, cap = 0, rc = 0;
+
+  for (int i = 1; i < argc && !rc; i++) {
+    if (!strcmp(argv[i], "--golden") && i + 1 < argc) {
+      golden = argv[++i];
+    } else if (!strcmp(argv[i], "--tolerance") && i + 1 < argc) {
+      g.tol_pct = strtod(argv[++i], NULL);
+    } else if (!strcmp(argv[i], "--devices") && i + 1 < argc) {
+      if (read_device_list(argv[++i], &devs, &ndev, &cap) < 0)
+        rc = 2;
+    } else if (!strcmp(argv[i], "--device") && i + 1 < argc) {
+      if (ndev == cap) {
+        cap = cap ? cap * 2 : 64;
+        devs = realloc(devs, (size_t) cap * sizeof devs[0]);
+      }
+      char *copy = strdup(argv[++i]);
+      if (parse_device(copy, &devs[ndev]) < 0) {
+        fprintf(stderr, "--device BUS:ADDR (e.g. /dev/i2c-1:0x40)\n");
+        free(copy);
+        rc = 2;
+      } else {
+        ndev++;
+      }
+    } else {
+      usage_config();
+      rc = 2;
+    }
+  }
+
+  if (!rc && !golden) {
+    usage_config();
+    rc = 2;
+  }
+  if (!rc && golden_load(golden, &g) < 0)
+    rc = 2;
+
+  if (!rc) {
+    if (ndev) {
+      rc = config_verify(devs, ndev, &g, pretty);
+    } else {
+      /* no device list: the --bus/--addr device main() opened */
+      json_t *arr = json_array();
+      json_t *o = json_object();
+
+      verify_fd(&g, fd, o);
+      json_array_append_new(arr, o);
+      rc = verify_print(arr, pretty);
+    }
+  }
+
+  for (int i = 0; i < g.n; i++)
+    free((char *) g.regs[i].hex);
+  free(g.regs);
+  for (int i = 0; i < ndev; i++)
+    free((char *) devs[i].bus);
+  free(devs);
+
+  return rc;
+}
+
+int
+cmd_config(int fd, int argc, char *const *argv, int pretty) {
+  if (argc >= 1 && !strcmp(argv[0], "dump")) {
+    const char *out = NULL, *out_dir = NULL;
+
+    for (int i = 1; i < argc; i++) {
+      if (!strcmp(argv[i], "--out") && i + 1 < argc)
+        out = argv[++i];
+      else if (!strcmp(argv[i], "--out-dir") && i + 1 < argc)
+        out_dir = argv[++i];
+      else {
+        usage_config();
+        return 2;
+      }
+    }
+
+    return config_dump(fd, out, out_dir, pretty);
+  }
+
+  if (argc >= 1 && !strcmp(argv[0], "verify"))
+    return cmd_config_verify(fd, argc, argv, pretty);
+
+  if (argc < 2 || strcmp(argv[0], "apply")) {
+    usage_config();
+    return 2;
+  }
+
+  bool dry_run = false;
+  bool save = false;
+
+  for (int i = 2; i < argc; i++) {
+    if (!strcmp(argv[i], "--dry-run"))
+      dry_run = true;
+    else if (!strcmp(argv[i], "--save"))
+      save = true;
+    else {
+      usage_config();
+      return 2;
+    }
+  }
+
+  return config_apply(fd, argv[1], dry_run, save, pretty);
+}
@@ -2,7 +2,12 @@
 
 #include "decoders.h"
 
+#include "pmbus_io.h"
 #include "status.h"
+
+#include <stdio.h>
+#include <string.h>
+
 #define EMIT_STATUS_BYTE(name, bitno) JSON_SET_BIT(o, name, b, (uint8_t)BIT(bitno));
 #define EMIT_STATUS_WORD(name, bitno) JSON_SET_BIT(o, name, w, (uint16_t)BIT(bitno));
 
@@ -68,3 +73,134 @@ decode_status_cml(uint8_t b) {
 
   return o;
 }
+
+struct status_field {
+  const char *name;
+  uint8_t bit;
+};
+
+#define STATUS_FIELD(name, bitno) { name, bitno },
+
+static const struct status_field F_BYTE[] = { STATUS_BYTE_FIELDS(STATUS_FIELD) };
+static const struct status_field F_WORD[] = { STATUS_WORD_FIELDS(STATUS_FIELD) };
+static const struct status_field F_VOUT[] = { STATUS_VOUT_FIELDS(STATUS_FIELD) };
+static const struct status_field F_IOUT[] = { STATUS_IOUT_FIELDS(STATUS_FIELD) };
+static const struct status_field F_INPUT[] = { STATUS_INPUT_FIELDS(STATUS_FIELD) };
+static const struct status_field F_TEMPERATURE[] = { STATUS_TEMPERATURE_FIELDS(STATUS_FIELD) };
+static const struct status_field F_CML[] = { STATUS_CML_FIELDS(STATUS_FIELD) };
+
+/* each row is sized for all names of its register set at once, separators and NUL included */
+static char T_BYTE[256][1 STATUS_BYTE_FIELDS(STATUS_FLAGS_LEN)];
+static char T_WORD_HI[256][STATUS_WORD_FLAGS_MAX];
+static char T_WORD_LO[256][STATUS_WORD_FLAGS_MAX];
+static char T_VOUT[256][1 STATUS_VOUT_FIELDS(STATUS_FLAGS_LEN)];
+static char T_IOUT[256][1 STATUS_IOUT_FIELDS(STATUS_FLAGS_LEN)];
+static char T_INPUT[256][1 STATUS_INPUT_FIELDS(STATUS_FLAGS_LEN)];
+static char T_TEMPERATURE[256][1 STATUS_TEMPERATURE_FIELDS(STATUS_FLAGS_LEN)];
+static char T_CML[256][1 STATUS_CML_FIELDS(STATUS_FLAGS_LEN)];
+
+static const struct {
+  const char *tab;
+  size_t width;
+} SREG_TABS[SREG_COUNT] = {
+  [SREG_BYTE]        = { &T_BYTE[0][0],        sizeof T_BYTE[0] },
+  [SREG_VOUT]        = { &T_VOUT[0][0],        sizeof T_VOUT[0] },
+  [SREG_IOUT]        = { &T_IOUT[0][0],        sizeof T_IOUT[0] },
+  [SREG_INPUT]       = { &T_INPUT[0][0],       sizeof T_INPUT[0] },
+  [SREG_TEMPERATURE] = { &T_TEMPERATURE[0][0], sizeof T_TEMPERATURE[0] },
+  [SREG_CML]         = { &T_CML[0][0],         sizeof T_CML[0] },
+};
+
+/* fill tab[v] with the names of the fields in bits [lsb, lsb+8) that are set in v */
+static void
+build_flags(char *tab, size_t width, const struct status_field *f, size_t nf, unsigned lsb) {
+  for (unsigned v = 0; v < 256; v++) {
+    char *row = tab + v * width;
+    size_t off = 0;
+
+    for (size_t i = 0; i < nf; i++) {
+      if (f[i].bit < lsb || f[i].bit >= lsb + 8 || !(v & (1u << (f[i].bit - lsb))))
+        continue;
+
+      size_t L = strlen(f[i].name);
+      if (off)
+        row[off++] = '|';
+      memcpy(row + off, f[i].name, L);
+      off += L;
+    }
+    row[off] = '\0';
+  }
+}
+
+#define BUILD_FLAGS(T, F, lsb) build_flags(&T[0][0], sizeof T[0], F, sizeof F / sizeof F[0], lsb)
+
+__attribute__((constructor))
+static void
+status_flags_init(void) {
+  BUILD_FLAGS(T_BYTE, F_BYTE, 0);
+  BUILD_FLAGS(T_WORD_HI, F_WORD, 8);
+  BUILD_FLAGS(T_WORD_LO, F_WORD, 0);
+  BUILD_FLAGS(T_VOUT, F_VOUT, 0);
+  BUILD_FLAGS(T_IOUT, F_IOUT, 0);
+  BUILD_FLAGS(T_INPUT, F_INPUT, 0);
+  BUILD_FLAGS(T_TEMPERATURE, F_TEMPERATURE, 0);
+  BUILD_FLAGS(T_CML, F_CML, 0);
+}
+
+const char *
+status_flags(enum status_reg r, uint8_t v) {
+  if (r >= SREG_COUNT)
+    return "";
+
+  return SREG_TABS[r].tab + (size_t) v * SREG_TABS[r].width;
+}
+
+size_t
+status_word_flags(uint16_t w, char *buf, size_t len) {
+  const char *hi = T_WORD_HI[w >> 8];
+  const char *lo = T_WORD_LO[w & 0xFF];
+  int n = snprintf(buf, len, "%s%s%s", hi, (*hi && *lo) ? "|" : "", lo);
+
+  return (n < 0) ? 0 : (size_t) n;
+}
+
+#define STATUS_FIELDS(F) F, sizeof F / sizeof F[0]
+
+static const struct {
+  uint8_t reg;
+  const char *name;
+  const struct status_field *f;
+  size_t n;
+} STATUS_REGS[] = {
+  { PMBUS_STATUS_BYTE,        "STATUS_BYTE",        STATUS_FIELDS(F_BYTE) },
+  { PMBUS_STATUS_WORD,        "STATUS_WORD",        STATUS_FIELDS(F_WORD) },
+  { PMBUS_STATUS_VOUT,        "STATUS_VOUT",        STATUS_FIELDS(F_VOUT) },
+  { PMBUS_STATUS_IOUT,        "STATUS_IOUT",        STATUS_FIELDS(F_IOUT) },
+  { PMBUS_STATUS_INPUT,       "STATUS_INPUT",       STATUS_FIELDS(F_INPUT) },
+  { PMBUS_STATUS_TEMPERATURE, "STATUS_TEMPERATURE", STATUS_FIELDS(F_TEMPERATURE) },
+  { PMBUS_STATUS_CML,         "STATUS_CML",         STATUS_FIELDS(F_CML) },
+};
+
+int
+status_bit_parse(const char *spec, uint8_t *reg, uint16_t *mask) {
+  const char *colon = strchr(spec, ':');
+  size_t len = colon ? (size_t) (colon - spec) : strlen(spec);
+
+  for (size_t r = 0; r < sizeof STATUS_REGS / sizeof STATUS_REGS[0]; r++) {
+    if (strlen(STATUS_REGS[r].name) != len || strncmp(spec, STATUS_REGS[r].name, len))
+      continue;
+
+    uint16_t m = 0;
+    for (size_t i = 0; i < STATUS_REGS[r].n; i++)
+      if (!colon || !strcmp(colon + 1, STATUS_REGS[r].f[i].name))
+        m |= (uint16_t) BIT(STATUS_REGS[r].f[i].bit);
+    if (!m)
+      return -1;
+
+    *reg = STATUS_REGS[r].reg;
+    *mask = m;
+    return 0;
+  }
+
+  return -1;
+}
@@ -2,6 +2,9 @@
 
 #pragma once
 
+#include "status.h"
+
+#include <stddef.h>
 #include <stdint.h>
 #include <jansson.h>
 
@@ -12,3 +15,31 @@ json_t *decode_status_iout(uint8_t v);
 json_t *decode_status_input(uint8_t v);
 json_t *decode_status_temperature(uint8_t v);
 json_t *decode_status_cml(uint8_t v);
+
+/*
+ * Compact decoding: the active flag names joined with '|' ("" when no known bit is set),
+ * looked up in 256-entry tables precomputed from the STATUS_*_FIELDS X-macros.
+ * No allocation; the returned strings are static.
+ */
+enum status_reg : uint8_t {
+  SREG_BYTE,
+  SREG_VOUT,
+  SREG_IOUT,
+  SREG_INPUT,
+  SREG_TEMPERATURE,
+  SREG_CML,
+  SREG_COUNT,
+};
+
+#define STATUS_FLAGS_LEN(name, bitno) + sizeof(name)
+#define STATUS_WORD_FLAGS_MAX (1 STATUS_WORD_FIELDS(STATUS_FLAGS_LEN))
+
+const char *status_flags(enum status_reg r, uint8_t v);
+/* STATUS_WORD needs two lookups (high and low byte) joined into buf */
+size_t status_word_flags(uint16_t w, char *buf, size_t len);
+
+/*
+ * "STATUS_VOUT:VOUT_UV_FAULT" -> STATUS_VOUT opcode and that bit; a bare "STATUS_IOUT" gives
+ * every named bit of the register. -1 if the register or bit is unknown.
+ */
+int status_bit_parse(const char *spec, uint8_t *reg, uint16_t *mask);
@@ -0,0 +1,645 @@
+/* SPDX-License-Identifier: AGPL-3.0-or-later */
+#define _POSIX_C_SOURCE 200809L
+
+#include "pmbus_io.h"
+#include "pmbus_regs.h"
+#include "status.h"
+
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <pthread.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/*
+ * OpenMetrics exporter. One poller thread per bus reads telemetry and status of its devices
+ * every --interval, then re-renders the whole exposition into a cached buffer. A scrape only
+ * copies that buffer out under the lock: no bus I/O, and the same cost for 1 or 100 rails.
+ */
+
+#define EXP_DEFAULT_INTERVAL_MS 1000
+#define EXP_REQ_MAX 4096
+#define EXP_IO_TIMEOUT_MS 1000
+#define EXP_MODEL_LEN 16
+
+/* telemetry: OpenMetrics names carry the unit as suffix */
+static const struct exp_metric {
+  uint8_t reg;
+  const char *name;
+  const char *unit;
+} exp_metrics[] = {
+  { PMBUS_READ_VIN,           "bmr_input_voltage_volts",          "volts" },
+  { PMBUS_READ_VOUT,          "bmr_output_voltage_volts",         "volts" },
+  { PMBUS_READ_IOUT,          "bmr_output_current_amperes",       "amperes" },
+  { PMBUS_READ_TEMPERATURE_1, "bmr_temperature1_celsius",         "celsius" },
+  { PMBUS_READ_TEMPERATURE_2, "bmr_temperature2_celsius",         "celsius" },
+  { PMBUS_READ_DUTY_CYCLE,    "bmr_duty_cycle_percent",           "percent" },
+  { PMBUS_READ_FREQUENCY,     "bmr_switching_frequency_kilohertz", "kilohertz" },
+};
+
+#define EXP_N_METRICS (sizeof exp_metrics / sizeof exp_metrics[0])
+
+struct exp_bit {
+  const char *name;
+  uint8_t bit;
+};
+
+#define EXP_BIT(name, bitno) { name, bitno },
+
+static const struct exp_bit bits_word[] = { STATUS_WORD_FIELDS(EXP_BIT) };
+static const struct exp_bit bits_vout[] = { STATUS_VOUT_FIELDS(EXP_BIT) };
+static const struct exp_bit bits_iout[] = { STATUS_IOUT_FIELDS(EXP_BIT) };
+static const struct exp_bit bits_input[] = { STATUS_INPUT_FIELDS(EXP_BIT) };
+static const struct exp_bit bits_temp[] = { STATUS_TEMPERATURE_FIELDS(EXP_BIT) };
+static const struct exp_bit bits_cml[] = { STATUS_CML_FIELDS(EXP_BIT) };
+
+#define EXP_BITS(a) a, sizeof a / sizeof a[0]
+
+static const struct exp_status {
+  uint8_t reg;
+  const char *name;
+  const struct exp_bit *bits;
+  size_t n;
+} exp_status[] = {
+  { PMBUS_STATUS_WORD,        "STATUS_WORD",        EXP_BITS(bits_word) },
+  { PMBUS_STATUS_VOUT,        "STATUS_VOUT",        EXP_BITS(bits_vout) },
+  { PMBUS_STATUS_IOUT,        "STATUS_IOUT",        EXP_BITS(bits_iout) },
+  { PMBUS_STATUS_INPUT,       "STATUS_INPUT",       EXP_BITS(bits_input) },
+  { PMBUS_STATUS_TEMPERATURE, "STATUS_TEMPERATURE", EXP_BITS(bits_temp) },
+  { PMBUS_STATUS_CML,         "STATUS_CML",         EXP_BITS(bits_cml) },
+};
+
+#define EXP_N_STATUS (sizeof exp_status / sizeof exp_status[0])
+
+/* one poll of one device */
+struct exp_sample {
+  bool up;                      /* STATUS_WORD answered */
+  bool have[EXP_N_METRICS];
+  double val[EXP_N_METRICS];
+  int status[EXP_N_STATUS];     /* -1 if unreadable */
+  struct pmbus_io_stats io;
+  double poll_s;
+  double time_s;                /* CLOCK_REALTIME of the poll */
+};
+
+struct exp_dev {
+  char bus[256];
+  int addr;
+  int fd;
+  bool own_fd;
+  char model[EXP_MODEL_LEN];
+  unsigned model_bits;
+  int exp5;
+  struct exp_sample last;       /* published, under exp_lock */
+};
+
+struct exp_bus {
+  struct exp_dev *devs;
+  int n;
+  pthread_t tid;
+  bool started;
+};
+
+struct exp_buf {
+  char *p;
+  size_t len, cap;
+};
+
+static pthread_mutex_t exp_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t exp_wake;
+static struct exp_dev *exp_devs;
+static int exp_ndev;
+static struct exp_buf exp_cache;        /* rendered exposition, under exp_lock */
+static unsigned exp_interval_ms = EXP_DEFAULT_INTERVAL_MS;
+static volatile sig_atomic_t exp_stop;
+
+static void
+exp_on_signal(int sig) {
+  (void) sig;
+  exp_stop = 1;
+}
+
+static void
+usage_exporter(void) {
+  fprintf(stderr,
+"exporter --listen unix:/path|ADDR:PORT [--interval MS] [--device BUS:ADDR]...\n"
+"Notes:\n"
+"  Serves OpenMetrics on GET /metrics. Without --device, exports the --bus/--addr device.\n"
+"  Devices are polled every --interval (default 1000 ms), one thread per bus; scrapes\n"
+"  are answered from the last poll and never touch the bus.\n"
+  );
+}
+
+static void
+buf_printf(struct exp_buf *b, const char *fmt, ...) {
+  va_list ap;
+
+  for (;;) {
+    va_start(ap, fmt);
+    int n = vsnprintf(b->p ? b->p + b->len : NULL, b->p ? b->cap - b->len : 0, fmt, ap);
+    va_end(ap);
+    if (n < 0)
+      return;
+    if (b->p && b->len + (size_t) n < b->cap) {
+      b->len += (size_t) n;
+      return;
+    }
+    size_t cap = b->cap ? b->cap : 4096;
+    while (cap <= b->len + (size_t) n)
+      cap *= 2;
+    char *p = realloc(b->p, cap);
+    if (!p)
+      return;
+    b->p = p;
+    b->cap = cap;
+  }
+}
+
+/* label value with \\, \" and \n escaped, as OpenMetrics requires */
+static void
+buf_label_value(struct exp_buf *b, const char *s) {
+  for (;;) {
+    size_t n = strcspn(s, "\\\"\n");
+
+    buf_printf(b, "%.*s", (int) n, s);
+    if (!s[n])
+      return;
+    buf_printf(b, "\\%c", s[n] == '\n' ? 'n' : s[n]);
+    s += n + 1;
+  }
+}
+
+static void
+exp_labels(struct exp_buf *b, const struct exp_dev *d) {
+  buf_printf(b, "bus=\"");
+  buf_label_value(b, d->bus);
+  buf_printf(b, "\",addr=\"0x%02x\",model=\"", d->addr);
+  buf_label_value(b, d->model);
+  buf_printf(b, "\"");
+}
+
+/* families are contiguous, as OpenMetrics requires: loop metrics outside, devices inside */
+static void
+exp_render(struct exp_buf *b) {
+  b->len = 0;
+
+  for (size_t m = 0; m < EXP_N_METRICS; m++) {
+    buf_printf(b, "# TYPE %s gauge\n# UNIT %s %s\n# HELP %s %s\n", exp_metrics[m].name,
+               exp_metrics[m].name, exp_metrics[m].unit, exp_metrics[m].name,
+               pmbus_regs[exp_metrics[m].reg].name);
+    for (int i = 0; i < exp_ndev; i++) {
+      const struct exp_dev *d = &exp_devs[i];
+
+      if (!d->last.have[m])
+        continue;
+      buf_printf(b, "%s{", exp_metrics[m].name);
+      exp_labels(b, d);
+      buf_printf(b, "} %.9g\n", d->last.val[m]);
+    }
+  }
+
+  buf_printf(b, "# TYPE bmr_status_bit gauge\n# HELP bmr_status_bit Decoded STATUS_* bits, 1 if set\n");
+  for (int i = 0; i < exp_ndev; i++) {
+    const struct exp_dev *d = &exp_devs[i];
+
+    for (size_t s = 0; s < EXP_N_STATUS; s++) {
+      if (d->last.status[s] < 0)
+        continue;
+      for (size_t k = 0; k < exp_status[s].n; k++) {
+        buf_printf(b, "bmr_status_bit{");
+        exp_labels(b, d);
+        buf_printf(b, ",register=\"%s\",bit=\"%s\"} %d\n", exp_status[s].name, exp_status[s].bits[k].name,
+                   (d->last.status[s] >> exp_status[s].bits[k].bit) & 1);
+      }
+    }
+  }
+
+  buf_printf(b, "# TYPE bmr_up gauge\n# HELP bmr_up 1 if the device answered the last poll\n");
+  for (int i = 0; i < exp_ndev; i++) {
+    buf_printf(b, "bmr_up{");
+    exp_labels(b, &exp_devs[i]);
+    buf_printf(b, "} %d\n", exp_devs[i].last.up);
+  }
+
+  buf_printf(b, "# TYPE bmr_poll_duration_seconds gauge\n# UNIT bmr_poll_duration_seconds seconds\n");
+  for (int i = 0; i < exp_ndev; i++) {
+    buf_printf(b, "bmr_poll_duration_seconds{");
+    exp_labels(b, &exp_devs[i]);
+    buf_printf(b, "} %.6f\n", exp_devs[i].last.poll_s);
+  }
+
+  buf_printf(b, "# TYPE bmr_last_poll_timestamp_seconds gauge\n# UNIT bmr_last_poll_timestamp_seconds seconds\n");
+  for (int i = 0; i < exp_ndev; i++) {
+    buf_printf(b, "bmr_last_poll_timestamp_seconds{");
+    exp_labels(b, &exp_devs[i]);
+    buf_printf(b, "} %.3f\n", exp_devs[i].last.time_s);
+  }
+
+  buf_printf(b, "# TYPE bmr_pmbus_transactions counter\n# HELP bmr_pmbus_transactions SMBus transfers\n");
+  for (int i = 0; i < exp_ndev; i++) {
+    buf_printf(b, "bmr_pmbus_transactions_total{");
+    exp_labels(b, &exp_devs[i]);
+    buf_printf(b, "} %llu\n", (unsigned long long) exp_devs[i].last.io.tx);
+  }
+
+  buf_printf(b, "# TYPE bmr_pmbus_errors counter\n# HELP bmr_pmbus_errors Failed SMBus transfers\n");
+  for (int i = 0; i < exp_ndev; i++) {
+    const struct pmbus_io_stats *io = &exp_devs[i].last.io;
+    const struct { const char *kind; uint64_t v; } kinds[] = {
+      { "nack", io->nack }, { "timeout", io->timeout }, { "other", io->other },
+    };
+
+    for (size_t k = 0; k < sizeof kinds / sizeof kinds[0]; k++) {
+      buf_printf(b, "bmr_pmbus_errors_total{");
+      exp_labels(b, &exp_devs[i]);
+      buf_printf(b, ",kind=\"%s\"} %llu\n", kinds[k].kind, (unsigned long long) kinds[k].v);
+    }
+  }
+
+  buf_printf(b, "# EOF\n");
+}
+
+static void
+exp_poll(struct exp_dev *d, struct exp_sample *s) {
+  int64_t t0 = pmbus_now_us();
+  struct timespec now;
+
+  for (size_t m = 0; m < EXP_N_METRICS; m++) {
+    uint8_t reg = exp_metrics[m].reg;
+
+    s->have[m] = false;
+    if (!pmbus_reg_supported(reg, d->model_bits))
+      continue;
+    int w = pmbus_reg_rd(d->fd, reg);
+    if (w < 0)
+      continue;
+    s->val[m] = pmbus_reg_to_units(reg, (uint16_t) w, d->exp5);
+    s->have[m] = true;
+  }
+
+  for (size_t k = 0; k < EXP_N_STATUS; k++)
+    s->status[k] = pmbus_reg_rd(d->fd, exp_status[k].reg);
+  s->up = s->status[0] >= 0;
+
+  clock_gettime(CLOCK_REALTIME, &now);
+  s->time_s = (double) now.tv_sec + (double) now.tv_nsec / 1e9;
+  s->poll_s = (double) (pmbus_now_us() - t0) / 1e6;
+  pmbus_io_stats(d->fd, &s->io);
+}
+
+/* MFR_MODEL and VOUT_MODE do not change at run time: read them once */
+static void
+exp_identify(struct exp_dev *d) {
+  uint8_t b[64];
+  int n = pmbus_rd_block(d->fd, MFR_MODEL, b, (int) sizeof b);
+  size_t k = 0;
+
+  for (int i = 0; i < n && k + 1 < sizeof d->model; i++)
+    if ((b[i] >= '0' && b[i] <= '9') || (b[i] >= 'A' && b[i] <= 'Z') || (b[i] >= 'a' && b[i] <= 'z') ||
+        b[i] == '-' || b[i] == '_')
+      d->model[k++] = (char) b[i];
+  d->model[k] = '\0';
+
+  d->model_bits = pmbus_model(d->fd);
+  d->exp5 = 0;
+  pmbus_get_vout_mode_exp(d->fd, &d->exp5);
+}
+
+static void *
+exp_bus_thread(void *arg) {
+  struct exp_bus *eb = arg;
+  struct exp_sample *s = calloc((size_t) eb->n, sizeof s[0]);
+  int64_t next = pmbus_now_us();
+
+  pthread_mutex_lock(&exp_lock);
+  while (!exp_stop) {
+    pthread_mutex_unlock(&exp_lock);
+    for (int i = 0; i < eb->n; i++)
+      exp_poll(&eb->devs[i], &s[i]);
+    pthread_mutex_lock(&exp_lock);
+
+    for (int i = 0; i < eb->n; i++)
+      eb->devs[i].last = s[i];
+    exp_render(&exp_cache);
+
+    /* fixed rate: the next poll is due one interval after the previous one started */
+    next += (int64_t) exp_interval_ms * 1000;
+    struct timespec ts = { .tv_sec = next / 1000000, .tv_nsec = (long) (next % 1000000) * 1000L };
+    while (!exp_stop && pmbus_now_us() < next)
+      if (pthread_cond_timedwait(&exp_wake, &exp_lock, &ts) == ETIMEDOUT)
+        break;
+    if (pmbus_now_us() > next)
+      next = pmbus_now_us();    /* fell behind: don't burst to catch up */
+  }
+  pthread_mutex_unlock(&exp_lock);
+
+  free(s);
+
+  return NULL;
+}
+
+static int
+exp_listen(const char *spec, char *unix_path, size_t len) {
+  int fd;
+
+  unix_path[0] = '\0';
+  if (!strncmp(spec, "unix:", 5)) {
+    struct sockaddr_un sa = { .sun_family = AF_UNIX };
+
+    if (strlen(spec + 5) >= sizeof sa.sun_path || strlen(spec + 5) >= len) {
+      fprintf(stderr, "%s: path too long\n", spec);
+      return -1;
+    }
+    strcpy(sa.sun_path, spec + 5);
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+      return -1;
+    /* a stale socket from a previous run goes; anything else at the path is not ours */
+    struct stat st;
+    if (lstat(sa.sun_path, &st) == 0) {
+      if (!S_ISSOCK(st.st_mode)) {
+        close(fd);
+        errno = EADDRINUSE;
+        return -1;
+      }
+      unlink(sa.sun_path);
+    }
+    if (bind(fd, (struct sockaddr *) &sa, sizeof sa) < 0) {
+      close(fd);
+      return -1;
+    }
+    strcpy(unix_path, sa.sun_path);
+  } else {
+    struct sockaddr_in sa = { .sin_family = AF_INET };
+    char host[64];
+    const char *c = strrchr(spec, ':');
+    char *end = NULL;
+
+    if (!c || (size_t) (c - spec) >= sizeof host) {
+      errno = EINVAL;
+      return -1;
+    }
+    long port = strtol(c + 1, &end, 10);
+    memcpy(host, spec, (size_t) (c - spec));
+    host[c - spec] = '\0';
+    if (*end || port < 1 || port > 65535 || inet_pton(AF_INET, host, &sa.sin_addr) != 1) {
+      errno = EINVAL;
+      return -1;
+    }
+    sa.sin_port = htons((uint16_t) port);
+
+    fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+      return -1;
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof one);
+    if (bind(fd, (struct sockaddr *) &sa, sizeof sa) < 0) {
+      close(fd);
+      return -1;
+    }
+  }
+
+  if (listen(fd, 16) < 0) {
+    close(fd);
+    return -1;
+  }
+
+  return fd;
+}
+
+static void
+exp_send_all(int fd, const char *p, size_t n) {
+  while (n) {
+    ssize_t w = send(fd, p, n, MSG_NOSIGNAL);
+    if (w < 0 && errno == EINTR)
+      continue;
+    if (w <= 0)
+      return;
+    p += w;
+    n -= (size_t) w;
+  }
+}
+
+static void
+exp_respond(int fd, struct exp_buf *out) {
+  char req[EXP_REQ_MAX];
+  size_t n = 0;
+  struct timeval tv = { .tv_sec = EXP_IO_TIMEOUT_MS / 1000, .tv_usec = (EXP_IO_TIMEOUT_MS % 1000) * 1000 };
+
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof tv);
+  setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof tv);
+
+  /* the request line is all we look at; read until the end of the headers */
+  while (n < sizeof req - 1) {
+    ssize_t r = recv(fd, req + n, sizeof req - 1 - n, 0);
+    if (r <= 0)
+      break;
+    n += (size_t) r;
+    req[n] = '\0';
+    if (strstr(req, "\r\n\r\n") || strstr(req, "\n\n"))
+      break;
+  }
+  req[n] = '\0';
+
+  char hdr[256];
+  bool head = !strncmp(req, "HEAD ", 5);
+  const char *path = head ? req + 5 : !strncmp(req, "GET ", 4) ? req + 4 : NULL;
+  size_t plen = path ? strcspn(path, " ?\r\n") : 0;
+
+  if (!path || !((plen == 8 && !strncmp(path, "/metrics", 8)) || (plen == 1 && *path == '/'))) {
+    static const char nf[] = "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+    exp_send_all(fd, nf, sizeof nf - 1);
+    return;
+  }
+
+  pthread_mutex_lock(&exp_lock);
+  if (out->cap < exp_cache.len) {
+    char *p = realloc(out->p, exp_cache.len);
+    if (p) {
+      out->p = p;
+      out->cap = exp_cache.len;
+    }
+  }
+  out->len = out->cap >= exp_cache.len ? exp_cache.len : 0;
+  if (out->len)
+    memcpy(out->p, exp_cache.p, out->len);
+  pthread_mutex_unlock(&exp_lock);
+
+  int h = snprintf(hdr, sizeof hdr,
+                   "HTTP/1.1 200 OK\r\n"
+                   "Content-Type: application/openmetrics-text; version=1.0.0; charset=utf-8\r\n"
+                   "Content-Length: %zu\r\nConnection: close\r\n\r\n", out->len);
+  exp_send_all(fd, hdr, (size_t) h);
+  if (!head)
+    exp_send_all(fd, out->p, out->len);
+}
+
+static int
+exp_serve(int lfd) {
+  struct exp_buf out = { 0 };
+
+  while (!exp_stop) {
+    struct pollfd p = { .fd = lfd, .events = POLLIN };
+
+    if (poll(&p, 1, 1000) <= 0)
+      continue;
+    int c = accept(lfd, NULL, NULL);
+    if (c < 0)
+      continue;
+    exp_respond(c, &out);
+    close(c);
+  }
+  free(out.p);
+
+  return 0;
+}
+
+static int
+exp_dev_cmp(const void *a, const void *b) {
+  const struct exp_dev *x = a, *y = b;
+  int c = strcmp(x->bus, y->bus);
+
+  return c ? c : x->addr - y->addr;
+}
+
+int
+cmd_exporter(int fd, const char *bus, int addr, int argc, char *const *argv) {
+  const char *listen_spec = NULL;
+  int ndev = 0, rc = 0;
+
+  exp_devs = calloc((size_t) argc + 1, sizeof exp_devs[0]);
+
+  for (int i = 0; i < argc; i++) {
+    if (!strcmp(argv[i], "--listen") && i + 1 < argc) {
+      listen_spec = argv[++i];
+    } else if (!strcmp(argv[i], "--interval") && i + 1 < argc) {
+      exp_interval_ms = (unsigned) strtoul(argv[++i], NULL, 0);
+    } else if (!strcmp(argv[i], "--device") && i + 1 < argc) {
+      struct exp_dev *d = &exp_devs[ndev];
+      char copy[sizeof d->bus];
+      const char *b;
+
+      snprintf(copy, sizeof copy, "%s", argv[++i]);
+      if (pmbus_parse_dev(copy, &b, &d->addr) < 0) {
+        fprintf(stderr, "--device BUS:ADDR (e.g. /dev/i2c-1:0x40)\n");
+        rc = 2;
+        break;
+      }
+      snprintf(d->bus, sizeof d->bus, "%s", b);
+      ndev++;
+    } else {
+      usage_exporter();
+      rc = 2;
+      break;
+    }
+  }
+  if (!rc && (!listen_spec || !exp_interval_ms)) {
+    usage_exporter();
+    rc = 2;
+  }
+  if (rc) {
+    free(exp_devs);
+    return rc;
+  }
+
+  if (!ndev) {
+    snprintf(exp_devs[0].bus, sizeof exp_devs[0].bus, "%s", bus);
+    exp_devs[0].addr = addr;
+    exp_devs[0].fd = fd;
+    ndev = 1;
+  } else {
+    qsort(exp_devs, (size_t) ndev, sizeof exp_devs[0], exp_dev_cmp);
+    for (int i = 0; i < ndev; i++) {
+      exp_devs[i].fd = pmbus_open(exp_devs[i].bus, exp_devs[i].addr);
+      exp_devs[i].own_fd = true;
+      if (exp_devs[i].fd < 0) {
+        fprintf(stderr, "%s:0x%02x: %s\n", exp_devs[i].bus, exp_devs[i].addr, strerror(errno));
+        rc = 1;
+      }
+    }
+  }
+  exp_ndev = ndev;
+
+  char unix_path[108];
+  int lfd = rc ? -1 : exp_listen(listen_spec, unix_path, sizeof unix_path);
+  if (!rc && lfd < 0) {
+    fprintf(stderr, "%s: %s\n", listen_spec, strerror(errno));
+    rc = 1;
+  }
+  if (rc)
+    goto out;
+
+  struct sigaction sa = { .sa_handler = exp_on_signal };
+  sigemptyset(&sa.sa_mask);
+  sigaction(SIGINT, &sa, NULL);
+  sigaction(SIGTERM, &sa, NULL);
+
+  pthread_condattr_t ca;
+  pthread_condattr_init(&ca);
+  pthread_condattr_setclock(&ca, CLOCK_MONOTONIC);
+  pthread_cond_init(&exp_wake, &ca);
+  pthread_condattr_destroy(&ca);
+
+  for (int i = 0; i < ndev; i++) {
+    exp_identify(&exp_devs[i]);
+    for (size_t k = 0; k < EXP_N_STATUS; k++)
+      exp_devs[i].last.status[k] = -1;
+  }
+  exp_render(&exp_cache);       /* bmr_up 0 until the first poll lands */
+
+  struct exp_bus *buses = calloc((size_t) ndev, sizeof buses[0]);
+  int nb = 0;
+  for (int i = 0; i < ndev; i++) {
+    if (!nb || strcmp(buses[nb - 1].devs[0].bus, exp_devs[i].bus)) {
+      buses[nb].devs = &exp_devs[i];
+      nb++;
+    }
+    buses[nb - 1].n++;
+  }
+  for (int i = 0; i < nb; i++) {
+    buses[i].started = !pthread_create(&buses[i].tid, NULL, exp_bus_thread, &buses[i]);
+    if (!buses[i].started) {
+      perror("pthread_create");
+      exp_stop = 1;
+      rc = 1;
+    }
+  }
+
+  if (!rc)
+    exp_serve(lfd);
+
+  pthread_mutex_lock(&exp_lock);
+  exp_stop = 1;
+  pthread_cond_broadcast(&exp_wake);
+  pthread_mutex_unlock(&exp_lock);
+  for (int i = 0; i < nb; i++)
+    if (buses[i].started)
+      pthread_join(buses[i].tid, NULL);
+  free(buses);
+  pthread_cond_destroy(&exp_wake);
+
+  close(lfd);
+  if (unix_path[0])
+    unlink(unix_path);
+
+out:
+  for (int i = 0; i < ndev; i++)
+    if (exp_devs[i].own_fd)
+      pmbus_close(exp_devs[i].fd);
+  free(exp_devs);
+  free(exp_cache.p);
+
+  return rc;
+}
@@ -0,0 +1,5 @@
+/* SPDX-License-Identifier: AGPL-3.0-or-later */
+#pragma once
+
+/* bus/addr: the device main() opened on fd, exported when no --device is given */
+int cmd_exporter(int fd, const char *bus, int addr, int argc, char *const *argv);
@@ -1,6 +1,7 @@
 /* SPDX-License-Identifier: AGPL-3.0-or-later */
 
 #include "pmbus_io.h"
+#include "pmbus_regs.h"
 #include "util_json.h"
 
 #include <jansson.h>
@@ -88,9 +89,11 @@ decode_delay_ms10(uint8_t b, json_t *o) {
   json_object_set_new(o, "delay_ms", json_integer(ms));
 }
 
+/* the delay unit of each response byte comes from pmbus_regs[] */
 static void
-put_resp_byte(json_t *dst, const char *key, int fd, uint8_t cmd, bool is_temp_family) {
+put_resp_byte(json_t *dst, const char *key, int fd, uint8_t cmd) {
   int v = pmbus_rd_byte(fd, cmd);
+  bool is_temp_family = pmbus_reg(cmd)->unit == UNIT_S_POW2;
 
   json_t *o = json_object();
 
@@ -306,34 +309,34 @@ cmd_fault(int fd, int argc, char *const *argv, int pretty) {
 
     if (!strcmp(which, "all") || !strcmp(which, "temp")) {
       json_t *temp = json_object();
-      put_resp_byte(temp, "OT_FAULT_RESPONSE", fd, PMBUS_OT_FAULT_RESPONSE, true);
-      put_resp_byte(temp, "UT_FAULT_RESPONSE", fd, PMBUS_UT_FAULT_RESPONSE, true);
+      put_resp_byte(temp, "OT_FAULT_RESPONSE", fd, PMBUS_OT_FAULT_RESPONSE);
+      put_resp_byte(temp, "UT_FAULT_RESPONSE", fd, PMBUS_UT_FAULT_RESPONSE);
       json_object_set_new(root, "temperature", temp);
     }
 
     if (!strcmp(which, "all") || !strcmp(which, "vout")) {
       json_t *vout = json_object();
-      put_resp_byte(vout, "VOUT_OV_FAULT_RESPONSE", fd, PMBUS_VOUT_OV_FAULT_RESPONSE, false);
-      put_resp_byte(vout, "VOUT_UV_FAULT_RESPONSE", fd, PMBUS_VOUT_UV_FAULT_RESPONSE, false);
+      put_resp_byte(vout, "VOUT_OV_FAULT_RESPONSE", fd, PMBUS_VOUT_OV_FAULT_RESPONSE);
+      put_resp_byte(vout, "VOUT_UV_FAULT_RESPONSE", fd, PMBUS_VOUT_UV_FAULT_RESPONSE);
       json_object_set_new(root, "vout", vout);
     }
 
     if (!strcmp(which, "all") || !strcmp(which, "vin")) {
       json_t *vin = json_object();
-      put_resp_byte(vin, "VIN_OV_FAULT_RESPONSE", fd, PMBUS_VIN_OV_FAULT_RESPONSE, false);
-      put_resp_byte(vin, "VIN_UV_FAULT_RESPONSE", fd, PMBUS_VIN_UV_FAULT_RESPONSE, false);
+      put_resp_byte(vin, "VIN_OV_FAULT_RESPONSE", fd, PMBUS_VIN_OV_FAULT_RESPONSE);
+      put_resp_byte(vin, "VIN_UV_FAULT_RESPONSE", fd, PMBUS_VIN_UV_FAULT_RESPONSE);
       json_object_set_new(root, "vin", vin);
     }
 
     if (!strcmp(which, "all") || !strcmp(which, "tonmax")) {
       json_t *tm = json_object();
-      put_resp_byte(tm, "TON_MAX_FAULT_RESPONSE", fd, PMBUS_TON_MAX_FAULT_RESPONSE, false);
+      put_resp_byte(tm, "TON_MAX_FAULT_RESPONSE", fd, PMBUS_TON_MAX_FAULT_RESPONSE);
       json_object_set_new(root, "tonmax", tm);
     }
 
     if (!strcmp(which, "all") || !strcmp(which, "iout")) {
       json_t *io = json_object();
-      put_resp_byte(io, "IOUT_OC_FAULT_RESPONSE", fd, PMBUS_IOUT_OC_FAULT_RESPONSE, false);
+      put_resp_byte(io, "IOUT_OC_FAULT_RESPONSE", fd, PMBUS_IOUT_OC_FAULT_RESPONSE);
       json_object_set_new(root, "iout", io);
     }
 
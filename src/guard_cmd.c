@@ -0,0 +1,564 @@
+/* SPDX-License-Identifier: AGPL-3.0-or-later */
+#define _POSIX_C_SOURCE 200809L
+
+#include "pmbus_io.h"
+#include "decoders.h"
+#include "mfr_restart.h"
+#include "util_json.h"
+
+#include <jansson.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+/*
+ * Fault watchdog: poll STATUS_WORD at a high rate (or wake on SMBALERT#) and when a policy's
+ * STATUS bit sets, run its actions straight away. The hot path is one word read per cycle;
+ * a STATUS_VOUT/IOUT/INPUT/TEMPERATURE/CML byte is only read when its STATUS_WORD summary bit
+ * is set and a policy looks at it. Dependent rails are opened and their OPERATION read before
+ * the loop, so switching one off is a single byte write, and the event JSON is only built
+ * after every action has been issued.
+ *
+ * Policies fire on the edge (bit clear -> set), then stay quiet for --holdoff, so a fault that
+ * CLEAR_FAULTS cannot clear is not cleared again on every cycle. Restarts are limited to
+ * --retries per policy for the whole run; after that the watched device is switched off.
+ */
+
+#define GUARD_DEFAULT_INTERVAL_US 1000
+#define GUARD_DEFAULT_HOLDOFF_MS 100
+#define GUARD_DEFAULT_RETRIES 3
+#define GUARD_READY_TIMEOUT_MS 5000
+#define GUARD_MAX_POLICIES 8
+#define GUARD_MAX_ACTIONS 4
+#define GUARD_MAX_DEPS 8
+#define GUARD_MAX_RESULTS (GUARD_MAX_ACTIONS * GUARD_MAX_DEPS)
+#define GUARD_SPEC_LEN 64
+#define GUARD_OPERATION_ON 0x80
+
+static volatile sig_atomic_t guard_stop;
+
+static void
+guard_on_signal(int sig) {
+  (void) sig;
+  guard_stop = 1;
+}
+
+static void
+usage_guard(void) {
+  fprintf(stderr,
+"guard --on STATUS_REG[:BIT]=ACTION[,ACTION]... [--dep BUS:ADDR]... [--interval-us N]\n"
+"      [--alert GPIO_VALUE_FILE] [--holdoff MS] [--retries N] [--rt PRIO]\n"
+"      [--events N] [--count N]\n"
+"ACTION:\n"
+"  off       OPERATION off on every --dep rail (on the watched device if there is none)\n"
+"  clear     CLEAR_FAULTS on the watched device\n"
+"  restart   MFR_RESTART and wait for power good, retried up to --retries per policy\n"
+"Notes:\n"
+"  --interval-us defaults to %d; with --alert it is the backstop poll period.\n"
+"  --rt runs SCHED_FIFO at PRIO with memory locked.\n"
+  , GUARD_DEFAULT_INTERVAL_US);
+}
+
+enum guard_act : uint8_t {
+  ACT_OFF,
+  ACT_CLEAR,
+  ACT_RESTART,
+};
+
+static const char *const ACT_NAMES[] = {
+  [ACT_OFF] = "off",
+  [ACT_CLEAR] = "clear",
+  [ACT_RESTART] = "restart",
+};
+
+/* STATUS_WORD summary bit -> the byte register behind it */
+static const struct guard_summary {
+  uint8_t reg;
+  const char *name;
+  uint16_t sw_bit;
+} GUARD_SUMMARY[] = {
+  { PMBUS_STATUS_VOUT,        "STATUS_VOUT",        0x8000 },
+  { PMBUS_STATUS_IOUT,        "STATUS_IOUT",        0x4000 },
+  { PMBUS_STATUS_INPUT,       "STATUS_INPUT",       0x2000 },
+  { PMBUS_STATUS_TEMPERATURE, "STATUS_TEMPERATURE", 0x0004 },
+  { PMBUS_STATUS_CML,         "STATUS_CML",         0x0002 },
+};
+
+#define N_GUARD_SUMMARY (sizeof GUARD_SUMMARY / sizeof GUARD_SUMMARY[0])
+
+struct guard_dep {
+  char dev[64];
+  int fd;
+  uint8_t op;
+};
+
+struct guard_policy {
+  char spec[GUARD_SPEC_LEN];
+  uint8_t reg;
+  uint16_t mask;
+  int sub;                      /* GUARD_SUMMARY[] slot, -1 for STATUS_WORD/STATUS_BYTE */
+  enum guard_act act[GUARD_MAX_ACTIONS];
+  int nact;
+  bool was;                     /* matched on the previous good read */
+  int64_t armed_at;
+  unsigned restarts;
+};
+
+struct guard_sample {
+  int64_t t_start, t_end;
+  int sw;
+  int sub[N_GUARD_SUMMARY];     /* <0: not read */
+};
+
+/* filled while acting, turned into JSON once everything is issued */
+struct guard_result {
+  enum guard_act act;
+  int dep;                      /* --dep index for ACT_OFF, -1 for the watched device */
+  int err;
+  int64_t done_us;
+  unsigned attempt;
+  bool exhausted;               /* restart budget used up: switched off instead */
+  json_t *ready;                /* wait_ready() output of a restart */
+};
+
+struct guard {
+  struct guard_policy pol[GUARD_MAX_POLICIES];
+  int npol;
+  struct guard_dep dep[GUARD_MAX_DEPS];
+  int ndep;
+  unsigned need_sub;            /* GUARD_SUMMARY[] slots some policy needs */
+  unsigned retries;
+  uint8_t op;                   /* watched device OPERATION at start */
+  struct guard_result res[GUARD_MAX_RESULTS];
+  int nres;
+};
+
+static int
+parse_policy(struct guard *g, const char *arg) {
+  if (g->npol == GUARD_MAX_POLICIES)
+    return -1;
+
+  struct guard_policy *p = &g->pol[g->npol];
+  char s[GUARD_SPEC_LEN];
+
+  if ((size_t) snprintf(s, sizeof s, "%s", arg) >= sizeof s)
+    return -1;
+
+  char *eq = strchr(s, '=');
+  if (!eq)
+    return -1;
+  *eq = '\0';
+  if (status_bit_parse(s, &p->reg, &p->mask) < 0) {
+    fprintf(stderr, "guard: unknown status bit %s\n", s);
+    return -1;
+  }
+  snprintf(p->spec, sizeof p->spec, "%s", s);
+
+  p->sub = -1;
+  for (size_t i = 0; i < N_GUARD_SUMMARY; i++)
+    if (GUARD_SUMMARY[i].reg == p->reg) {
+      p->sub = (int) i;
+      g->need_sub |= 1u << i;
+    }
+
+  for (char *tok = strtok(eq + 1, ","); tok; tok = strtok(NULL, ",")) {
+    size_t a = 0;
+    while (a < sizeof ACT_NAMES / sizeof ACT_NAMES[0] && strcmp(tok, ACT_NAMES[a]))
+      a++;
+    if (a == sizeof ACT_NAMES / sizeof ACT_NAMES[0] || p->nact == GUARD_MAX_ACTIONS) {
+      fprintf(stderr, "guard: bad action %s\n", tok);
+      return -1;
+    }
+    p->act[p->nact++] = (enum guard_act) a;
+  }
+  if (!p->nact)
+    return -1;
+  g->npol++;
+
+  return 0;
+}
+
+static int
+open_dep(struct guard *g, const char *arg) {
+  if (g->ndep == GUARD_MAX_DEPS)
+    return -1;
+
+  struct guard_dep *d = &g->dep[g->ndep];
+  char copy[sizeof d->dev];
+  const char *bus;
+  int addr;
+
+  if ((size_t) snprintf(d->dev, sizeof d->dev, "%s", arg) >= sizeof d->dev)
+    return -1;
+  snprintf(copy, sizeof copy, "%s", arg);
+  if (pmbus_parse_dev(copy, &bus, &addr) < 0) {
+    fprintf(stderr, "guard: bad device '%s'\n", arg);
+    return -1;
+  }
+
+  d->fd = pmbus_open(bus, addr);
+  if (d->fd < 0) {
+    perror(d->dev);
+    return -1;
+  }
+  int op = pmbus_rd_byte(d->fd, PMBUS_OPERATION);
+  if (op < 0) {
+    fprintf(stderr, "%s: OPERATION: %s\n", d->dev, strerror(errno));
+    pmbus_close(d->fd);
+    return -1;
+  }
+  d->op = (uint8_t) op;
+  g->ndep++;
+
+  return 0;
+}
+
+static void
+guard_read(int fd, const struct guard *g, struct guard_sample *s) {
+  s->t_start = pmbus_now_us();
+  s->sw = pmbus_rd_word(fd, PMBUS_STATUS_WORD);
+  for (size_t i = 0; i < N_GUARD_SUMMARY; i++) {
+    s->sub[i] = -1;
+    if (s->sw >= 0 && (g->need_sub & (1u << i)) && (s->sw & GUARD_SUMMARY[i].sw_bit))
+      s->sub[i] = pmbus_rd_byte(fd, GUARD_SUMMARY[i].reg);
+  }
+  s->t_end = pmbus_now_us();
+}
+
+static bool
+policy_now(const struct guard_policy *p, const struct guard_sample *s) {
+  int v;
+
+  if (p->sub >= 0)
+    v = s->sub[p->sub];
+  else
+    v = p->reg == PMBUS_STATUS_BYTE ? (s->sw & 0xFF) : s->sw;
+
+  return v >= 0 && (v & p->mask);
+}
+
+static struct guard_result *
+result_add(struct guard *g, enum guard_act act, int dep) {
+  if (g->nres == GUARD_MAX_RESULTS)
+    return NULL;
+
+  struct guard_result *r = &g->res[g->nres++];
+  *r = (struct guard_result) { .act = act, .dep = dep };
+
+  return r;
+}
+
+static void
+result_done(struct guard_result *r, int rc) {
+  r->err = rc < 0 ? errno : 0;
+  r->done_us = pmbus_now_us();
+}
+
+static void
+act_off(int fd, struct guard *g) {
+  if (!g->ndep) {
+    struct guard_result *r = result_add(g, ACT_OFF, -1);
+    int rc = pmbus_wr_byte(fd, PMBUS_OPERATION, (uint8_t) (g->op & ~GUARD_OPERATION_ON));
+    if (r)
+      result_done(r, rc);
+    return;
+  }
+  for (int i = 0; i < g->ndep; i++) {
+    struct guard_dep *d = &g->dep[i];
+    struct guard_result *r = result_add(g, ACT_OFF, i);
+    int rc = pmbus_wr_byte(d->fd, PMBUS_OPERATION, (uint8_t) (d->op & ~GUARD_OPERATION_ON));
+    if (r)
+      result_done(r, rc);
+  }
+}
+
+static void
+act_restart(int fd, struct guard *g, struct guard_policy *p) {
+  if (p->restarts >= g->retries) {
+    struct guard_result *r = result_add(g, ACT_RESTART, -1);
+    int rc = pmbus_wr_byte(fd, PMBUS_OPERATION, (uint8_t) (g->op & ~GUARD_OPERATION_ON));
+    if (r) {
+      result_done(r, rc);
+      r->exhausted = true;
+    }
+    return;
+  }
+
+  while (p->restarts < g->retries) {
+    struct guard_result *r = result_add(g, ACT_RESTART, -1);
+    int rc = mfr_restart_issue(fd);
+
+    p->restarts++;
+    if (!r)
+      return;
+    result_done(r, rc);
+    r->attempt = p->restarts;
+    if (rc < 0)
+      continue;
+    r->ready = json_object();
+    if (wait_ready(fd, GUARD_READY_TIMEOUT_MS, true, r->ready) == 0)
+      return;
+  }
+}
+
+static void
+guard_act(int fd, struct guard *g, struct guard_policy *p) {
+  for (int k = 0; k < p->nact; k++) {
+    switch (p->act[k]) {
+    case ACT_OFF:
+      act_off(fd, g);
+      break;
+    case ACT_CLEAR: {
+      struct guard_result *r = result_add(g, ACT_CLEAR, -1);
+      int rc = pmbus_send_byte(fd, PMBUS_CLEAR_FAULTS);
+      if (r)
+        result_done(r, rc);
+      break;
+    }
+    case ACT_RESTART:
+      act_restart(fd, g, p);
+      break;
+    }
+  }
+}
+
+static json_t *
+event_json(struct guard *g, const struct guard_policy *p, const struct guard_sample *s,
+           int64_t t_ms, int64_t t_ref, int64_t gap_us) {
+  json_t *o = json_object();
+  json_t *acts = json_array();
+
+  json_object_set_new(o, "event", json_string("guard"));
+  json_object_set_new(o, "policy", json_string(p->spec));
+  json_object_set_new(o, "t_ms", json_integer(t_ms));
+  json_object_set_new(o, "STATUS_WORD", json_integer(s->sw));
+  for (size_t i = 0; i < N_GUARD_SUMMARY; i++)
+    if (s->sub[i] >= 0)
+      json_object_set_new(o, GUARD_SUMMARY[i].name, json_integer(s->sub[i]));
+
+  /* detect: alert edge (or start of the read) to the read that showed the fault */
+  json_object_set_new(o, "detect_us", json_integer(s->t_end - t_ref));
+  json_object_set_new(o, "poll_gap_us", gap_us >= 0 ? json_integer(gap_us) : json_null());
+  json_object_set_new(o, "response_us",
+                      g->nres ? json_integer(g->res[0].done_us - s->t_end) : json_null());
+
+  for (int i = 0; i < g->nres; i++) {
+    struct guard_result *r = &g->res[i];
+    json_t *a = r->ready ? r->ready : json_object();
+
+    json_object_set_new(a, "action", json_string(ACT_NAMES[r->act]));
+    if (r->dep >= 0)
+      json_object_set_new(a, "device", json_string(g->dep[r->dep].dev));
+    if (r->attempt)
+      json_object_set_new(a, "attempt", json_integer(r->attempt));
+    if (r->exhausted) {
+      json_object_set_new(a, "exhausted", json_true());
+      json_object_set_new(a, "fallback", json_string(ACT_NAMES[ACT_OFF]));
+    }
+    json_object_set_new(a, "ok", json_boolean(!r->err));
+    if (r->err)
+      json_object_set_new(a, "error", json_string(strerror(r->err)));
+    json_object_set_new(a, "latency_us", json_integer(r->done_us - s->t_end));
+    json_array_append_new(acts, a);
+  }
+  json_object_set_new(o, "actions", acts);
+  g->nres = 0;
+
+  return o;
+}
+
+static int
+guard_realtime(int prio) {
+  struct sched_param sp = { .sched_priority = prio };
+
+  if (sched_setscheduler(0, SCHED_FIFO, &sp) < 0) {
+    perror("sched_setscheduler");
+    return -1;
+  }
+  if (mlockall(MCL_CURRENT | MCL_FUTURE) < 0) {
+    perror("mlockall");
+    return -1;
+  }
+
+  return 0;
+}
+
+/* sysfs GPIO "value" with edge set: POLLPRI on the edge, read from 0 to re-arm */
+static bool
+alert_wait(int afd, int64_t until_us) {
+  int64_t left = until_us - pmbus_now_us();
+  struct pollfd pfd = { .fd = afd, .events = POLLPRI | POLLERR };
+  char b[8];
+
+  if (poll(&pfd, 1, left > 0 ? (int) ((left + 999) / 1000) : 0) <= 0)
+    return false;
+  lseek(afd, 0, SEEK_SET);
+  if (read(afd, b, sizeof b) < 0)
+    return false;
+
+  return true;
+}
+
+int
+cmd_guard(int fd, int argc, char *const *argv, int pretty) {
+  static struct guard g;
+  unsigned interval_us = GUARD_DEFAULT_INTERVAL_US;
+  unsigned holdoff_ms = GUARD_DEFAULT_HOLDOFF_MS;
+  const char *alert = NULL;
+  long events = 0, count = 0;
+  int rt = 0, rc = 0;
+
+  g = (struct guard) { .retries = GUARD_DEFAULT_RETRIES };
+
+  for (int i = 0; i < argc; i++) {
+    if (!strcmp(argv[i], "--on") && i + 1 < argc) {
+      if (parse_policy(&g, argv[++i]) < 0) {
+        usage_guard();
+        rc = 2;
+        goto out;
+      }
+    } else if (!strcmp(argv[i], "--dep") && i + 1 < argc) {
+      if (open_dep(&g, argv[++i]) < 0) {
+        rc = 1;
+        goto out;
+      }
+    } else if (!strcmp(argv[i], "--interval-us") && i + 1 < argc)
+      interval_us = (unsigned) strtoul(argv[++i], NULL, 0);
+    else if (!strcmp(argv[i], "--alert") && i + 1 < argc)
+      alert = argv[++i];
+    else if (!strcmp(argv[i], "--holdoff") && i + 1 < argc)
+      holdoff_ms = (unsigned) strtoul(argv[++i], NULL, 0);
+    else if (!strcmp(argv[i], "--retries") && i + 1 < argc)
+      g.retries = (unsigned) strtoul(argv[++i], NULL, 0);
+    else if (!strcmp(argv[i], "--rt") && i + 1 < argc)
+      rt = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--events") && i + 1 < argc)
+      events = strtol(argv[++i], NULL, 0);
+    else if (!strcmp(argv[i], "--count") && i + 1 < argc)
+      count = strtol(argv[++i], NULL, 0);
+    else {
+      usage_guard();
+      rc = 2;
+      goto out;
+    }
+  }
+  if (!g.npol || !interval_us) {
+    usage_guard();
+    rc = 2;
+    goto out;
+  }
+
+  int op = pmbus_rd_byte(fd, PMBUS_OPERATION);
+  if (op < 0) {
+    perror("OPERATION");
+    rc = 1;
+    goto out;
+  }
+  g.op = (uint8_t) op;
+
+  int afd = -1;
+  if (alert && (afd = open(alert, O_RDONLY)) < 0) {
+    perror(alert);
+    rc = 1;
+    goto out;
+  }
+  if (afd >= 0)
+    alert_wait(afd, 0);
+  if (rt > 0 && guard_realtime(rt) < 0) {
+    rc = 1;
+    goto close_alert;
+  }
+
+  struct sigaction sa = { .sa_handler = guard_on_signal };
+  struct sigaction old_int, old_term;
+
+  sigemptyset(&sa.sa_mask);
+  sigaction(SIGINT, &sa, &old_int);
+  sigaction(SIGTERM, &sa, &old_term);
+
+  int64_t period_us = interval_us;
+  int64_t next = pmbus_now_us(), prev_end = -1, max_gap = 0;
+  long n, nevents = 0, errors = 0;
+
+  for (n = 0; !guard_stop && (count <= 0 || n < count); n++) {
+    int64_t t_ref = -1;
+
+    if (afd >= 0) {
+      if (alert_wait(afd, next))
+        t_ref = pmbus_now_us();
+    } else
+      pmbus_sleep_until_us(next);
+    if (guard_stop)
+      break;
+
+    struct guard_sample s;
+    guard_read(fd, &g, &s);
+    if (s.sw < 0) {
+      errors++;
+      goto next_cycle;
+    }
+    if (t_ref < 0)
+      t_ref = s.t_start;
+
+    int64_t gap = prev_end >= 0 ? s.t_end - prev_end : -1;
+    if (gap > max_gap)
+      max_gap = gap;
+    prev_end = s.t_end;
+
+    for (int k = 0; k < g.npol; k++) {
+      struct guard_policy *p = &g.pol[k];
+      bool now = policy_now(p, &s);
+
+      if (now && !p->was && s.t_end >= p->armed_at) {
+        int64_t t_ms = pmbus_wall_ms();
+
+        guard_act(fd, &g, p);
+        json_print_or_pretty(event_json(&g, p, &s, t_ms, t_ref, gap), pretty);
+        fflush(stdout);
+        p->armed_at = pmbus_now_us() + (int64_t) holdoff_ms * 1000;
+        nevents++;
+        /* the actions (a restart above all) took time: the next gap is not a polling gap */
+        prev_end = -1;
+      }
+      p->was = now;
+    }
+    if (events > 0 && nevents >= events)
+      break;
+
+next_cycle:
+    /* with an alert line the period is only a backstop, counted from the last read */
+    int64_t t = pmbus_now_us();
+    next += period_us;
+    if (afd >= 0)
+      next = t + period_us;
+    else if (t > next + period_us)
+      next = t;
+  }
+
+  json_t *o = json_object();
+  json_object_set_new(o, "event", json_string("summary"));
+  json_object_set_new(o, "polls", json_integer(n));
+  json_object_set_new(o, "events", json_integer(nevents));
+  json_object_set_new(o, "read_errors", json_integer(errors));
+  json_object_set_new(o, "max_poll_gap_us", json_integer(max_gap));
+  json_print_or_pretty(o, pretty);
+
+  sigaction(SIGINT, &old_int, NULL);
+  sigaction(SIGTERM, &old_term, NULL);
+close_alert:
+  if (afd >= 0)
+    close(afd);
+out:
+  for (int i = 0; i < g.ndep; i++)
+    pmbus_close(g.dep[i].fd);
+
+  return rc;
+}
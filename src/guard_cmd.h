@@ -0,0 +1,4 @@
+/* SPDX-License-Identifier: AGPL-3.0-or-later */
+#pragma once
+
+int cmd_guard(int fd, int argc, char *const *argv, int pretty);
@@ -0,0 +1,397 @@
+/* SPDX-License-Identifier: AGPL-3.0-or-later */
+#define _POSIX_C_SOURCE 200809L
+
+#include "history_store.h"
+#include "pmbus_io.h"
+#include "pmbus_regs.h"
+#include "util_json.h"
+#include "util_state.h"
+
+#include <errno.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * history record: sample word registers on absolute CLOCK_MONOTONIC deadlines and append
+ * the raw words to the per-register store (history_store.h). Timestamps are wall clock ms so
+ * queries can use absolute times. A chunk is written when it is full, older than --flush-s,
+ * or on SIGINT/SIGTERM, so at most --flush-s of samples is lost on a crash.
+ *
+ * history query: stream the samples of one register in [--from, --to] from the store.
+ */
+
+#define HIST_DEFAULT_INTERVAL_MS 100
+#define HIST_DEFAULT_FLUSH_S 60
+#define HIST_MAX_REGS 16
+#define HIST_DEFAULT_REGS "READ_VIN,READ_VOUT,READ_IOUT,READ_TEMPERATURE_1"
+
+static volatile sig_atomic_t hist_stop;
+
+static void
+hist_on_signal(int sig) {
+  (void) sig;
+  hist_stop = 1;
+}
+
+static void
+usage_history(void) {
+  fprintf(stderr,
+"history record [--regs NAME,...] [--interval MS] [--flush-s N] [--count N] [--dir DIR]\n"
+"history query --reg NAME [--from T] [--to T] [--raw] [--csv] [--dir DIR]\n"
+"Notes:\n"
+"  --regs defaults to " HIST_DEFAULT_REGS ".\n"
+"  T is epoch seconds, 'now', or relative to now: -30s, -15m, -2h, -1d.\n"
+"  The store defaults to <state dir>/history-<MFR_SERIAL>/.\n"
+  );
+}
+
+/* epoch seconds (fractions allowed), "now", or -N[s|m|h|d] from now; ms since the epoch */
+static int
+parse_time(const char *s, int64_t *out) {
+  char *end = NULL;
+
+  if (!strcmp(s, "now")) {
+    *out = pmbus_wall_ms();
+    return 0;
+  }
+
+  errno = 0;
+  double v = strtod(s, &end);
+  if (errno || end == s)
+    return -1;
+
+  if (s[0] != '-') {
+    if (*end != '\0')
+      return -1;
+    *out = (int64_t) (v * 1000.0);
+    return 0;
+  }
+
+  double scale = 1.0;
+  switch (*end) {
+  case '\0':
+  case 's':
+    break;
+  case 'm':
+    scale = 60.0;
+    break;
+  case 'h':
+    scale = 3600.0;
+    break;
+  case 'd':
+    scale = 86400.0;
+    break;
+  default:
+    return -1;
+  }
+  if (*end && end[1] != '\0')
+    return -1;
+
+  *out = pmbus_wall_ms() + (int64_t) (v * scale * 1000.0);
+
+  return 0;
+}
+
+static int
+hist_reg(const char *name) {
+  int reg = pmbus_reg_by_name(name);
+
+  if (reg < 0 || pmbus_regs[reg].xfer != XFER_WORD || !(pmbus_regs[reg].flags & REG_R)) {
+    fprintf(stderr, "history: %s is not a readable word register\n", name);
+    return -1;
+  }
+
+  return reg;
+}
+
+static int
+parse_regs(char *list, uint8_t *regs, int *n) {
+  *n = 0;
+
+  for (char *tok = strtok(list, ","); tok; tok = strtok(NULL, ",")) {
+    int reg = hist_reg(tok);
+    if (reg < 0)
+      return -1;
+    if (*n == HIST_MAX_REGS) {
+      fprintf(stderr, "history: at most %d registers\n", HIST_MAX_REGS);
+      return -1;
+    }
+    regs[(*n)++] = (uint8_t) reg;
+  }
+
+  return *n ? 0 : -1;
+}
+
+static int
+hist_store_dir(int fd, const char *opt_dir, char *dir, size_t len) {
+  if (!opt_dir)
+    return state_dir(fd, "history", dir, len);
+
+  if ((size_t) snprintf(dir, len, "%s", opt_dir) >= len) {
+    fprintf(stderr, "history: --dir too long\n");
+    return -1;
+  }
+
+  return state_mkdir(dir);
+}
+
+struct hist_stats {
+  uint64_t samples;
+  uint64_t failed;
+  uint64_t chunks;
+  uint64_t bytes;
+};
+
+static int
+hist_flush(const char *dir, struct hist_chunk *c, struct hist_stats *st) {
+  if (!c->n)
+    return 0;
+
+  size_t len = c->len;
+  if (hist_append(dir, c) < 0)
+    return -1;
+  st->chunks++;
+  st->bytes += len + HIST_IDX_LEN;
+
+  return 0;
+}
+
+static int
+history_record(int fd, int argc, char *const *argv, int pretty) {
+  char list[512] = HIST_DEFAULT_REGS;
+  const char *opt_dir = NULL;
+  unsigned interval_ms = HIST_DEFAULT_INTERVAL_MS;
+  unsigned flush_s = HIST_DEFAULT_FLUSH_S;
+  long count = 0;
+
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--regs") && i + 1 < argc) {
+      if ((size_t) snprintf(list, sizeof list, "%s", argv[++i]) >= sizeof list) {
+        usage_history();
+        return 2;
+      }
+    } else if (!strcmp(argv[i], "--interval") && i + 1 < argc)
+      interval_ms = (unsigned) strtoul(argv[++i], NULL, 0);
+    else if (!strcmp(argv[i], "--flush-s") && i + 1 < argc)
+      flush_s = (unsigned) strtoul(argv[++i], NULL, 0);
+    else if (!strcmp(argv[i], "--count") && i + 1 < argc)
+      count = strtol(argv[++i], NULL, 0);
+    else if (!strcmp(argv[i], "--dir") && i + 1 < argc)
+      opt_dir = argv[++i];
+    else {
+      usage_history();
+      return 2;
+    }
+  }
+
+  uint8_t regs[HIST_MAX_REGS];
+  int nregs;
+  if (!interval_ms || !flush_s || parse_regs(list, regs, &nregs) < 0) {
+    usage_history();
+    return 2;
+  }
+
+  char dir[STATE_PATH_LEN];
+  if (hist_store_dir(fd, opt_dir, dir, sizeof dir) < 0)
+    return 1;
+
+  int exp5 = 0;
+  pmbus_get_vout_mode_exp(fd, &exp5);
+
+  struct hist_chunk *chunks = calloc((size_t) nregs, sizeof chunks[0]);
+  struct hist_stats *st = calloc((size_t) nregs, sizeof st[0]);
+  if (!chunks || !st) {
+    perror("calloc");
+    free(chunks);
+    free(st);
+    return 1;
+  }
+
+  struct sigaction sa = { .sa_handler = hist_on_signal };
+  struct sigaction old_int, old_term;
+
+  sigemptyset(&sa.sa_mask);
+  sigaction(SIGINT, &sa, &old_int);
+  sigaction(SIGTERM, &sa, &old_term);
+
+  int64_t period_us = (int64_t) interval_ms * 1000;
+  int64_t next = pmbus_now_us();
+  uint64_t overruns = 0;
+  long n = 0;
+  int rc = 0;
+
+  while (!hist_stop && (count <= 0 || n < count)) {
+    pmbus_sleep_until_us(next);
+    if (hist_stop)
+      break;
+
+    int64_t t = pmbus_wall_ms();
+    for (int r = 0; r < nregs && rc == 0; r++) {
+      struct hist_chunk *c = &chunks[r];
+      int w = pmbus_rd_word(fd, regs[r]);
+
+      /* a failed read is a gap in the series, not a fatal error */
+      if (w < 0) {
+        st[r].failed++;
+        continue;
+      }
+      st[r].samples++;
+
+      bool fits = c->n && t - c->t_first < (int64_t) flush_s * 1000 &&
+                  hist_chunk_add(c, t, (uint16_t) w);
+      if (fits)
+        continue;
+      if (hist_flush(dir, c, &st[r]) < 0) {
+        rc = 1;
+        break;
+      }
+      hist_chunk_start(c, regs[r], (int8_t) exp5, t, (uint16_t) w);
+    }
+    if (rc)
+      break;
+    n++;
+
+    /* fell a whole period behind (slow bus, suspended host): skip ahead, do not burst */
+    next += period_us;
+    int64_t now = pmbus_now_us();
+    if (now > next + period_us) {
+      overruns++;
+      next = now;
+    }
+  }
+
+  for (int r = 0; r < nregs; r++)
+    if (hist_flush(dir, &chunks[r], &st[r]) < 0)
+      rc = 1;
+
+  sigaction(SIGINT, &old_int, NULL);
+  sigaction(SIGTERM, &old_term, NULL);
+
+  json_t *o = json_object();
+  json_t *arr = json_array();
+  json_object_set_new(o, "dir", json_string(dir));
+  json_object_set_new(o, "interval_ms", json_integer(interval_ms));
+  json_object_set_new(o, "cycles", json_integer(n));
+  json_object_set_new(o, "overruns", json_integer((json_int_t) overruns));
+  for (int r = 0; r < nregs; r++) {
+    json_t *e = json_object();
+    json_object_set_new(e, "reg", json_string(pmbus_regs[regs[r]].name));
+    json_object_set_new(e, "samples", json_integer((json_int_t) st[r].samples));
+    json_object_set_new(e, "failed", json_integer((json_int_t) st[r].failed));
+    json_object_set_new(e, "chunks", json_integer((json_int_t) st[r].chunks));
+    json_object_set_new(e, "bytes", json_integer((json_int_t) st[r].bytes));
+    if (st[r].samples)
+      json_object_set_new(e, "bytes_per_sample",
+                          json_real((double) st[r].bytes / (double) st[r].samples));
+    json_array_append_new(arr, e);
+  }
+  json_object_set_new(o, "registers", arr);
+  json_print_or_pretty(o, pretty);
+
+  free(chunks);
+  free(st);
+
+  return rc;
+}
+
+struct hist_out {
+  uint8_t reg;
+  bool raw, csv, pretty;
+  uint64_t n;
+};
+
+static bool
+hist_print(void *ctx, int64_t t_ms, uint16_t raw, int exp5) {
+  struct hist_out *q = ctx;
+  const char *sep = q->n ? "," : "";
+
+  if (q->csv) {
+    if (q->raw)
+      printf("%lld,%u\n", (long long) t_ms, raw);
+    else
+      printf("%lld,%.9g\n", (long long) t_ms, pmbus_reg_to_units(q->reg, raw, exp5));
+  } else {
+    if (q->raw)
+      printf("%s%s[%lld,%u]", sep, q->pretty ? "\n    " : "", (long long) t_ms, raw);
+    else
+      printf("%s%s[%lld,%.9g]", sep, q->pretty ? "\n    " : "", (long long) t_ms,
+             pmbus_reg_to_units(q->reg, raw, exp5));
+  }
+  q->n++;
+
+  return true;
+}
+
+static int
+history_query(int fd, int argc, char *const *argv, int pretty) {
+  const char *opt_dir = NULL;
+  int64_t from = INT64_MIN, to = INT64_MAX;
+  struct hist_out q = { .pretty = pretty != 0 };
+  int reg = -1;
+
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--reg") && i + 1 < argc) {
+      if ((reg = hist_reg(argv[++i])) < 0)
+        return 2;
+    } else if (!strcmp(argv[i], "--from") && i + 1 < argc) {
+      if (parse_time(argv[++i], &from) < 0) {
+        usage_history();
+        return 2;
+      }
+    } else if (!strcmp(argv[i], "--to") && i + 1 < argc) {
+      if (parse_time(argv[++i], &to) < 0) {
+        usage_history();
+        return 2;
+      }
+    } else if (!strcmp(argv[i], "--dir") && i + 1 < argc)
+      opt_dir = argv[++i];
+    else if (!strcmp(argv[i], "--raw"))
+      q.raw = true;
+    else if (!strcmp(argv[i], "--csv"))
+      q.csv = true;
+    else {
+      usage_history();
+      return 2;
+    }
+  }
+  if (reg < 0 || from > to) {
+    usage_history();
+    return 2;
+  }
+  q.reg = (uint8_t) reg;
+
+  char dir[STATE_PATH_LEN];
+  if (hist_store_dir(fd, opt_dir, dir, sizeof dir) < 0)
+    return 1;
+
+  /* rows are streamed: a day at 10 Hz is close to a million samples */
+  const char *unit = q.raw ? "raw" : pmbus_unit_name(pmbus_regs[reg].unit);
+  if (q.csv)
+    printf("t_ms,%s_%s\n", pmbus_regs[reg].name, unit);
+  else
+    printf("{%s\"reg\": \"%s\", \"unit\": \"%s\", \"columns\": [\"t_ms\", \"value\"], \"rows\": [",
+           q.pretty ? "\n  " : "", pmbus_regs[reg].name, unit);
+
+  int rc = hist_scan(dir, q.reg, from, to, hist_print, &q) < 0 ? 1 : 0;
+
+  if (!q.csv)
+    printf("%s], \"count\": %llu%s}\n", q.pretty && q.n ? "\n  " : "",
+           (unsigned long long) q.n, q.pretty ? "\n" : "");
+
+  return rc;
+}
+
+int
+cmd_history(int fd, int argc, char *const *argv, int pretty) {
+  if (argc > 0 && !strcmp(argv[0], "record"))
+    return history_record(fd, argc, argv, pretty);
+  if (argc > 0 && !strcmp(argv[0], "query"))
+    return history_query(fd, argc, argv, pretty);
+
+  usage_history();
+
+  return 2;
+}
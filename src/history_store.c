@@ -0,0 +1,335 @@
+/* SPDX-License-Identifier: AGPL-3.0-or-later */
+#define _POSIX_C_SOURCE 200809L
+
+#include "history_store.h"
+#include "pmbus_regs.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/*
+ * Chunk header, little endian:
+ *   0  "BMRH"
+ *   4  u8  version
+ *   5  u8  register
+ *   6  s8  exp5 (LIN16U registers; 0 otherwise)
+ *   7  u8  reserved
+ *   8  u16 samples
+ *  10  u16 first raw word
+ *  12  u32 chunk length, header included
+ *  16  s64 first timestamp, ms since the epoch
+ *
+ * Index record: s64 first timestamp, s64 last timestamp, u64 offset, u32 length, u32 samples.
+ *
+ * Data goes to disk (fdatasync) before its index record, so a crash in between leaves at
+ * worst unreferenced bytes in the .dat file; a torn index record at the end is ignored.
+ */
+
+#define HIST_MAGIC "BMRH"
+#define HIST_VERSION 1
+#define HIST_SAMPLE_MAX 13      /* 10-byte timestamp varint + 3-byte value varint */
+#define HIST_IDX_BATCH 256
+
+static void
+put16(uint8_t *p, uint16_t v) {
+  p[0] = (uint8_t) v;
+  p[1] = (uint8_t) (v >> 8);
+}
+
+static void
+put32(uint8_t *p, uint32_t v) {
+  for (int i = 0; i < 4; i++)
+    p[i] = (uint8_t) (v >> (8 * i));
+}
+
+static void
+put64(uint8_t *p, uint64_t v) {
+  for (int i = 0; i < 8; i++)
+    p[i] = (uint8_t) (v >> (8 * i));
+}
+
+static uint16_t
+get16(const uint8_t *p) {
+  return (uint16_t) (p[0] | p[1] << 8);
+}
+
+static uint32_t
+get32(const uint8_t *p) {
+  uint32_t v = 0;
+
+  for (int i = 3; i >= 0; i--)
+    v = v << 8 | p[i];
+
+  return v;
+}
+
+static uint64_t
+get64(const uint8_t *p) {
+  uint64_t v = 0;
+
+  for (int i = 7; i >= 0; i--)
+    v = v << 8 | p[i];
+
+  return v;
+}
+
+static uint64_t
+zigzag(int64_t v) {
+  return ((uint64_t) v << 1) ^ (uint64_t) (v >> 63);
+}
+
+static int64_t
+unzigzag(uint64_t v) {
+  return (int64_t) (v >> 1) ^ -(int64_t) (v & 1);
+}
+
+static size_t
+put_varint(uint8_t *p, uint64_t v) {
+  size_t n = 0;
+
+  while (v >= 0x80) {
+    p[n++] = (uint8_t) (v | 0x80);
+    v >>= 7;
+  }
+  p[n++] = (uint8_t) v;
+
+  return n;
+}
+
+/* 0 if the varint runs past end or over 64 bits */
+static size_t
+get_varint(const uint8_t *p, const uint8_t *end, uint64_t *out) {
+  uint64_t v = 0;
+
+  for (size_t n = 0; n < 10 && p + n < end; n++) {
+    v |= (uint64_t) (p[n] & 0x7F) << (7 * n);
+    if (!(p[n] & 0x80)) {
+      *out = v;
+      return n + 1;
+    }
+  }
+
+  return 0;
+}
+
+void
+hist_chunk_start(struct hist_chunk *c, uint8_t reg, int8_t exp5, int64_t t_ms, uint16_t v) {
+  c->reg = reg;
+  c->exp5 = exp5;
+  c->n = 1;
+  c->t_first = c->t_prev = t_ms;
+  c->dt_prev = 0;
+  c->v_first = c->v_prev = v;
+  c->len = HIST_HDR_LEN;
+}
+
+bool
+hist_chunk_add(struct hist_chunk *c, int64_t t_ms, uint16_t v) {
+  if (c->n == UINT16_MAX || c->len + HIST_SAMPLE_MAX > HIST_CHUNK_MAX)
+    return false;
+
+  int64_t dt = t_ms - c->t_prev;
+
+  c->len += put_varint(&c->buf[c->len], zigzag(dt - c->dt_prev));
+  c->len += put_varint(&c->buf[c->len], zigzag((int16_t) (uint16_t) (v - c->v_prev)));
+  c->n++;
+  c->t_prev = t_ms;
+  c->dt_prev = dt;
+  c->v_prev = v;
+
+  return true;
+}
+
+static int
+hist_file(char *path, size_t len, const char *dir, uint8_t reg, const char *ext) {
+  const char *name = pmbus_regs[reg].name;
+
+  if (!name || (size_t) snprintf(path, len, "%s/%s.%s", dir, name, ext) >= len) {
+    fprintf(stderr, "history: no path for register 0x%02X\n", reg);
+    return -1;
+  }
+
+  return 0;
+}
+
+static int
+write_all(int fd, const uint8_t *p, size_t n) {
+  while (n) {
+    ssize_t w = write(fd, p, n);
+    if (w < 0) {
+      if (errno == EINTR)
+        continue;
+      return -1;
+    }
+    p += w;
+    n -= (size_t) w;
+  }
+
+  return 0;
+}
+
+int
+hist_append(const char *dir, struct hist_chunk *c) {
+  char dat[512], idx[512];
+  uint8_t rec[HIST_IDX_LEN];
+
+  if (!c->n)
+    return 0;
+  if (hist_file(dat, sizeof dat, dir, c->reg, "dat") < 0 ||
+      hist_file(idx, sizeof idx, dir, c->reg, "idx") < 0)
+    return -1;
+
+  memcpy(c->buf, HIST_MAGIC, 4);
+  c->buf[4] = HIST_VERSION;
+  c->buf[5] = c->reg;
+  c->buf[6] = (uint8_t) c->exp5;
+  c->buf[7] = 0;
+  put16(&c->buf[8], c->n);
+  put16(&c->buf[10], c->v_first);
+  put32(&c->buf[12], (uint32_t) c->len);
+  put64(&c->buf[16], (uint64_t) c->t_first);
+
+  int fd = open(dat, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    perror(dat);
+    return -1;
+  }
+  off_t off = lseek(fd, 0, SEEK_END);
+  if (off < 0 || write_all(fd, c->buf, c->len) < 0 || fdatasync(fd) < 0) {
+    perror(dat);
+    close(fd);
+    return -1;
+  }
+  close(fd);
+
+  put64(&rec[0], (uint64_t) c->t_first);
+  put64(&rec[8], (uint64_t) c->t_prev);
+  put64(&rec[16], (uint64_t) off);
+  put32(&rec[24], (uint32_t) c->len);
+  put32(&rec[28], c->n);
+
+  fd = open(idx, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    perror(idx);
+    return -1;
+  }
+  if (write_all(fd, rec, sizeof rec) < 0 || fdatasync(fd) < 0) {
+    perror(idx);
+    close(fd);
+    return -1;
+  }
+  close(fd);
+
+  c->n = 0;
+
+  return 0;
+}
+
+/* decode one chunk; 1 if the callback stopped the scan, <0 if the chunk is corrupt */
+static int
+hist_decode(const uint8_t *b, size_t len, uint8_t reg, int64_t from, int64_t to, hist_cb cb,
+            void *ctx) {
+  if (len < HIST_HDR_LEN || memcmp(b, HIST_MAGIC, 4) || b[4] != HIST_VERSION || b[5] != reg ||
+      get32(&b[12]) != len)
+    return -1;
+
+  int exp5 = (int8_t) b[6];
+  unsigned n = get16(&b[8]);
+  uint16_t v = get16(&b[10]);
+  int64_t t = (int64_t) get64(&b[16]), dt = 0;
+  const uint8_t *p = &b[HIST_HDR_LEN], *end = b + len;
+
+  for (unsigned i = 0; i < n; i++) {
+    if (i) {
+      uint64_t zt, zv;
+      size_t k = get_varint(p, end, &zt);
+      if (!k)
+        return -1;
+      p += k;
+      if (!(k = get_varint(p, end, &zv)))
+        return -1;
+      p += k;
+
+      dt += unzigzag(zt);
+      t += dt;
+      v = (uint16_t) (v + (uint16_t) unzigzag(zv));
+    }
+    if (t >= from && t <= to && !cb(ctx, t, v, exp5))
+      return 1;
+  }
+
+  return p == end ? 0 : -1;
+}
+
+int
+hist_scan(const char *dir, uint8_t reg, int64_t from, int64_t to, hist_cb cb, void *ctx) {
+  char dat[512], idx[512];
+  uint8_t rec[HIST_IDX_BATCH][HIST_IDX_LEN];
+  uint8_t *chunk = NULL;
+  int rc = 0;
+
+  if (hist_file(dat, sizeof dat, dir, reg, "dat") < 0 ||
+      hist_file(idx, sizeof idx, dir, reg, "idx") < 0)
+    return -1;
+
+  FILE *fi = fopen(idx, "rb");
+  if (!fi) {
+    perror(idx);
+    return -1;
+  }
+  int fd = open(dat, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    perror(dat);
+    fclose(fi);
+    return -1;
+  }
+  off_t size = lseek(fd, 0, SEEK_END);
+
+  chunk = malloc(HIST_CHUNK_MAX);
+  if (!chunk || size < 0) {
+    perror("history");
+    rc = -1;
+    goto out;
+  }
+
+  /* the index is small (32 bytes per chunk), a linear pass is cheap and survives clock steps */
+  size_t got;
+  while (rc == 0 && (got = fread(rec, HIST_IDX_LEN, HIST_IDX_BATCH, fi)) > 0) {
+    for (size_t i = 0; i < got && rc == 0; i++) {
+      int64_t t_first = (int64_t) get64(&rec[i][0]);
+      int64_t t_last = (int64_t) get64(&rec[i][8]);
+      uint64_t off = get64(&rec[i][16]);
+      uint32_t len = get32(&rec[i][24]);
+
+      if (t_last < from || t_first > to)
+        continue;
+      if (len > HIST_CHUNK_MAX || off + len > (uint64_t) size ||
+          pread(fd, chunk, len, (off_t) off) != (ssize_t) len) {
+        fprintf(stderr, "%s: chunk at %llu out of range, skipped\n", dat,
+                (unsigned long long) off);
+        continue;
+      }
+
+      int d = hist_decode(chunk, len, reg, from, to, cb, ctx);
+      if (d < 0)
+        fprintf(stderr, "%s: corrupt chunk at %llu, skipped\n", dat, (unsigned long long) off);
+      else if (d > 0)
+        rc = 1;
+    }
+  }
+  if (ferror(fi)) {
+    perror(idx);
+    rc = -1;
+  }
+
+out:
+  free(chunk);
+  close(fd);
+  fclose(fi);
+
+  return rc < 0 ? -1 : 0;
+}
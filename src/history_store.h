@@ -0,0 +1,45 @@
+/* SPDX-License-Identifier: AGPL-3.0-or-later */
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * On-host telemetry history: raw PMBus words per register, appended in compressed chunks.
+ *
+ * <dir>/<REG>.dat  chunks, back to back
+ * <dir>/<REG>.idx  one fixed-size record per chunk: first/last timestamp, offset, length
+ *
+ * A chunk starts with a header holding the first sample verbatim (timestamp in ms since the
+ * epoch, raw word, VOUT_MODE exponent for LIN16U). Each later sample is two zig-zag varints:
+ * the delta-of-delta of its timestamp and the 16-bit delta of its raw word. At a steady rate
+ * with a quiet rail both are 0, so a sample usually costs 2 bytes.
+ */
+
+#define HIST_CHUNK_MAX 8192
+#define HIST_HDR_LEN 24
+#define HIST_IDX_LEN 32
+
+struct hist_chunk {
+  uint8_t reg;
+  int8_t exp5;
+  uint16_t n;                   /* samples, including the one in the header */
+  int64_t t_first, t_prev, dt_prev;
+  uint16_t v_first, v_prev;
+  size_t len;                   /* encoded bytes, header included */
+  uint8_t buf[HIST_CHUNK_MAX];
+};
+
+void hist_chunk_start(struct hist_chunk *c, uint8_t reg, int8_t exp5, int64_t t_ms, uint16_t v);
+/* false when the chunk is full: append it and start a new one with this sample */
+bool hist_chunk_add(struct hist_chunk *c, int64_t t_ms, uint16_t v);
+
+/* append the chunk to <dir>/<REG>.dat and its record to <REG>.idx; <0 with a message */
+int hist_append(const char *dir, struct hist_chunk *c);
+
+/* return false to stop the scan */
+typedef bool (*hist_cb)(void *ctx, int64_t t_ms, uint16_t raw, int exp5);
+
+/* samples of reg with from <= t <= to, oldest first; <0 with a message on error */
+int hist_scan(const char *dir, uint8_t reg, int64_t from, int64_t to, hist_cb cb, void *ctx);
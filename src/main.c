@@ -10,7 +10,14 @@
 #include "mfr_addr_offset.h"
 #include "mfr_status_data.h"
 #include "mfr_save_restore.h"
+#include "config_cmd.h"
 #include "timing_cmd.h"
+#include "sequence_cmd.h"
+#include "exporter_cmd.h"
+#include "history_cmd.h"
+#include "rollup_cmd.h"
+#include "trigger_cmd.h"
+#include "guard_cmd.h"
 #include "read_cmd.h"
 #include "onoff_cmd.h"
 #include "operation_cmd.h"
@@ -18,6 +25,7 @@
 #include "temp_cmd.h"
 #include "status_cmd.h"
 #include "vout_cmd.h"
+#include "margin_sweep_cmd.h"
 #include "interleave_cmd.h"
 #include "vin_cmd.h"
 #include "pgood_cmd.h"
@@ -31,6 +39,7 @@
 #include "rw_cmd.h"
 
 #include <jansson.h>
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -48,16 +57,29 @@ usage(const char *p) {
 "\n"
 "Commands:\n"
 "  read [vin|vout|iout|temp1|temp2|duty|freq|all]\n"
-"  save\n"
-"  restore [default]\n"
-"  status\n"
-"  snapshot [--cycle 0..19] [--decode]\n"
+"  save [--force]\n"
+"  restore [default] [--wait [--timeout MS]]\n"
+"  status [--compact] [--clear]\n"
+"  snapshot [--cycle 0..19 | --all | --since-last [--state FILE]] [--decode [--compact]]\n"
 "  mfr-multi-pin get|set [--mode MODE] [--pg pushpull|highz] [--pg-enable 0|1] [--sec-rc-pull 0|1]\n"
 "  id\n"
 "  fwdata\n"
-"  restart\n"
+"  restart [--wait [--timeout MS]]\n"
 "  user-data get|set [--hex XX..|--ascii STR]\n"
+"  config apply FILE.json [--dry-run] [--save]\n"
+"  config dump [--out FILE | --out-dir DIR]\n"
+"  config verify --golden FILE [--device BUS:ADDR]... [--devices LIST] [--tolerance PCT]\n"
 "  timing get|set [--profile safe|sequenced|fast|prebias]\n"
+"  sequence up|down FILE.json [--on-fault abort|rollback] [--poll-ms N]\n"
+"  exporter --listen unix:/path|ADDR:PORT [--interval MS] [--device BUS:ADDR]...\n"
+"  history record [--regs NAME,...] [--interval MS] [--flush-s N] [--count N] [--dir DIR]\n"
+"  history query --reg NAME [--from T] [--to T] [--raw] [--csv] [--dir DIR]\n"
+"  rollup [--regs NAME,...] [--interval MS] [--window S] [--count N]\n"
+"         [--threshold NAME>V|NAME<V]... [--burst N]\n"
+"  trigger --when NAME>V|NAME<V|NAME/s>V|NAME/s<V|STATUS_REG[:BIT]... [--regs NAME,...]\n"
+"          [--interval MS] [--pre N] [--post N] [--holdoff MS] [--events N] [--no-snapshot]\n"
+"  guard --on STATUS_REG[:BIT]=off|clear|restart[,...]... [--dep BUS:ADDR]... [--interval-us N]\n"
+"        [--alert GPIO_VALUE_FILE] [--holdoff MS] [--retries N] [--rt PRIO] [--events N]\n"
 "  fault get [all|temp|vin|vout|tonmax|iout]\n"
 "  fault temp set [--ot-delay 16s|32s|2^n] [--ot-mode disable-retry] [--ot-retries cont]\n"
 "                 [--ton-delay MS] [--ton-rise MS] [--ton-max-fault MS]\n"
@@ -70,6 +92,7 @@ usage(const char *p) {
 "  operation get|set [--on|--off] [--margin normal|low|high] [--raw 0xHH]\n"
 "  vout get|set [--command V] [--mhigh V] [--mlow V]\n"
 "               [--set-all NOM --margin-pct +/-PCT]\n"
+"  margin-sweep --from V --to V --step V --dwell MS [--samples N] [--csv]\n"
 "  capability get\n"
 "  capability check [--need-pec on|off] [--min-speed 100|400|1000] [--need-alert on|off] [--strict]\n"
 "  interleave get|set [--set 0xNN] [--phases 1..16 --index 0..15]\n"
@@ -82,8 +105,8 @@ usage(const char *p) {
 "  freq get|set --raw 0xNNNN\n"
 "  salert get|set --raw 0xNN\n"
 "  addr-offset get|set --raw 0xNN\n"
-"  ramp-data\n"
-"  status-data\n"
+"  ramp-data [--decode] [--after restart|on [--count N]] [--period-us N]\n"
+"  status-data [--decode] | watch [--interval MS] [--count N]\n"
 "  write-protect get|set [--none|--ctrl|--nvm|--all] | --raw 0xNN\n"
 "  temp get  [all|ot|ut|warn]\n"
 "  temp set  [--ot-fault <C>] [--ut-fault <C>] [--ot-warn <C>] [--ut-warn <C>]\n"
@@ -103,6 +126,25 @@ usage(const char *p) {
   );
 }
 
+/*
+ * Commands whose devices are all named on the command line (or in a rail file) never touch
+ * --bus/--addr: don't make them depend on that device being reachable.
+ */
+static bool
+uses_default_dev(const char *cmd, int argc, char *const *argv) {
+  bool verify = !strcmp(cmd, "config") && argc >= 1 && !strcmp(argv[0], "verify");
+
+  if (!strcmp(cmd, "sequence"))
+    return false;
+  if (strcmp(cmd, "exporter") && !verify)
+    return true;
+  for (int i = 0; i < argc; i++)
+    if (!strcmp(argv[i], "--device") || (verify && !strcmp(argv[i], "--devices")))
+      return false;
+
+  return true;
+}
+
 int
 main(int argc, char *const *argv) {
   static const char* Lopt = "+b:a:Ph";
@@ -141,10 +183,13 @@ main(int argc, char *const *argv) {
 
   const char *cmd = argv[optind++];
 
-  int fd = pmbus_open(opt_bus, opt_addr);
-  if (fd < 0) {
-    perror("open bus");
-    return EXIT_FAILURE;
+  int fd = -1;
+  if (uses_default_dev(cmd, argc - optind, &argv[optind])) {
+    fd = pmbus_open(opt_bus, opt_addr);
+    if (fd < 0) {
+      perror("open bus");
+      return EXIT_FAILURE;
+    }
   }
 
   int rc = EXIT_SUCCESS;
@@ -184,7 +229,7 @@ main(int argc, char *const *argv) {
   }
 
   if (!strcmp(cmd, "restart")) {
-    rc = cmd_restart(fd);
+    rc = cmd_restart(fd, sub_argc, sub_argv, opt_pretty);
     goto fini;
   }
 
@@ -193,11 +238,46 @@ main(int argc, char *const *argv) {
     goto fini;
   }
 
+  if (!strcmp(cmd, "config")) {
+    rc = cmd_config(fd, sub_argc, sub_argv, opt_pretty);
+    goto fini;
+  }
+
   if (!strcmp(cmd, "timing")) {
     rc = cmd_timing(fd, sub_argc, sub_argv, opt_pretty);
     goto fini;
   }
 
+  if (!strcmp(cmd, "sequence")) {
+    rc = cmd_sequence(fd, sub_argc, sub_argv, opt_pretty);
+    goto fini;
+  }
+
+  if (!strcmp(cmd, "exporter")) {
+    rc = cmd_exporter(fd, opt_bus, opt_addr, sub_argc, sub_argv);
+    goto fini;
+  }
+
+  if (!strcmp(cmd, "history")) {
+    rc = cmd_history(fd, sub_argc, sub_argv, opt_pretty);
+    goto fini;
+  }
+
+  if (!strcmp(cmd, "rollup")) {
+    rc = cmd_rollup(fd, sub_argc, sub_argv, opt_pretty);
+    goto fini;
+  }
+
+  if (!strcmp(cmd, "trigger")) {
+    rc = cmd_trigger(fd, sub_argc, sub_argv, opt_pretty);
+    goto fini;
+  }
+
+  if (!strcmp(cmd, "guard")) {
+    rc = cmd_guard(fd, sub_argc, sub_argv, opt_pretty);
+    goto fini;
+  }
+
   if (!strcmp(cmd, "onoff")) {
     rc = cmd_onoff(fd, sub_argc, sub_argv, opt_pretty);
     goto fini;
@@ -213,6 +293,11 @@ main(int argc, char *const *argv) {
     goto fini;
   }
 
+  if (!strcmp(cmd, "margin-sweep")) {
+    rc = cmd_margin_sweep(fd, sub_argc, sub_argv, opt_pretty);
+    goto fini;
+  }
+
   if (!strcmp(cmd, "interleave")) {
     rc = cmd_interleave(fd, sub_argc, sub_argv, opt_pretty);
     goto fini;
@@ -284,12 +369,12 @@ main(int argc, char *const *argv) {
   }
 
   if (!strcmp(cmd, "save")) {
-    rc = cmd_save(fd);
+    rc = cmd_save(fd, sub_argc, sub_argv);
     goto fini;
   }
 
   if (!strcmp(cmd, "restore")) {
-    rc = cmd_restore(fd, sub_argc, sub_argv);
+    rc = cmd_restore(fd, sub_argc, sub_argv, opt_pretty);
     goto fini;
   }
 
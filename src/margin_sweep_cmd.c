@@ -0,0 +1,288 @@
+/* SPDX-License-Identifier: AGPL-3.0-or-later */
+#define _POSIX_C_SOURCE 200809L
+
+#include "pmbus_io.h"
+#include "util_json.h"
+#include "util_lin.h"
+
+#include <jansson.h>
+#include <errno.h>
+#include <math.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * VOUT margin sweep over one fd:
+ * for each set point, write VOUT_COMMAND, wait |dV| / VOUT_TRANSITION_RATE plus a fixed
+ * settle margin, then take --samples READ_VOUT/READ_IOUT/READ_TEMPERATURE_1 batches spread
+ * evenly over --dwell. All waits are absolute deadlines on CLOCK_MONOTONIC.
+ * The original VOUT_COMMAND is restored at the end, also on SIGINT/SIGTERM.
+ */
+
+#define SWEEP_SETTLE_MARGIN_US 1000
+#define SWEEP_DEFAULT_RATE_MV_US 1.0      /* if VOUT_TRANSITION_RATE is unreadable or 0 */
+#define SWEEP_DEFAULT_SAMPLES 4
+#define SWEEP_MAX_STEPS 10000
+
+static volatile sig_atomic_t sweep_stop;
+
+static void
+sweep_on_signal(int sig) {
+  (void) sig;
+  sweep_stop = 1;
+}
+
+static void
+usage_margin_sweep(void) {
+  fprintf(stderr,
+"margin-sweep --from V --to V --step V --dwell MS [--samples N] [--csv]\n"
+"Notes:\n"
+"  Set points stay within [VOUT_UV_FAULT_LIMIT, VOUT_OV_FAULT_LIMIT] and VOUT_MAX.\n"
+"  VOUT_COMMAND is restored when the sweep ends or is interrupted.\n"
+  );
+}
+
+static int
+parse_double(const char *s, double *out) {
+  char *end = NULL;
+
+  errno = 0;
+  double v = strtod(s, &end);
+  if (errno || end == s || *end != '\0')
+    return -1;
+
+  *out = v;
+
+  return 0;
+}
+
+/* LIN16U limit in volts, or fallback if the register cannot be read */
+static double
+rd_vout_limit(int fd, uint8_t cmd, int exp5, double fallback) {
+  int w = pmbus_rd_word(fd, cmd);
+
+  return w >= 0 ? lin16u_to_units((uint16_t) w, exp5) : fallback;
+}
+
+struct sweep_row {
+  double set_v;
+  double settle_ms;
+  double vout_mean, vout_min, vout_max;
+  double iout_mean;
+  double temp_mean;
+  int samples;
+};
+
+static const char *const sweep_columns[] = {
+  "vout_set_V", "settle_ms", "vout_mean_V", "vout_min_V", "vout_max_V", "error_mV", "iout_A",
+  "temp_C", "samples",
+};
+
+static void
+sweep_row_values(const struct sweep_row *r, double *v) {
+  v[0] = r->set_v;
+  v[1] = r->settle_ms;
+  v[2] = r->vout_mean;
+  v[3] = r->vout_min;
+  v[4] = r->vout_max;
+  v[5] = (r->vout_mean - r->set_v) * 1000.0;
+  v[6] = r->iout_mean;
+  v[7] = r->temp_mean;
+  v[8] = r->samples;
+}
+
+static void
+sweep_print(const struct sweep_row *rows, int n, bool csv, bool restored, int pretty) {
+  const size_t ncol = sizeof sweep_columns / sizeof sweep_columns[0];
+  double v[sizeof sweep_columns / sizeof sweep_columns[0]];
+
+  if (csv) {
+    for (size_t c = 0; c < ncol; c++)
+      printf("%s%s", c ? "," : "", sweep_columns[c]);
+    putchar('\n');
+    for (int i = 0; i < n; i++) {
+      sweep_row_values(&rows[i], v);
+      for (size_t c = 0; c < ncol; c++)
+        printf(c ? ",%.6g" : "%.6g", v[c]);
+      putchar('\n');
+    }
+    return;
+  }
+
+  json_t *o = json_object();
+  json_t *cols = json_array();
+  json_t *tab = json_array();
+
+  for (size_t c = 0; c < ncol; c++)
+    json_array_append_new(cols, json_string(sweep_columns[c]));
+  for (int i = 0; i < n; i++) {
+    json_t *row = json_array();
+
+    sweep_row_values(&rows[i], v);
+    for (size_t c = 0; c < ncol; c++)
+      json_array_append_new(row, c + 1 == ncol ? json_integer(rows[i].samples) :
+                                 isfinite(v[c]) ? json_real(v[c]) : json_null());
+    json_array_append_new(tab, row);
+  }
+  json_object_set_new(o, "columns", cols);
+  json_object_set_new(o, "rows", tab);
+  json_object_set_new(o, "vout_restored", json_boolean(restored));
+
+  json_print_or_pretty(o, pretty);
+}
+
+int
+cmd_margin_sweep(int fd, int argc, char *const *argv, int pretty) {
+  double from = NAN, to = NAN, step = NAN, dwell_ms = NAN;
+  int nsamples = SWEEP_DEFAULT_SAMPLES;
+  bool csv = false;
+
+  for (int i = 0; i < argc; i++) {
+    const char *a = argv[i];
+    int bad = 0;
+
+    if (!strcmp(a, "--from") && i + 1 < argc)
+      bad = parse_double(argv[++i], &from);
+    else if (!strcmp(a, "--to") && i + 1 < argc)
+      bad = parse_double(argv[++i], &to);
+    else if (!strcmp(a, "--step") && i + 1 < argc)
+      bad = parse_double(argv[++i], &step);
+    else if (!strcmp(a, "--dwell") && i + 1 < argc)
+      bad = parse_double(argv[++i], &dwell_ms);
+    else if (!strcmp(a, "--samples") && i + 1 < argc)
+      nsamples = atoi(argv[++i]);
+    else if (!strcmp(a, "--csv"))
+      csv = true;
+    else
+      bad = -1;
+
+    if (bad) {
+      usage_margin_sweep();
+      return 2;
+    }
+  }
+
+  if (isnan(from) || isnan(to) || isnan(dwell_ms) || !(step > 0) || dwell_ms < 0 || nsamples < 1) {
+    usage_margin_sweep();
+    return 2;
+  }
+
+  int nsteps = (int) (fabs(to - from) / step + 1e-9) + 1;
+  if (nsteps > SWEEP_MAX_STEPS) {
+    fprintf(stderr, "too many steps (max %d)\n", SWEEP_MAX_STEPS);
+    return 2;
+  }
+
+  int exp5;
+  if (pmbus_get_vout_mode_exp(fd, &exp5) < 0) {
+    perror("VOUT_MODE");
+    return 1;
+  }
+
+  int orig = pmbus_rd_word(fd, PMBUS_VOUT_COMMAND);
+  if (orig < 0) {
+    perror("VOUT_COMMAND");
+    return 1;
+  }
+
+  double lo = rd_vout_limit(fd, PMBUS_VOUT_UV_FAULT_LIMIT, exp5, 0.0);
+  double hi = rd_vout_limit(fd, PMBUS_VOUT_OV_FAULT_LIMIT, exp5, INFINITY);
+  double vmax = rd_vout_limit(fd, PMBUS_VOUT_MAX, exp5, INFINITY);
+  if (vmax < hi)
+    hi = vmax;
+  double vlo = to < from ? to : from;
+  double vhi = to < from ? from : to;
+  if (vlo <= lo || vhi >= hi) {
+    fprintf(stderr, "sweep %.4g..%.4g V leaves the fault window (%.4g, %.4g) V\n", from, to, lo, hi);
+    return 2;
+  }
+
+  int rate_w = pmbus_rd_word(fd, PMBUS_VOUT_TRANSITION_RATE);
+  double rate = rate_w >= 0 ? lin11_to_units((uint16_t) rate_w) : 0.0;  /* mV/us */
+  if (!(rate > 0))
+    rate = SWEEP_DEFAULT_RATE_MV_US;
+
+  struct sweep_row *rows = calloc((size_t) nsteps, sizeof rows[0]);
+  struct sigaction sa = { .sa_handler = sweep_on_signal };
+  struct sigaction old_int, old_term;
+
+  sigemptyset(&sa.sa_mask);
+  sigaction(SIGINT, &sa, &old_int);
+  sigaction(SIGTERM, &sa, &old_term);
+
+  double dir = to >= from ? 1.0 : -1.0;
+  double prev_v = lin16u_to_units((uint16_t) orig, exp5);
+  int n = 0, rc = 0;
+
+  for (int i = 0; i < nsteps && !sweep_stop; i++) {
+    uint16_t code = units_to_lin16u(from + dir * step * i, exp5);
+    struct sweep_row *r = &rows[n];
+
+    r->set_v = lin16u_to_units(code, exp5);
+
+    if (pmbus_wr_word(fd, PMBUS_VOUT_COMMAND, code) < 0) {
+      perror("VOUT_COMMAND");
+      rc = 1;
+      break;
+    }
+
+    int64_t t0 = pmbus_now_us();
+    int64_t settle_us = (int64_t) (fabs(r->set_v - prev_v) * 1000.0 / rate) + SWEEP_SETTLE_MARGIN_US;
+    int64_t dwell_us = (int64_t) (dwell_ms * 1000.0);
+    prev_v = r->set_v;
+    r->settle_ms = (double) settle_us / 1000.0;
+    r->vout_min = INFINITY;
+    r->vout_max = -INFINITY;
+
+    for (int k = 0; k < nsamples && !sweep_stop; k++) {
+      pmbus_sleep_until_us(t0 + settle_us + (nsamples > 1 ? dwell_us * k / (nsamples - 1) : dwell_us));
+
+      int wv = pmbus_rd_word(fd, PMBUS_READ_VOUT);
+      int wi = pmbus_rd_word(fd, PMBUS_READ_IOUT);
+      int wt = pmbus_rd_word(fd, PMBUS_READ_TEMPERATURE_1);
+      if (wv < 0 || wi < 0 || wt < 0)
+        continue;
+
+      double v = lin16u_to_units((uint16_t) wv, exp5);
+      r->vout_mean += v;
+      if (v < r->vout_min)
+        r->vout_min = v;
+      if (v > r->vout_max)
+        r->vout_max = v;
+      r->iout_mean += lin11_to_units((uint16_t) wi);
+      r->temp_mean += lin11_to_units((uint16_t) wt);
+      r->samples++;
+    }
+
+    if (r->samples) {
+      r->vout_mean /= r->samples;
+      r->iout_mean /= r->samples;
+      r->temp_mean /= r->samples;
+    } else {
+      r->vout_mean = r->vout_min = r->vout_max = r->iout_mean = r->temp_mean = NAN;
+    }
+    n++;
+  }
+
+  bool restored = pmbus_wr_word(fd, PMBUS_VOUT_COMMAND, (uint16_t) orig) == 0;
+  if (!restored) {
+    perror("VOUT_COMMAND restore");
+    rc = 1;
+  }
+
+  sigaction(SIGINT, &old_int, NULL);
+  sigaction(SIGTERM, &old_term, NULL);
+
+  if (sweep_stop) {
+    fprintf(stderr, "margin-sweep: interrupted after %d steps\n", n);
+    rc = 1;
+  }
+
+  sweep_print(rows, n, csv, restored, pretty);
+  free(rows);
+
+  return rc;
+}
@@ -1,5 +1,6 @@
 /* SPDX-License-Identifier: AGPL-3.0-or-later */
 #include "pmbus_io.h"
+#include "mfr_hrr.h"
 #include "util_json.h"
 
 #include <jansson.h>
@@ -9,7 +10,7 @@
 #include <errno.h>
 
 /* See BMR480 specs */
-#define BIT_PEC     (1u<<7)     /* Require Packet Error Check */
+#define BIT_PEC     MFR_SPECIAL_OPTIONS_PEC
 #define BIT_HRR     (1u<<6)     /* Hybrid Regulated Ratio enable */
 #define BIT_DLS     (1u<<5)     /* 0: linear droop, 1: non-linear droop */
 #define BIT_ARTDLC  (1u<<3)     /* Adaptive Ramp-up Time / Dynamic Loop Compensation enable */
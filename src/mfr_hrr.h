@@ -1,4 +1,7 @@
 /* SPDX-License-Identifier: AGPL-3.0-or-later */
 #pragma once
 
+/* MFR_SPECIAL_OPTIONS bit 7: the device requires SMBus PEC on every transaction */
+#define MFR_SPECIAL_OPTIONS_PEC (1u << 7)
+
 int cmd_hrr(int fd, int argc, char *const *argv, int pretty);
@@ -1,36 +1,284 @@
 /* SPDX-License-Identifier: AGPL-3.0-or-later */
+
 #include "pmbus_io.h"
+#include "mfr_restart.h"
 #include "util_json.h"
 
 #include <jansson.h>
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdbool.h>
+#include <errno.h>
+
+/*
+ * MFR_GET_RAMP_DATA record, as captured by the device during the last soft-start.
+ * Assumed layout (no document in the tree describes it): consecutive 4-byte samples,
+ * each VOUT (LIN16U, VOUT_MODE exponent) followed by IOUT (LIN11), both little-endian,
+ * taken at a fixed period. The period is not part of the record either, hence
+ * --period-us.
+ */
+#define RAMP_SAMPLE_LEN 4
+#define RAMP_MAX_SAMPLES (255 / RAMP_SAMPLE_LEN)
+#define RAMP_DEFAULT_PERIOD_US 100
+
+/* margin added after TON_DELAY + TON_RISE before fetching the capture */
+#define RAMP_SETTLE_MS 50
+#define RAMP_READ_RETRIES 20
+
+struct ramp_ctx {
+  int exp5;
+  unsigned period_us;
+  int ton_rise_ms;              /* -1 if unreadable */
+  double vout_cmd;              /* target, < 0 if unreadable */
+};
 
 static void
 usage_ramp_data(void) {
   fprintf(stderr,
-"ramp-data\n"
+"ramp-data [--decode] [--period-us N]\n"
+"ramp-data --after restart|on [--count N] [--period-us N]\n"
   );
 }
 
+/* Time at which the rising waveform crosses level, interpolated between samples. */
+static double
+ramp_cross_us(const double *v, int n, double level, unsigned period_us) {
+  for (int i = 1; i < n; i++) {
+    if (v[i - 1] < level && v[i] >= level) {
+      double f = (level - v[i - 1]) / (v[i] - v[i - 1]);
+      return ((double) (i - 1) + f) * period_us;
+    }
+  }
+  if (n > 0 && v[0] >= level)
+    return 0.0;
+
+  return -1.0;
+}
+
+static json_t *
+ramp_decode(const uint8_t *b, int len, const struct ramp_ctx *c) {
+  json_t *o = json_object();
+  int n = len / RAMP_SAMPLE_LEN;
+
+  if (n < 2) {
+    json_object_set_new(o, "error", json_string("short record"));
+    return o;
+  }
+
+  double vout[RAMP_MAX_SAMPLES];
+  json_t *samples = json_array();
+
+  for (int i = 0; i < n; i++) {
+    const uint8_t *s = &b[i * RAMP_SAMPLE_LEN];
+    json_t *e = json_object();
+
+    vout[i] = pmbus_lin16u_to_double(le16(&s[0]), c->exp5);
+    json_object_set_new(e, "t_us", json_integer((json_int_t) i * c->period_us));
+    json_object_set_new(e, "vout_V", json_real(vout[i]));
+    json_object_set_new(e, "iout_A", json_real(pmbus_lin11_to_double(le16(&s[2]))));
+    json_array_append_new(samples, e);
+  }
+
+  /* target: commanded VOUT when available, else the last (settled) sample */
+  double target = c->vout_cmd > 0 ? c->vout_cmd : vout[n - 1];
+  double peak = vout[0];
+  for (int i = 1; i < n; i++)
+    if (vout[i] > peak)
+      peak = vout[i];
+
+  /*
+   * Monotonic up to the 90% point; dips of one LSB are quantization, not a
+   * real reversal.
+   */
+  double lsb = pmbus_lin16u_to_double(1, c->exp5);
+  int reversals = 0;
+  for (int i = 1; i < n && vout[i - 1] < 0.9 * target; i++)
+    if (vout[i] < vout[i - 1] - lsb)
+      reversals++;
+
+  json_t *a = json_object();
+  double t10 = ramp_cross_us(vout, n, 0.1 * target, c->period_us);
+  double t90 = ramp_cross_us(vout, n, 0.9 * target, c->period_us);
+
+  json_object_set_new(a, "target_V", json_real(target));
+  json_object_set_new(a, "peak_V", json_real(peak));
+  /* a failed ramp can end at 0 V with no VOUT_COMMAND to fall back on */
+  if (target > 0)
+    json_object_set_new(a, "overshoot_pct",
+                        json_real(peak > target ? (peak - target) / target * 100.0 : 0.0));
+  else
+    json_object_set_new(a, "overshoot_pct", json_null());
+  json_object_set_new(a, "monotonic", json_boolean(reversals == 0));
+  json_object_set_new(a, "reversals", json_integer(reversals));
+  if (t10 >= 0 && t90 >= 0) {
+    double rise_ms = (t90 - t10) / 1000.0;
+
+    json_object_set_new(a, "rise_10_90_ms", json_real(rise_ms));
+    /* TON_RISE is 0..100%: a linear ramp spends 80% of it between 10% and 90% */
+    if (c->ton_rise_ms > 0)
+      json_object_set_new(a, "rise_vs_ton_rise", json_real(rise_ms / (0.8 * c->ton_rise_ms)));
+  } else {
+    json_object_set_new(a, "rise_10_90_ms", json_null());
+  }
+  if (c->ton_rise_ms >= 0)
+    json_object_set_new(a, "ton_rise_ms", json_integer(c->ton_rise_ms));
+
+  json_object_set_new(o, "period_us", json_integer(c->period_us));
+  json_object_set_new(o, "samples", samples);
+  json_object_set_new(o, "analysis", a);
+
+  return o;
+}
+
+static void
+ramp_ctx_init(int fd, struct ramp_ctx *c, unsigned period_us) {
+  c->exp5 = 0;
+  c->period_us = period_us;
+  pmbus_get_vout_mode_exp(fd, &c->exp5);
+
+  c->ton_rise_ms = pmbus_rd_word(fd, PMBUS_TON_RISE);
+
+  int v = pmbus_rd_word(fd, PMBUS_VOUT_COMMAND);
+  c->vout_cmd = v >= 0 ? pmbus_lin16u_to_double((uint16_t) v, c->exp5) : -1.0;
+}
+
+/* The device NACKs while restarting: retry the fetch until it answers again. */
+static int
+ramp_fetch(int fd, uint8_t *buf, int max, bool retry) {
+  for (int t = 0;; t++) {
+    int n = pmbus_rd_block(fd, MFR_GET_RAMP_DATA, buf, max);
+    if (n >= 0 || !retry || t >= RAMP_READ_RETRIES)
+      return n;
+    pmbus_sleep_ms(10);
+  }
+}
+
+static int
+ramp_trigger(int fd, bool restart) {
+  if (restart) {
+    if (mfr_restart_issue(fd) < 0) {
+      perror("MFR_RESTART");
+      return -1;
+    }
+    return 0;
+  }
+
+  int op = pmbus_rd_byte(fd, PMBUS_OPERATION);
+  if (op < 0) {
+    perror("OPERATION");
+    return -1;
+  }
+
+  if (op & 0x80) {
+    int toff = pmbus_rd_word(fd, PMBUS_TOFF_DELAY);
+    int fall = pmbus_rd_word(fd, PMBUS_TOFF_FALL);
+
+    if (pmbus_wr_byte(fd, PMBUS_OPERATION, (uint8_t) (op & ~0x80)) < 0) {
+      perror("OPERATION");
+      return -1;
+    }
+    pmbus_sleep_ms((unsigned) ((toff > 0 ? toff : 0) + (fall > 0 ? fall : 0) + RAMP_SETTLE_MS));
+  }
+
+  if (pmbus_wr_byte(fd, PMBUS_OPERATION, (uint8_t) (op | 0x80)) < 0) {
+    perror("OPERATION");
+    return -1;
+  }
+
+  return 0;
+}
+
+static int
+ramp_loop(int fd, bool restart, int count, unsigned period_us, int pretty) {
+  struct ramp_ctx c;
+  ramp_ctx_init(fd, &c, period_us);
+
+  int ton_delay = pmbus_rd_word(fd, PMBUS_TON_DELAY);
+  unsigned wait_ms = (unsigned) ((ton_delay > 0 ? ton_delay : 0) +
+                                 (c.ton_rise_ms > 0 ? c.ton_rise_ms : 0) + RAMP_SETTLE_MS);
+
+  json_t *arr = json_array();
+  int rc = 0;
+
+  for (int i = 0; i < count; i++) {
+    if (ramp_trigger(fd, restart) < 0) {
+      rc = 1;
+      break;
+    }
+    pmbus_sleep_ms(wait_ms);
+
+    uint8_t buf[255];
+    int n = ramp_fetch(fd, buf, (int) sizeof buf, true);
+    json_t *e;
+
+    if (n < 0) {
+      e = json_object();
+      json_object_set_new(e, "error", json_string(strerror(errno)));
+    } else {
+      e = ramp_decode(buf, n, &c);
+      json_add_len_and_hex(e, "hex", buf, (size_t) n);
+    }
+    json_object_set_new(e, "run", json_integer(i));
+    json_array_append_new(arr, e);
+  }
+
+  json_print_or_pretty(arr, pretty);
+
+  return rc;
+}
+
 int
 cmd_ramp_data(int fd, int argc, char *const *argv, int pretty) {
-  (void) argv;
+  bool decode = false;
+  const char *after = NULL;
+  int count = 1;
+  unsigned period_us = RAMP_DEFAULT_PERIOD_US;
 
-  if (argc > 0) {
+  for (int i = 0; i < argc; i++) {
+    if (!strcmp(argv[i], "--decode"))
+      decode = true;
+    else if (!strcmp(argv[i], "--after") && i + 1 < argc)
+      after = argv[++i];
+    else if (!strcmp(argv[i], "--count") && i + 1 < argc)
+      count = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--period-us") && i + 1 < argc)
+      period_us = (unsigned) strtoul(argv[++i], NULL, 0);
+    else {
+      usage_ramp_data();
+      return 2;
+    }
+  }
+
+  if (count < 1 || !period_us) {
     usage_ramp_data();
     return 2;
   }
 
+  if (after) {
+    if (strcmp(after, "restart") && strcmp(after, "on")) {
+      usage_ramp_data();
+      return 2;
+    }
+    return ramp_loop(fd, !strcmp(after, "restart"), count, period_us, pretty);
+  }
+
   uint8_t buf[255];
-  int n = pmbus_rd_block(fd, MFR_GET_RAMP_DATA, buf, (int) sizeof(buf));
+  int n = ramp_fetch(fd, buf, (int) sizeof(buf), false);
   if (n < 0) {
     perror("MFR_GET_RAMP_DATA");
     return 1;
   }
 
-  json_t *o = json_object();
+  json_t *o;
+  if (decode) {
+    struct ramp_ctx c;
+
+    ramp_ctx_init(fd, &c, period_us);
+    o = ramp_decode(buf, n, &c);
+  } else {
+    o = json_object();
+  }
   json_add_len_and_hex(o, "hex", buf, (size_t)n);
 
   json_print_or_pretty(o, pretty);
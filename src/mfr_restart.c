@@ -1,17 +1,116 @@
 /* SPDX-License-Identifier: AGPL-3.0-or-later */
 
 #include "pmbus_io.h"
+#include "mfr_restart.h"
+#include "util_json.h"
+
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define READY_DEFAULT_TIMEOUT_MS 5000
+/* window for the restart to take effect before we stop waiting for the drop */
+#define READY_DROP_WINDOW_MS 200
+/* consecutive power-good reads needed to call it stable */
+#define READY_PG_STABLE 3
+
+/* STATUS_WORD bit 11 is POWER_GOOD#: set while power is not good */
+#define STATUS_WORD_POWER_GOOD_N 0x0800
+
+static void
+usage_restart(void) {
+  fprintf(stderr,
+"restart [--wait [--timeout MS]]\n"
+  );
+}
+
+int
+mfr_restart_issue(int fd) {
+  static const uint8_t key[4] = { 'E', 'R', 'I', 'C' };
+
+  return pmbus_wr_block(fd, MFR_RESTART, key, sizeof key);
+}
 
 int
-cmd_restart(int fd) {
-  const char *s = "ERIC";
+wait_ready(int fd, unsigned timeout_ms, bool expect_drop, json_t *out) {
+  int64_t t0 = pmbus_now_us();
+  int64_t deadline = t0 + (int64_t) timeout_ms * 1000;
+  int64_t ack_us = -1;
+  unsigned backoff = 1;
+  int stable = 0;
+
+  if (expect_drop) {
+    int64_t drop_deadline = t0 + READY_DROP_WINDOW_MS * 1000;
+
+    for (;;) {
+      int sw = pmbus_rd_word(fd, PMBUS_STATUS_WORD);
+      if (sw < 0 || (sw & STATUS_WORD_POWER_GOOD_N) || pmbus_now_us() >= drop_deadline)
+        break;
+      pmbus_sleep_ms(1);
+    }
+  }
+
+  for (;;) {
+    int sw = pmbus_rd_word(fd, PMBUS_STATUS_WORD);
+    int64_t now = pmbus_now_us();
+
+    if (sw >= 0) {
+      if (ack_us < 0)
+        ack_us = now - t0;
+      stable = (sw & STATUS_WORD_POWER_GOOD_N) ? 0 : stable + 1;
+      if (stable >= READY_PG_STABLE) {
+        json_object_set_new(out, "ack_ms", json_real((double) ack_us / 1000.0));
+        json_object_set_new(out, "power_good_ms", json_real((double) (now - t0) / 1000.0));
+        return 0;
+      }
+      /* device is back: poll power good at a steady 1 ms */
+      backoff = 1;
+    }
+    if (now >= deadline)
+      break;
 
-  if (pmbus_wr_block(fd, MFR_RESTART, (const uint8_t *) s, 4) < 0) {
+    pmbus_sleep_ms(backoff);
+    if (sw < 0 && backoff < 16)
+      backoff <<= 1;
+  }
+
+  json_object_set_new(out, "ack_ms", ack_us >= 0 ? json_real((double) ack_us / 1000.0) : json_null());
+  json_object_set_new(out, "power_good_ms", json_null());
+
+  return -1;
+}
+
+int
+cmd_restart(int fd, int argc, char *const *argv, int pretty) {
+  bool wait = false;
+  unsigned timeout_ms = READY_DEFAULT_TIMEOUT_MS;
+
+  for (int i = 0; i < argc; i++) {
+    if (!strcmp(argv[i], "--wait"))
+      wait = true;
+    else if (!strcmp(argv[i], "--timeout") && i + 1 < argc)
+      timeout_ms = (unsigned) strtoul(argv[++i], NULL, 0);
+    else {
+      usage_restart();
+      return 2;
+    }
+  }
+
+  if (mfr_restart_issue(fd) < 0) {
     perror("MFR_RESTART");
     return 1;
   }
-  puts("OK");
 
-  return 0;
+  if (!wait) {
+    puts("OK");
+    return 0;
+  }
+
+  json_t *o = json_object();
+  int rc = wait_ready(fd, timeout_ms, true, o);
+
+  json_object_set_new(o, "ready", json_boolean(rc == 0));
+  json_print_or_pretty(o, pretty);
+
+  return rc < 0 ? 1 : 0;
 }
@@ -1,4 +1,18 @@
 /* SPDX-License-Identifier: AGPL-3.0-or-later */
 #pragma once
 
-int cmd_restart(int fd);
+#include <jansson.h>
+#include <stdbool.h>
+
+/*
+ * Poll until the device ACKs and STATUS_WORD shows power good on several consecutive reads.
+ * With expect_drop, first wait (briefly) for the device to go away or lose power good, so a
+ * device that has not started its restart yet is not reported ready.
+ * Fills out with ack_ms / power_good_ms; returns 0 when ready, <0 on timeout.
+ */
+int wait_ready(int fd, unsigned timeout_ms, bool expect_drop, json_t *out);
+
+/* MFR_RESTART with its "ERIC" key; <0 with errno set on failure */
+int mfr_restart_issue(int fd);
+
+int cmd_restart(int fd, int argc, char *const *argv, int pretty);
@@ -1,23 +1,133 @@
 /* SPDX-License-Identifier: AGPL-3.0-or-later */
 
 #include "pmbus_io.h"
+#include "pmbus_regs.h"
+#include "mfr_save_restore.h"
+#include "mfr_restart.h"
+#include "util_json.h"
+#include "util_state.h"
+
+#include <inttypes.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
-int
-cmd_save(int fd) {
-  uint8_t b[64];
+/* NVM programming takes tens of ms, during which the device may NACK */
+#define STORE_READY_TIMEOUT_MS 1000
+#define RESTORE_WAIT_TIMEOUT_MS 5000
 
+int
+store_user_all(int fd, unsigned model) {
   /*
    * For BMR456 STORE and RESTORE is not based on send byte but on a write byte with a dummy value
    * Product version is read to know how to execute the command
    */
-  pmbus_rd_block(fd, MFR_MODEL, b, (int)sizeof b);
+  if (model != MODEL_BMR456)
+    return pmbus_send_byte(fd, PMBUS_STORE_USER_ALL);
+
+  return pmbus_wr_byte(fd, PMBUS_STORE_USER_ALL, 0x01);
+}
+
+/*
+ * FNV-1a over (opcode, length, value) of every configuration register, i.e. what
+ * STORE_USER_ALL would persist. Unreadable registers hash as absent.
+ */
+static uint64_t
+config_hash(int fd, unsigned model) {
+  uint64_t h = 0xcbf29ce484222325ULL;
+
+  for (int c = 0; c < 256; c++) {
+    if (!pmbus_reg_config((uint8_t) c, model))
+      continue;
+
+    uint8_t b[256];
+    int n;
+
+    if (pmbus_regs[c].xfer == XFER_BLOCK) {
+      n = pmbus_rd_block(fd, (uint8_t) c, &b[1], (int) sizeof b - 1);
+    } else {
+      int v = pmbus_reg_rd(fd, (uint8_t) c);
+      n = v < 0 ? -1 : 2;
+      b[1] = (uint8_t) v;
+      b[2] = (uint8_t) (v >> 8);
+    }
+    if (n < 0)
+      continue;
+
+    b[0] = (uint8_t) c;
+    for (int i = 0; i <= n; i++) {
+      h ^= b[i];
+      h *= 0x100000001b3ULL;
+    }
+    h ^= (uint8_t) n;
+    h *= 0x100000001b3ULL;
+  }
+
+  return h;
+}
+
+int
+store_user_all_coalesced(int fd, unsigned model, bool force, int64_t *ready_us) {
+  char path[STATE_PATH_LEN];
+  char hex[20];
+  bool have_state = state_path(fd, "store", path, sizeof path) == 0;
+  uint64_t h = config_hash(fd, model);
 
-  if (strncmp((char *)b, "BMR456", (size_t)6))
-    pmbus_send_byte(fd, PMBUS_STORE_USER_ALL);
-  else
-    pmbus_wr_byte(fd, PMBUS_STORE_USER_ALL, 0x01);
+  snprintf(hex, sizeof hex, "%016" PRIx64, h);
+  *ready_us = 0;
+
+  if (have_state && !force) {
+    json_t *o = state_load(path);
+    const char *last = json_string_value(json_object_get(o, "config_hash"));
+    bool same = last && !strcmp(last, hex);
+
+    json_decref(o);
+    if (same)
+      return 0;
+  }
+
+  if (store_user_all(fd, model) < 0) {
+    perror("STORE_USER_ALL");
+    return -1;
+  }
+
+  *ready_us = pmbus_wait_ack(fd, STORE_READY_TIMEOUT_MS);
+  if (*ready_us < 0) {
+    fprintf(stderr, "STORE_USER_ALL: device not ready after %d ms\n", STORE_READY_TIMEOUT_MS);
+    return -1;
+  }
+
+  if (have_state) {
+    json_t *o = json_object();
+
+    json_object_set_new(o, "config_hash", json_string(hex));
+    state_save(path, o);
+    json_decref(o);
+  }
+
+  return 1;
+}
+
+int
+cmd_save(int fd, int argc, char *const *argv) {
+  bool force = false;
+
+  for (int i = 0; i < argc; i++) {
+    if (!strcmp(argv[i], "--force")) {
+      force = true;
+    } else {
+      fprintf(stderr, "save [--force]\n");
+      return 2;
+    }
+  }
+
+  int64_t ready_us;
+  int rc = store_user_all_coalesced(fd, pmbus_model(fd), force, &ready_us);
+
+  if (rc < 0)
+    return 1;
+  if (!rc)
+    fprintf(stderr, "save: no change since last store, skipped (--force to store anyway)\n");
 
   puts("OK");
 
@@ -25,33 +135,53 @@ cmd_save(int fd) {
 }
 
 int
-cmd_restore(int fd, int argc, char *const *argv) {
-  uint8_t b[64];
+cmd_restore(int fd, int argc, char *const *argv, int pretty) {
   bool isDefault = false;
+  bool wait = false;
+  unsigned timeout_ms = RESTORE_WAIT_TIMEOUT_MS;
 
-  if ((argc) && !strcmp(argv[0], "default"))
-    isDefault = true;
+  for (int i = 0; i < argc; i++) {
+    if (!strcmp(argv[i], "default"))
+      isDefault = true;
+    else if (!strcmp(argv[i], "--wait"))
+      wait = true;
+    else if (!strcmp(argv[i], "--timeout") && i + 1 < argc)
+      timeout_ms = (unsigned) strtoul(argv[++i], NULL, 0);
+    else {
+      fprintf(stderr, "restore [default] [--wait [--timeout MS]]\n");
+      return 2;
+    }
+  }
 
 
   /*
    * For BMR456 STORE and RESTORE is not based on send byte but on a write byte with a dummy value
    * Product version is read to know how to execute the command
    */
-  pmbus_rd_block(fd, MFR_MODEL, b, (int)sizeof b);
+  bool is456 = pmbus_model(fd) == MODEL_BMR456;
 
   if (isDefault) {
-    if (strncmp((char *)b, "BMR456", (size_t)6))
+    if (!is456)
       pmbus_send_byte(fd, PMBUS_RESTORE_DEFAULT_ALL);
     else
       pmbus_wr_byte(fd, PMBUS_RESTORE_DEFAULT_ALL, 0x01);
   } else {
-    if (strncmp((char *)b, "BMR456", (size_t)6))
+    if (!is456)
       pmbus_send_byte(fd, PMBUS_RESTORE_USER_ALL);
     else
       pmbus_wr_byte(fd, PMBUS_RESTORE_USER_ALL, 0x01);
   }
 
-  puts("OK");
+  if (!wait) {
+    puts("OK");
+    return 0;
+  }
 
-  return 0;
+  json_t *o = json_object();
+  int rc = wait_ready(fd, timeout_ms, false, o);
+
+  json_object_set_new(o, "ready", json_boolean(rc == 0));
+  json_print_or_pretty(o, pretty);
+
+  return rc < 0 ? 1 : 0;
 }
@@ -1,5 +1,18 @@
 /* SPDX-License-Identifier: AGPL-3.0-or-later */
 #pragma once
 
-int cmd_save(int fd);
-int cmd_restore(int fd, int argc, char *const *argv);
+#include <stdbool.h>
+#include <stdint.h>
+
+/* STORE_USER_ALL with the per-model transaction type (model from pmbus_model()) */
+int store_user_all(int fd, unsigned model);
+
+/*
+ * STORE_USER_ALL only if the configuration registers changed since the last store made
+ * through this tool (hash kept in the per-device state file), then wait until the device
+ * ACKs again. Returns 1 if stored (*ready_us: time to ready), 0 if skipped, <0 on error.
+ */
+int store_user_all_coalesced(int fd, unsigned model, bool force, int64_t *ready_us);
+
+int cmd_save(int fd, int argc, char *const *argv);
+int cmd_restore(int fd, int argc, char *const *argv, int pretty);
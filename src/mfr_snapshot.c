@@ -1,17 +1,22 @@
 /* SPDX-License-Identifier: AGPL-3.0-or-later */
 
 #include "pmbus_io.h"
+#include "mfr_snapshot.h"
 #include "decoders.h"
 #include "util_json.h"
+#include "util_state.h"
 
 #include <jansson.h>
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <stdint.h>
 
-static json_t *
-decode_snapshot_block(int fd, const uint8_t *b, int n) {
+#define SNAPSHOT_CYCLES 20
+
+json_t *
+decode_snapshot_block(const uint8_t *b, int n, int exp5, bool compact) {
   json_t *o = json_object();
 
   if (n < 32) {
@@ -19,10 +24,6 @@ decode_snapshot_block(int fd, const uint8_t *b, int n) {
     return o;
   }
 
-  int exp5 = 0;
-
-  pmbus_get_vout_mode_exp(fd, &exp5);
-
   json_object_set_new(o, "vin_old_V", json_real(pmbus_lin11_to_double(le16(&b[0]))));
   json_object_set_new(o, "vout_old_V", json_real(pmbus_lin16u_to_double(le16(&b[2]), exp5)));
   json_object_set_new(o, "iout_old_A", json_real(pmbus_lin11_to_double(le16(&b[4]))));
@@ -35,20 +36,220 @@ decode_snapshot_block(int fd, const uint8_t *b, int n) {
   json_object_set_new(o, "time_in_operation_s", json_integer(le16(&b[18])));
   json_object_set_new(o, "status_word", json_integer(le16(&b[20])));
   json_object_set_new(o, "status_byte", json_integer(b[22]));
-  json_object_set_new(o, "status_vout", decode_status_vout(b[23]));
-  json_object_set_new(o, "status_iout", decode_status_iout(b[24]));
-  json_object_set_new(o, "status_vin", decode_status_input(b[25]));
-  json_object_set_new(o, "status_temperature", decode_status_temperature(b[26]));
-  json_object_set_new(o, "status_cml", decode_status_cml(b[27]));
+  if (compact) {
+    json_object_set_new(o, "status_vout", json_string(status_flags(SREG_VOUT, b[23])));
+    json_object_set_new(o, "status_iout", json_string(status_flags(SREG_IOUT, b[24])));
+    json_object_set_new(o, "status_vin", json_string(status_flags(SREG_INPUT, b[25])));
+    json_object_set_new(o, "status_temperature", json_string(status_flags(SREG_TEMPERATURE, b[26])));
+    json_object_set_new(o, "status_cml", json_string(status_flags(SREG_CML, b[27])));
+  } else {
+    json_object_set_new(o, "status_vout", decode_status_vout(b[23]));
+    json_object_set_new(o, "status_iout", decode_status_iout(b[24]));
+    json_object_set_new(o, "status_vin", decode_status_input(b[25]));
+    json_object_set_new(o, "status_temperature", decode_status_temperature(b[26]));
+    json_object_set_new(o, "status_cml", decode_status_cml(b[27]));
+  }
   json_object_set_new(o, "snapshot_cycles", json_integer(le32(&b[28])));
 
   return o;
 }
 
+/* Short or failed blocks carry no counter and sort last. */
+static uint32_t
+snapshot_key(const struct snapshot_rec *r) {
+  return r->n >= 32 ? le32(&r->blk[28]) : UINT32_MAX;
+}
+
+static int
+snapshot_cmp(const void *a, const void *b) {
+  uint32_t ka = snapshot_key(a), kb = snapshot_key(b);
+
+  return (ka > kb) - (ka < kb);
+}
+
+static json_t *
+snapshot_json(const struct snapshot_rec *r, bool decode, int exp5, bool compact) {
+  json_t *o = json_object();
+
+  if (r->cycle >= 0)
+    json_object_set_new(o, "cycle", json_integer(r->cycle));
+  if (r->n < 0) {
+    json_object_set_new(o, "error", json_string("read failed"));
+    return o;
+  }
+  json_object_set_new(o, "len", json_integer(r->n));
+  json_add_hex_ascii(o, "hex", r->blk, (size_t) r->n);
+
+  if (decode && r->n >= 32)
+    json_object_set_new(o, "decoded", decode_snapshot_block(r->blk, r->n, exp5, compact));
+
+  return o;
+}
+
+void
+snapshot_fetch(int fd, int cycle, struct snapshot_rec *r) {
+  r->cycle = cycle;
+  r->n = -1;
+  if (pmbus_wr_byte(fd, MFR_SNAPSHOT_CYCLES_SELECT, (uint8_t) cycle) < 0)
+    return;
+  r->n = pmbus_rd_block(fd, MFR_GET_SNAPSHOT, r->blk, sizeof r->blk);
+}
+
+/*
+ * The select sticks: after a walk over older cycles, point it back at cycle 0 so a plain
+ * "snapshot" (or trigger) reads the newest record, not the last one walked.
+ */
+static void
+snapshot_reselect(int fd) {
+  if (pmbus_wr_byte(fd, MFR_SNAPSHOT_CYCLES_SELECT, 0) < 0)
+    perror("MFR_SNAPSHOT_CYCLES_SELECT");
+}
+
+static void
+snapshot_print(struct snapshot_rec *rec, int count, bool decode, int exp5, bool compact, int pretty) {
+  qsort(rec, (size_t) count, sizeof rec[0], snapshot_cmp);
+
+  json_t *a = json_array();
+  for (int c = 0; c < count; c++)
+    json_array_append_new(a, snapshot_json(&rec[c], decode, exp5, compact));
+
+  json_print_or_pretty(a, pretty);
+}
+
+/*
+ * All cycles in one session: each select is followed back-to-back by its block
+ * read, and nothing is decoded until the bus work is done, so the device sees
+ * 20 tight select/read pairs instead of 20 full command invocations.
+ */
+static int
+snapshot_all(int fd, bool decode, int exp5, bool compact, int pretty) {
+  struct snapshot_rec rec[SNAPSHOT_CYCLES];
+  int ok = 0;
+
+  for (int c = 0; c < SNAPSHOT_CYCLES; c++) {
+    snapshot_fetch(fd, c, &rec[c]);
+    if (rec[c].n >= 0)
+      ok++;
+  }
+
+  if (!ok) {
+    perror("MFR_GET_SNAPSHOT");
+    return 1;
+  }
+  snapshot_reselect(fd);
+
+  snapshot_print(rec, SNAPSHOT_CYCLES, decode, exp5, compact, pretty);
+
+  return 0;
+}
+
+/*
+ * --since-last state (see util_state.h): the newest (snapshot_cycles,
+ * time_in_operation_s) already reported.
+ */
+struct snapshot_mark {
+  uint32_t cycles;
+  uint32_t time_s;
+};
+
+static void
+snapshot_mark_load(const char *path, struct snapshot_mark *m) {
+  json_t *o = state_load(path);
+
+  m->cycles = 0;
+  m->time_s = 0;
+  if (!o)
+    return;
+  m->cycles = (uint32_t) json_integer_value(json_object_get(o, "snapshot_cycles"));
+  m->time_s = (uint32_t) json_integer_value(json_object_get(o, "time_in_operation_s"));
+  json_decref(o);
+}
+
+static int
+snapshot_mark_save(const char *path, const struct snapshot_mark *m) {
+  json_t *o = json_object();
+
+  json_object_set_new(o, "snapshot_cycles", json_integer(m->cycles));
+  json_object_set_new(o, "time_in_operation_s", json_integer(m->time_s));
+
+  int rc = state_save(path, o);
+  json_decref(o);
+
+  return rc;
+}
+
+static bool
+snapshot_is_new(const struct snapshot_rec *r, const struct snapshot_mark *m) {
+  if (r->n < 32)
+    return false;
+
+  uint32_t cycles = le32(&r->blk[28]);
+  uint32_t time_s = le16(&r->blk[18]);
+
+  return cycles > m->cycles || (cycles == m->cycles && time_s > m->time_s);
+}
+
+/*
+ * Cycle 0 holds the newest record: if it is already known nothing else is
+ * read. Otherwise older cycles are walked only until the first known one.
+ */
+static int
+snapshot_since_last(int fd, const char *state, bool decode, int exp5, bool compact, int pretty) {
+  char path[STATE_PATH_LEN];
+
+  if (state)
+    snprintf(path, sizeof path, "%s", state);
+  else if (state_path(fd, "snapshot", path, sizeof path) < 0)
+    return 1;
+
+  struct snapshot_mark last, next;
+  struct snapshot_rec rec[SNAPSHOT_CYCLES];
+  int count = 0;
+
+  snapshot_mark_load(path, &last);
+  next = last;
+
+  int c;
+
+  for (c = 0; c < SNAPSHOT_CYCLES; c++) {
+    snapshot_fetch(fd, c, &rec[count]);
+    if (rec[count].n < 0) {
+      if (c == 0) {
+        perror("MFR_GET_SNAPSHOT");
+        return 1;
+      }
+      continue;
+    }
+    if (!snapshot_is_new(&rec[count], &last))
+      break;
+
+    uint32_t cycles = le32(&rec[count].blk[28]);
+    uint32_t time_s = le16(&rec[count].blk[18]);
+    if (cycles > next.cycles || (cycles == next.cycles && time_s > next.time_s)) {
+      next.cycles = cycles;
+      next.time_s = time_s;
+    }
+    count++;
+  }
+  if (c > 0)
+    snapshot_reselect(fd);
+
+  snapshot_print(rec, count, decode, exp5, compact, pretty);
+
+  if (count && snapshot_mark_save(path, &next) < 0)
+    return 1;
+
+  return 0;
+}
+
 int
 cmd_snapshot(int fd, int argc, char * const *argv, int pretty) {
   int cycle = -1;
   bool decode = false;
+  bool compact = false;
+  bool all = false;
+  bool since_last = false;
+  const char *state = NULL;
 
   /* TODO: switch to getopt_long() */
   for (int i = 0; i < argc; i++) {
@@ -56,10 +257,34 @@ cmd_snapshot(int fd, int argc, char * const *argv, int pretty) {
       cycle = atoi(argv[++i]);
     else if (!strcmp(argv[i], "--decode"))
       decode = true;
+    else if (!strcmp(argv[i], "--compact"))
+      compact = true;
+    else if (!strcmp(argv[i], "--all"))
+      all = true;
+    else if (!strcmp(argv[i], "--since-last"))
+      since_last = true;
+    else if (!strcmp(argv[i], "--state") && i + 1 < argc)
+      state = argv[++i];
+  }
+
+  if ((all ? 1 : 0) + (since_last ? 1 : 0) + (cycle >= 0 ? 1 : 0) > 1) {
+    fprintf(stderr, "--all, --since-last and --cycle are exclusive\n");
+    return 2;
   }
 
+  int exp5 = 0;
+
+  if (decode)
+    pmbus_get_vout_mode_exp(fd, &exp5);
+
+  if (all)
+    return snapshot_all(fd, decode, exp5, compact, pretty);
+
+  if (since_last)
+    return snapshot_since_last(fd, state, decode, exp5, compact, pretty);
+
   if (cycle >= 0) {
-    if (cycle > 19) {
+    if (cycle >= SNAPSHOT_CYCLES) {
       fprintf(stderr, "--cycle 0..19\n");
       return 2;
     }
@@ -69,22 +294,15 @@ cmd_snapshot(int fd, int argc, char * const *argv, int pretty) {
     }
   }
 
-  uint8_t blk[64];
-  int n = pmbus_rd_block(fd, MFR_GET_SNAPSHOT, blk, sizeof blk);
-  if (n < 0) {
+  struct snapshot_rec r = { .cycle = -1 };
+
+  r.n = pmbus_rd_block(fd, MFR_GET_SNAPSHOT, r.blk, sizeof r.blk);
+  if (r.n < 0) {
     perror("MFR_GET_SNAPSHOT");
     return 1;
   }
 
-  json_t *o = json_object();
-  json_object_set_new(o, "len", json_integer(n));
-  json_add_hex_ascii(o, "hex", blk, (size_t)n);
-
-  if (decode && n >= 32) {
-    json_object_set_new(o, "decoded", decode_snapshot_block(fd, blk, n));
-  }
-
-  json_print_or_pretty(o, pretty);
+  json_print_or_pretty(snapshot_json(&r, decode, exp5, compact), pretty);
 
   return 0;
 }
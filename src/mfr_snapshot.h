@@ -3,5 +3,19 @@
 #pragma once
 
 #include <jansson.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/* One MFR_GET_SNAPSHOT block (>= 32 bytes); compact decodes status bytes as flag strings. */
+json_t *decode_snapshot_block(const uint8_t *b, int n, int exp5, bool compact);
+
+struct snapshot_rec {
+  int cycle;
+  int n;                        /* block length, <0 if the select or the read failed */
+  uint8_t blk[64];
+};
+
+/* MFR_SNAPSHOT_CYCLES_SELECT = cycle, then MFR_GET_SNAPSHOT right after it */
+void snapshot_fetch(int fd, int cycle, struct snapshot_rec *r);
 
 int cmd_snapshot(int fd, int argc, char * const * argv, int pretty);
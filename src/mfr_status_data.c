@@ -1,26 +1,209 @@
 /* SPDX-License-Identifier: AGPL-3.0-or-later */
+
 #include "pmbus_io.h"
+#include "decoders.h"
 #include "util_json.h"
 
 #include <jansson.h>
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdbool.h>
+#include <time.h>
+
+/*
+ * MFR_GET_STATUS_DATA layout, assumed (no document in the tree describes it): the
+ * standard status registers latched by the device, STATUS_WORD first, then the status
+ * bytes, followed by manufacturer bytes that are reported as hex.
+ */
+enum sd_type : uint8_t {
+  SD_STATUS,                    /* one status byte, decoded through status_flags() */
+  SD_WORD,                      /* STATUS_WORD, decoded through status_word_flags() */
+  SD_U8,
+};
+
+struct sd_field {
+  const char *name;
+  uint8_t off;
+  enum sd_type type;
+  enum status_reg reg;          /* SD_STATUS only */
+};
+
+static const struct sd_field sd_fields[] = {
+  { .name = "status_word",        .off = 0, .type = SD_WORD },
+  { .name = "status_vout",        .off = 2, .type = SD_STATUS, .reg = SREG_VOUT },
+  { .name = "status_iout",        .off = 3, .type = SD_STATUS, .reg = SREG_IOUT },
+  { .name = "status_input",       .off = 4, .type = SD_STATUS, .reg = SREG_INPUT },
+  { .name = "status_temperature", .off = 5, .type = SD_STATUS, .reg = SREG_TEMPERATURE },
+  { .name = "status_cml",         .off = 6, .type = SD_STATUS, .reg = SREG_CML },
+  { .name = "status_other",       .off = 7, .type = SD_U8 },
+  { .name = "status_mfr",         .off = 8, .type = SD_U8 },
+};
+
+#define N_SD_FIELDS (sizeof sd_fields / sizeof sd_fields[0])
+#define SD_WIDTH(f) ((f)->type == SD_WORD ? 2 : 1)
+/* the manufacturer bytes start right after the last field */
+#define SD_FIELDS_LEN (sd_fields[N_SD_FIELDS - 1].off + SD_WIDTH(&sd_fields[N_SD_FIELDS - 1]))
+#define SD_DEFAULT_INTERVAL_MS 1000
 
 static void
 usage_status_data(void) {
   fprintf(stderr,
-"status-data\n"
+"status-data [--decode]\n"
+"status-data watch [--interval MS] [--count N]\n"
   );
 }
 
+static json_t *
+sd_field_json(const struct sd_field *f, const uint8_t *b) {
+  char w[STATUS_WORD_FLAGS_MAX];
+
+  switch (f->type) {
+  case SD_WORD:
+    status_word_flags(le16(&b[f->off]), w, sizeof w);
+    return json_string(w);
+  case SD_STATUS:
+    return json_string(status_flags(f->reg, b[f->off]));
+  case SD_U8:
+  default:
+    return json_integer(b[f->off]);
+  }
+}
+
+static json_t *
+decode_status_data(const uint8_t *b, int n) {
+  json_t *o = json_object();
+
+  if (n < SD_FIELDS_LEN) {
+    json_object_set_new(o, "error", json_string("short block"));
+    return o;
+  }
+
+  for (size_t i = 0; i < N_SD_FIELDS; i++)
+    json_object_set_new(o, sd_fields[i].name, sd_field_json(&sd_fields[i], b));
+  json_add_hex_ascii(o, "mfr_data", &b[SD_FIELDS_LEN], (size_t) (n - SD_FIELDS_LEN));
+
+  return o;
+}
+
+/* FNV-1a: cheap enough to run on every poll, so unchanged blocks are never decoded. */
+static uint64_t
+sd_hash(const uint8_t *b, int n) {
+  uint64_t h = 0xcbf29ce484222325ULL;
+
+  for (int i = 0; i < n; i++) {
+    h ^= b[i];
+    h *= 0x100000001b3ULL;
+  }
+
+  return h;
+}
+
+static json_t *
+sd_diff(const uint8_t *prev, int pn, const uint8_t *cur, int cn) {
+  json_t *d = json_object();
+
+  if (pn < SD_FIELDS_LEN || cn < SD_FIELDS_LEN || pn != cn) {
+    json_object_set_new(d, "len", json_integer(cn));
+    return d;
+  }
+
+  for (size_t i = 0; i < N_SD_FIELDS; i++) {
+    const struct sd_field *f = &sd_fields[i];
+    size_t w = SD_WIDTH(f);
+
+    if (!memcmp(&prev[f->off], &cur[f->off], w))
+      continue;
+
+    json_t *c = json_object();
+    json_object_set_new(c, "from", sd_field_json(f, prev));
+    json_object_set_new(c, "to", sd_field_json(f, cur));
+    json_object_set_new(d, f->name, c);
+  }
+
+  if (memcmp(&prev[SD_FIELDS_LEN], &cur[SD_FIELDS_LEN], (size_t) (cn - SD_FIELDS_LEN))) {
+    json_t *c = json_object();
+    json_add_hex_ascii(c, "from", &prev[SD_FIELDS_LEN], (size_t) (pn - SD_FIELDS_LEN));
+    json_add_hex_ascii(c, "to", &cur[SD_FIELDS_LEN], (size_t) (cn - SD_FIELDS_LEN));
+    json_object_set_new(d, "mfr_data", c);
+  }
+
+  return d;
+}
+
+/*
+ * One JSON document per change: the first poll prints the full decode, later
+ * polls print only when the block hash moves, with from/to of the changed fields.
+ */
+static int
+status_data_watch(int fd, unsigned interval_ms, long count, int pretty) {
+  uint8_t buf[2][255];
+  int len[2] = { -1, -1 };
+  uint64_t hash = 0;
+  int cur = 0;
+
+  for (long i = 0; count <= 0 || i < count; i++) {
+    if (i)
+      pmbus_sleep_ms(interval_ms);
+
+    int n = pmbus_rd_block(fd, MFR_GET_STATUS_DATA, buf[cur], (int) sizeof buf[cur]);
+    if (n < 0) {
+      perror("MFR_GET_STATUS_DATA");
+      continue;
+    }
+
+    uint64_t h = sd_hash(buf[cur], n);
+    int prev = cur ^ 1;
+    if (len[prev] == n && h == hash)
+      continue;
+
+    json_t *o = json_object();
+    json_object_set_new(o, "time", json_integer((json_int_t) time(NULL)));
+    if (len[prev] < 0)
+      json_object_set_new(o, "decoded", decode_status_data(buf[cur], n));
+    else
+      json_object_set_new(o, "changed", sd_diff(buf[prev], len[prev], buf[cur], n));
+    json_add_len_and_hex(o, "hex", buf[cur], (size_t) n);
+    json_print_or_pretty(o, pretty);
+    fflush(stdout);
+
+    hash = h;
+    len[cur] = n;
+    cur = prev;
+  }
+
+  return 0;
+}
+
 int
 cmd_status_data(int fd, int argc, char *const *argv, int pretty) {
-  (void) argv;
+  bool decode = false;
+
+  if (argc > 0 && !strcmp(argv[0], "watch")) {
+    unsigned interval_ms = SD_DEFAULT_INTERVAL_MS;
+    long count = 0;
+
+    for (int i = 1; i < argc; i++) {
+      if (!strcmp(argv[i], "--interval") && i + 1 < argc)
+        interval_ms = (unsigned) strtoul(argv[++i], NULL, 0);
+      else if (!strcmp(argv[i], "--count") && i + 1 < argc)
+        count = strtol(argv[++i], NULL, 0);
+      else {
+        usage_status_data();
+        return 2;
+      }
+    }
+
+    return status_data_watch(fd, interval_ms, count, pretty);
+  }
 
-  if (argc > 0) {
-    usage_status_data();
-    return 2;
+  for (int i = 0; i < argc; i++) {
+    if (!strcmp(argv[i], "--decode"))
+      decode = true;
+    else {
+      usage_status_data();
+      return 2;
+    }
   }
 
   uint8_t buf[255];
@@ -32,6 +215,8 @@ cmd_status_data(int fd, int argc, char *const *argv, int pretty) {
 
   json_t *o = json_object();
   json_add_len_and_hex(o, "hex", buf, (size_t)n);
+  if (decode)
+    json_object_set_new(o, "decoded", decode_status_data(buf, n));
 
   json_print_or_pretty(o, pretty);
 
@@ -1,16 +1,57 @@
 /* SPDX-License-Identifier: AGPL-3.0-or-later */
+#define _POSIX_C_SOURCE 200809L
 
 #include "pmbus_io.h"
 #include "util_lin.h"
 
 #include <linux/i2c-dev.h>
+#include <linux/i2c.h>
 #include <i2c/smbus.h>
 #include <sys/ioctl.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <stdlib.h>
+#include <string.h>
 #include <errno.h>
 #include <math.h>
+#include <time.h>
+
+/*
+ * Per-fd transfer counters. Each fd is only ever used by one thread at a time (see config
+ * verify, exporter), so plain increments are enough; fds past the table are not counted.
+ */
+static struct pmbus_io_stats io_stats[PMBUS_IO_STATS_FDS];
+
+/* I2C_RDWR messages carry the address themselves; 0: unknown or no plain-I2C adapter */
+static uint8_t io_rdwr_addr[PMBUS_IO_STATS_FDS];
+
+static int
+io_count(int fd, int rc) {
+  if (fd < 0 || fd >= PMBUS_IO_STATS_FDS)
+    return rc;
+
+  struct pmbus_io_stats *st = &io_stats[fd];
+  st->tx++;
+  if (rc < 0) {
+    int e = errno;
+
+    if (e == ENXIO || e == EREMOTEIO)
+      st->nack++;
+    else if (e == ETIMEDOUT || e == EAGAIN)
+      st->timeout++;
+    else
+      st->other++;
+  }
+
+  return rc;
+}
+
+void
+pmbus_io_stats(int fd, struct pmbus_io_stats *out) {
+  static const struct pmbus_io_stats none;
+
+  *out = fd >= 0 && fd < PMBUS_IO_STATS_FDS ? io_stats[fd] : none;
+}
 
 int
 pmbus_open(const char *dev, int addr7) {
@@ -24,6 +65,13 @@ pmbus_open(const char *dev, int addr7) {
     errno = e;
     return -1;
   }
+  if (fd < PMBUS_IO_STATS_FDS) {
+    unsigned long funcs = 0;
+
+    io_stats[fd] = (struct pmbus_io_stats) { 0 };
+    bool i2c = ioctl(fd, I2C_FUNCS, &funcs) == 0 && (funcs & I2C_FUNC_I2C);
+    io_rdwr_addr[fd] = i2c ? (uint8_t) addr7 : 0;
+  }
 
   return fd;
 }
@@ -36,40 +84,100 @@ pmbus_close(int fd) {
 
 int
 pmbus_rd_byte(int fd, uint8_t cmd) {
-  return i2c_smbus_read_byte_data(fd, cmd);
+  return io_count(fd, i2c_smbus_read_byte_data(fd, cmd));
 }
 
 int
 pmbus_rd_word(int fd, uint8_t cmd) {
-  return i2c_smbus_read_word_data(fd, cmd);
+  return io_count(fd, i2c_smbus_read_word_data(fd, cmd));
 }
 
 int
 pmbus_rd_block(int fd, uint8_t cmd, uint8_t *buf, int max) {
-  int n = i2c_smbus_read_block_data(fd, cmd, buf);
+  int n = io_count(fd, i2c_smbus_read_block_data(fd, cmd, buf));
   if (n > max)
     n = max;
   return n;
 }
 
+int
+pmbus_ops_burst(int fd, struct pmbus_op *x, int n) {
+  struct i2c_msg msgs[PMBUS_OPS_MSGS_MAX];
+  uint8_t data[PMBUS_OPS_MSGS_MAX][2];
+  uint32_t m = 0;
+
+  if (n < 1 || n > PMBUS_OPS_MSGS_MAX) {
+    errno = EINVAL;
+    return -1;
+  }
+  if (fd < 0 || fd >= PMBUS_IO_STATS_FDS || !io_rdwr_addr[fd]) {
+    errno = EOPNOTSUPP;
+    return -1;
+  }
+
+  /*
+   * SMBus protocols as plain I2C: the command byte alone is a send byte; a read writes the
+   * command, repeated START, then reads 1 or 2 bytes LSB first
+   */
+  for (int i = 0; i < n; i++) {
+    if (x[i].len > 2 || m + (x[i].len ? 2 : 1) > PMBUS_OPS_MSGS_MAX) {
+      errno = EINVAL;
+      return -1;
+    }
+    msgs[m++] = (struct i2c_msg) { .addr = io_rdwr_addr[fd], .len = 1, .buf = &x[i].cmd };
+    if (x[i].len)
+      msgs[m++] = (struct i2c_msg) {
+        .addr = io_rdwr_addr[fd], .flags = I2C_M_RD, .len = x[i].len, .buf = data[i],
+      };
+  }
+
+  struct i2c_rdwr_ioctl_data set = { .msgs = msgs, .nmsgs = m };
+  if (io_count(fd, ioctl(fd, I2C_RDWR, &set)) < 0)
+    return -1;
+  io_stats[fd].tx += (uint64_t) n - 1;      /* one per command, like the SMBus path */
+
+  for (int i = 0; i < n; i++)
+    x[i].val = x[i].len == 2 ? le16(data[i]) : x[i].len ? data[i][0] : 0;
+
+  return 0;
+}
+
+int
+pmbus_rd_words_burst(int fd, const uint8_t *cmds, int n, uint16_t *out) {
+  struct pmbus_op x[PMBUS_BURST_MAX];
+
+  if (n < 1 || n > PMBUS_BURST_MAX) {
+    errno = EINVAL;
+    return -1;
+  }
+  for (int i = 0; i < n; i++)
+    x[i] = (struct pmbus_op) { .cmd = cmds[i], .len = 2 };
+  if (pmbus_ops_burst(fd, x, n) < 0)
+    return -1;
+  for (int i = 0; i < n; i++)
+    out[i] = (uint16_t) x[i].val;
+
+  return 0;
+}
+
 int
 pmbus_wr_byte(int fd, uint8_t cmd, uint8_t val) {
-  return i2c_smbus_write_byte_data(fd, cmd, val);
+  return io_count(fd, i2c_smbus_write_byte_data(fd, cmd, val));
 }
 
 int
 pmbus_wr_word(int fd, uint8_t cmd, uint16_t val) {
-  return i2c_smbus_write_word_data(fd, cmd, val);
+  return io_count(fd, i2c_smbus_write_word_data(fd, cmd, val));
 }
 
 int
 pmbus_wr_block(int fd, uint8_t cmd, const uint8_t *buf, int len) {
-  return i2c_smbus_write_block_data(fd, cmd, len, buf);
+  return io_count(fd, i2c_smbus_write_block_data(fd, cmd, len, buf));
 }
 
 int
 pmbus_send_byte(int fd, uint8_t cmd) {
-  return i2c_smbus_write_byte(fd, cmd);
+  return io_count(fd, i2c_smbus_write_byte(fd, cmd));
 }
 
 /* see PMBus-Specification-Rev-1-3-1-Part-II-20150313.pdf, section 8.3 */
@@ -94,15 +202,8 @@ pmbus_get_vout_mode_exp(int fd, int *exp_out) {
 
 double
 pmbus_lin11_to_double(uint16_t raw) {
-  int16_t s = (int16_t) raw;
-  int8_t exp = (int8_t) (s >> 11);
-  int16_t mant = s & 0x7FF;
-
-  if (mant & 0x400)
-    mant |= ~0x7FF;
-
   /* value = mantissa * 2^exp */
-  return ldexp((double)mant, exp);
+  return lin11_to_units(raw);
 }
 
 double
@@ -110,6 +211,16 @@ pmbus_lin16u_to_double(uint16_t raw, int exp5) {
   return lin16u_to_units(raw, exp5);
 }
 
+void
+pmbus_lin11_decode_n(const uint16_t *raw, double *out, size_t n) {
+  lin11_decode_n(raw, out, n);
+}
+
+void
+pmbus_lin16u_decode_n(const uint16_t *raw, double *out, size_t n, int exp5) {
+  lin16u_decode_n(raw, out, n, exp5);
+}
+
 uint16_t
 le16(const uint8_t *p) {
   return (uint16_t) p[0]
@@ -142,3 +253,72 @@ parse_u16(const char *s, uint16_t *out) {
 
   return 0;
 }
+
+int
+pmbus_parse_dev(char *s, const char **bus, int *addr7) {
+  char *c = strrchr(s, ':');
+  char *end = NULL;
+
+  if (!c)
+    return -1;
+  long a = strtol(c + 1, &end, 0);
+  if (end == c + 1 || *end || a < 0x03 || a > 0x77)
+    return -1;
+
+  *c = '\0';
+  *bus = s;
+  *addr7 = (int) a;
+
+  return 0;
+}
+
+int64_t
+pmbus_now_us(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return (int64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+int64_t
+pmbus_wall_ms(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_REALTIME, &ts);
+
+  return (int64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+void
+pmbus_sleep_ms(unsigned ms) {
+  struct timespec ts = { .tv_sec = ms / 1000, .tv_nsec = (long) (ms % 1000) * 1000000L };
+
+  while (nanosleep(&ts, &ts) < 0 && errno == EINTR)
+    ;
+}
+
+void
+pmbus_sleep_until_us(int64_t t_us) {
+  struct timespec ts = { .tv_sec = t_us / 1000000, .tv_nsec = (long) (t_us % 1000000) * 1000L };
+
+  while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+    ;
+}
+
+int64_t
+pmbus_wait_ack(int fd, unsigned timeout_ms) {
+  int64_t t0 = pmbus_now_us();
+  int64_t deadline = t0 + (int64_t) timeout_ms * 1000;
+  unsigned backoff = 1;
+
+  for (;;) {
+    if (pmbus_rd_byte(fd, PMBUS_PMBUS_REVISION) >= 0)
+      return pmbus_now_us() - t0;
+    if (pmbus_now_us() >= deadline)
+      return -1;
+    pmbus_sleep_ms(backoff);
+    if (backoff < 16)
+      backoff <<= 1;
+  }
+}
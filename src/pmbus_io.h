@@ -2,6 +2,7 @@
 
 #pragma once
 
+#include <stddef.h>
 #include <stdint.h>
 #include <stdbool.h>
 
@@ -21,6 +22,8 @@
  *   Notable exceptions: READ_DUTY_CYCLE (0x94) and READ_FREQUENCY (0x95) are documented
  *   on BMR685; BMR456 may not expose them.
  *
+ *   Per-opcode transfer type, format, unit and model support: see pmbus_regs.h.
+ *
  * vendor-specific (Flex “MFR_*” commands):
  *   0xC4, 0xC8, 0xD0–0xD3, 0xD5, 0xD7–0xDD, 0xDE, 0xE0–0xE3, 0xE7–0xE8, 0xEB, 0xEE,
  *   0xF1, 0xF4, 0xF8–0xF9, 0xFD–0xFE
@@ -170,11 +173,46 @@ enum PMBus_opcodes : uint8_t {
   MFR_RESTART                     = 0xFE,
 };
 
+/* transfer counters per fd, reset by pmbus_open() */
+struct pmbus_io_stats {
+  uint64_t tx;
+  uint64_t nack;                /* ENXIO / EREMOTEIO: device did not acknowledge */
+  uint64_t timeout;             /* ETIMEDOUT / EAGAIN: bus stuck or arbitration lost */
+  uint64_t other;
+};
+
+#define PMBUS_IO_STATS_FDS 1024
+
+void pmbus_io_stats(int fd, struct pmbus_io_stats *out);
+
 int pmbus_open(const char *dev, int addr7);
 void pmbus_close(int fd);
 int pmbus_rd_byte(int fd, uint8_t cmd);
 int pmbus_rd_word(int fd, uint8_t cmd);
 int pmbus_rd_block(int fd, uint8_t cmd, uint8_t * buf, int max);
+
+/*
+ * Read n word registers in one I2C_RDWR ioctl: write/read message pairs joined by repeated
+ * STARTs and a single STOP, so no other master or scheduler gap can split the set.
+ * All or nothing: one NACK fails the burst. -1 with EOPNOTSUPP on SMBus-only adapters.
+ */
+#define PMBUS_BURST_MAX 21              /* I2C_RDWR_IOCTL_MAX_MSGS / 2 */
+int pmbus_rd_words_burst(int fd, const uint8_t *cmds, int n, uint16_t *out);
+
+/*
+ * Mixed group in one I2C_RDWR ioctl, same rules: len 0 is a send byte (one message), len 1
+ * or 2 a byte or word read (two messages) whose value lands in val. At most
+ * PMBUS_OPS_MSGS_MAX messages in all.
+ */
+struct pmbus_op {
+  uint8_t cmd;
+  uint8_t len;
+  int val;
+};
+
+#define PMBUS_OPS_MSGS_MAX 42          /* I2C_RDWR_IOCTL_MAX_MSGS */
+int pmbus_ops_burst(int fd, struct pmbus_op *x, int n);
+
 int pmbus_wr_byte(int fd, uint8_t cmd, uint8_t val);
 int pmbus_wr_word(int fd, uint8_t cmd, uint16_t val);
 int pmbus_wr_block(int fd, uint8_t cmd, const uint8_t * buf, int len);
@@ -184,8 +222,28 @@ int pmbus_send_byte(int fd, uint8_t cmd);
 int pmbus_get_vout_mode_exp(int fd, int *exp_out);
 double pmbus_lin11_to_double(uint16_t raw);
 double pmbus_lin16u_to_double(uint16_t raw, int exp5);
+/* bulk variants of the above, for long runs of raw words */
+void pmbus_lin11_decode_n(const uint16_t *raw, double *out, size_t n);
+void pmbus_lin16u_decode_n(const uint16_t *raw, double *out, size_t n, int exp5);
 
 uint16_t le16(const uint8_t * p);
 uint32_t le32(const uint8_t * p);
 
 int parse_u16(const char *s, uint16_t *out);
+/* "BUS:ADDR", e.g. /dev/i2c-1:0x40; splits s in place, *bus points into it */
+int pmbus_parse_dev(char *s, const char **bus, int *addr7);
+
+/* CLOCK_MONOTONIC in microseconds */
+int64_t pmbus_now_us(void);
+/* CLOCK_REALTIME in milliseconds since the epoch, for timestamps that leave the process */
+int64_t pmbus_wall_ms(void);
+void pmbus_sleep_ms(unsigned ms);
+/* sleep to an absolute pmbus_now_us() deadline: no drift across repeated waits */
+void pmbus_sleep_until_us(int64_t t_us);
+
+/*
+ * Poll PMBUS_REVISION (one byte, no side effects) until the device ACKs again, e.g. after an
+ * NVM store or a restart. Backs off from 1 ms to 16 ms between tries.
+ * Returns the wait in microseconds, <0 if it still NACKs after timeout_ms.
+ */
+int64_t pmbus_wait_ack(int fd, unsigned timeout_ms);
@@ -0,0 +1,137 @@
+/* SPDX-License-Identifier: AGPL-3.0-or-later */
+
+#include "pmbus_regs.h"
+#include "util_lin.h"
+
+#include <string.h>
+
+#define REG_ENTRY(op, nm, xf, fm, un, md, fl) \
+  [op] = { .name = (nm), .xfer = (xf), .fmt = (fm), .unit = (un), .models = (md), .flags = (fl) },
+
+const struct pmbus_reg pmbus_regs[256] = {
+  PMBUS_REGS(REG_ENTRY)
+};
+
+const char *
+pmbus_unit_name(enum pmbus_unit u) {
+  switch (u) {
+  case UNIT_V:
+    return "V";
+  case UNIT_A:
+    return "A";
+  case UNIT_C:
+    return "C";
+  case UNIT_PCT:
+    return "pct";
+  case UNIT_KHZ:
+    return "kHz";
+  case UNIT_MS:
+    return "ms";
+  case UNIT_MV_US:
+    return "mV/us";
+  case UNIT_MOHM:
+    return "mOhm";
+  case UNIT_S_POW2:
+    return "2^n seconds";
+  case UNIT_MS10:
+    return "10ms";
+  case UNIT_NONE:
+  default:
+    return "";
+  }
+}
+
+unsigned
+pmbus_model(int fd) {
+  uint8_t b[64];
+  int n = pmbus_rd_block(fd, MFR_MODEL, b, (int) sizeof b);
+
+  if (n < 6)
+    return MODEL_ALL;
+
+  if (!strncmp((char *) b, "BMR685", (size_t) 6))
+    return MODEL_BMR685;
+
+  if (!strncmp((char *) b, "BMR456", (size_t) 6))
+    return MODEL_BMR456;
+
+  return MODEL_ALL;
+}
+
+int
+pmbus_reg_rd(int fd, uint8_t cmd) {
+  const struct pmbus_reg *r = pmbus_reg(cmd);
+
+  if (!r)
+    return -1;
+
+  switch (r->xfer) {
+  case XFER_BYTE:
+    return pmbus_rd_byte(fd, cmd);
+  case XFER_WORD:
+    return pmbus_rd_word(fd, cmd);
+  case XFER_SEND:
+  case XFER_BLOCK:
+  default:
+    return -1;
+  }
+}
+
+int
+pmbus_reg_wr(int fd, uint8_t cmd, uint16_t val) {
+  const struct pmbus_reg *r = pmbus_reg(cmd);
+
+  if (!r)
+    return -1;
+
+  switch (r->xfer) {
+  case XFER_BYTE:
+    return pmbus_wr_byte(fd, cmd, (uint8_t) val);
+  case XFER_WORD:
+    return pmbus_wr_word(fd, cmd, val);
+  case XFER_SEND:
+  case XFER_BLOCK:
+  default:
+    return -1;
+  }
+}
+
+int
+pmbus_reg_by_name(const char *name) {
+  for (int c = 0; c < 256; c++)
+    if (pmbus_regs[c].name && !strcmp(pmbus_regs[c].name, name))
+      return c;
+
+  return -1;
+}
+
+double
+pmbus_reg_to_units(uint8_t cmd, uint16_t raw, int exp5) {
+  const struct pmbus_reg *r = pmbus_reg(cmd);
+
+  if (!r)
+    return (double) raw;
+
+  switch (r->fmt) {
+  case FMT_LIN11:
+    return lin11_to_units(raw);
+  case FMT_LIN16U:
+    return lin16u_to_units(raw, exp5);
+  default:
+    return (double) raw;
+  }
+}
+
+uint16_t
+pmbus_units_to_reg(uint8_t cmd, double v, int exp5) {
+  const struct pmbus_reg *r = pmbus_reg(cmd);
+
+  switch (r ? r->fmt : FMT_RAW) {
+  case FMT_LIN11:
+    return units_to_lin11(v);
+  case FMT_LIN16U:
+    return units_to_lin16u(v, exp5);
+  default:
+    return u16_round_sat_pos(v);
+  }
+}
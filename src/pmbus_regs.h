@@ -0,0 +1,242 @@
+/* SPDX-License-Identifier: AGPL-3.0-or-later */
+
+#pragma once
+
+#include "pmbus_io.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Register descriptor table, indexed by opcode.
+ *
+ * One line per command: transaction type, numeric format, unit, which models implement it and
+ * access/volatility flags. Commands use it to plan their reads instead of hard-coding the
+ * encoding, and to skip registers the detected model does not implement (no NACKed transfer).
+ *
+ * Formats follow what the tool already does: VOUT-family and VIN_ON/OFF/POWER_GOOD words are
+ * LIN16U scaled by VOUT_MODE, TON/TOFF words are plain milliseconds, vendor words of unknown
+ * layout are kept raw. Vendor sizes follow Flex AN302.
+ */
+
+enum pmbus_xfer : uint8_t {
+  XFER_SEND,                    /* send byte, no data */
+  XFER_BYTE,
+  XFER_WORD,
+  XFER_BLOCK,
+};
+
+enum pmbus_fmt : uint8_t {
+  FMT_RAW,                      /* opaque bits, shown as integer */
+  FMT_U16,                      /* plain integer in 'unit' */
+  FMT_LIN11,
+  FMT_LIN16U,                   /* exponent from VOUT_MODE */
+  FMT_RESPONSE,                 /* fault response byte, delay unit in 'unit' */
+  FMT_ASCII,                    /* block string */
+  FMT_BLOCK,                    /* opaque block */
+};
+
+enum pmbus_unit : uint8_t {
+  UNIT_NONE,
+  UNIT_V,
+  UNIT_A,
+  UNIT_C,
+  UNIT_PCT,
+  UNIT_KHZ,
+  UNIT_MS,
+  UNIT_MV_US,
+  UNIT_MOHM,
+  UNIT_S_POW2,                  /* response delay: 2^n seconds */
+  UNIT_MS10,                    /* response delay: 10 ms per LSB */
+};
+
+/* model support bits */
+#define MODEL_NONE   0x0u
+#define MODEL_BMR685 0x1u
+#define MODEL_BMR456 0x2u
+#define MODEL_ALL    (MODEL_BMR685 | MODEL_BMR456)
+
+/* access / volatility flags */
+#define REG_R        0x01u      /* readable */
+#define REG_W        0x02u      /* writable */
+#define REG_RW       (REG_R | REG_W)
+#define REG_VOLATILE 0x04u      /* changes without host writes (telemetry, status): never cache */
+#define REG_CMD      0x08u      /* action, not state (store/restore/clear/restart) */
+
+/* X(opcode, name, xfer, fmt, unit, models, flags) */
+#define PMBUS_REGS(X) \
+  X(PMBUS_OPERATION,              "OPERATION",              XFER_BYTE,  FMT_RAW,      UNIT_NONE,   MODEL_ALL,    REG_RW) \
+  X(PMBUS_ON_OFF_CONFIG,          "ON_OFF_CONFIG",          XFER_BYTE,  FMT_RAW,      UNIT_NONE,   MODEL_ALL,    REG_RW) \
+  X(PMBUS_CLEAR_FAULTS,           "CLEAR_FAULTS",           XFER_SEND,  FMT_RAW,      UNIT_NONE,   MODEL_ALL,    REG_CMD) \
+  X(PMBUS_WRITE_PROTECT,          "WRITE_PROTECT",          XFER_BYTE,  FMT_RAW,      UNIT_NONE,   MODEL_ALL,    REG_RW) \
+  X(PMBUS_STORE_DEFAULT_ALL,      "STORE_DEFAULT_ALL",      XFER_SEND,  FMT_RAW,      UNIT_NONE,   MODEL_ALL,    REG_CMD) \
+  X(PMBUS_RESTORE_DEFAULT_ALL,    "RESTORE_DEFAULT_ALL",    XFER_SEND,  FMT_RAW,      UNIT_NONE,   MODEL_ALL,    REG_CMD) \
+  X(PMBUS_STORE_USER_ALL,         "STORE_USER_ALL",         XFER_SEND,  FMT_RAW,      UNIT_NONE,   MODEL_ALL,    REG_CMD) \
+  X(PMBUS_RESTORE_USER_ALL,       "RESTORE_USER_ALL",       XFER_SEND,  FMT_RAW,      UNIT_NONE,   MODEL_ALL,    REG_CMD) \
+  X(PMBUS_STORE_USER_CODE,        "STORE_USER_CODE",        XFER_BYTE,  FMT_RAW,      UNIT_NONE,   MODEL_NONE,   REG_CMD) \
+  X(PMBUS_RESTORE_USER_CODE,      "RESTORE_USER_CODE",      XFER_BYTE,  FMT_RAW,      UNIT_NONE,   MODEL_NONE,   REG_CMD) \
+  X(PMBUS_CAPABILITY,             "CAPABILITY",             XFER_BYTE,  FMT_RAW,      UNIT_NONE,   MODEL_ALL,    REG_R) \
+  X(PMBUS_QUERY,                  "QUERY",                  XFER_BLOCK, FMT_BLOCK,    UNIT_NONE,   MODEL_NONE,   REG_R) \
+  X(PMBUS_SMBALERT_MASK,          "SMBALERT_MASK",          XFER_BYTE,  FMT_RAW,      UNIT_NONE,   MODEL_ALL,    REG_RW) \
+  X(PMBUS_VOUT_MODE,              "VOUT_MODE",              XFER_BYTE,  FMT_RAW,      UNIT_NONE,   MODEL_ALL,    REG_R) \
+  X(PMBUS_VOUT_COMMAND,           "VOUT_COMMAND",           XFER_WORD,  FMT_LIN16U,   UNIT_V,      MODEL_ALL,    REG_RW) \
+  X(PMBUS_VOUT_TRIM,              "VOUT_TRIM",              XFER_WORD,  FMT_RAW,      UNIT_NONE,   MODEL_ALL,    REG_RW) \
+  X(PMBUS_VOUT_CAL_OFFSET,        "VOUT_CAL_OFFSET",        XFER_WORD,  FMT_RAW,      UNIT_NONE,   MODEL_ALL,    REG_RW) \
+  X(PMBUS_VOUT_MAX,               "VOUT_MAX",               XFER_WORD,  FMT_LIN16U,   UNIT_V,      MODEL_ALL,    REG_RW) \
+  X(PMBUS_VOUT_MARGIN_HIGH,       "VOUT_MARGIN_HIGH",       XFER_WORD,  FMT_LIN16U,   UNIT_V,      MODEL_ALL,    REG_RW) \
+  X(PMBUS_VOUT_MARGIN_LOW,        "VOUT_MARGIN_LOW",        XFER_WORD,  FMT_LIN16U,   UNIT_V,      MODEL_ALL,    REG_RW) \
+  X(PMBUS_VOUT_TRANSITION_RATE,   "VOUT_TRANSITION_RATE",   XFER_WORD,  FMT_LIN11,    UNIT_MV_US,  MODEL_ALL,    REG_RW) \
+  X(PMBUS_VOUT_SCALE_LOOP,        "VOUT_SCALE_LOOP",        XFER_WORD,  FMT_LIN11,    UNIT_NONE,   MODEL_ALL,    REG_RW) \
+  X(PMBUS_VOUT_SCALE_MONITOR,     "VOUT_SCALE_MONITOR",     XFER_WORD,  FMT_LIN11,    UNIT_NONE,   MODEL_ALL,    REG_RW) \
+  X(PMBUS_MAX_DUTY,               "MAX_DUTY",               XFER_WORD,  FMT_LIN11,    UNIT_PCT,    MODEL_ALL,    REG_RW) \
+  X(PMBUS_FREQUENCY_SWITCH,       "FREQUENCY_SWITCH",       XFER_WORD,  FMT_RAW,      UNIT_NONE,   MODEL_ALL,    REG_RW) \
+  X(PMBUS_VIN_ON,                 "VIN_ON",                 XFER_WORD,  FMT_LIN16U,   UNIT_V,      MODEL_ALL,    REG_RW) \
+  X(PMBUS_VIN_OFF,                "VIN_OFF",                XFER_WORD,  FMT_LIN16U,   UNIT_V,      MODEL_ALL,    REG_RW) \
+  X(PMBUS_INTERLEAVE,             "INTERLEAVE",             XFER_BYTE,  FMT_RAW,      UNIT_NONE,   MODEL_ALL,    REG_RW) \
+  X(PMBUS_IOUT_CAL_GAIN,          "IOUT_CAL_GAIN",          XFER_WORD,  FMT_LIN11,    UNIT_MOHM,   MODEL_ALL,    REG_RW) \
+  X(PMBUS_IOUT_CAL_OFFSET,        "IOUT_CAL_OFFSET",        XFER_WORD,  FMT_LIN11,    UNIT_A,      MODEL_ALL,    REG_RW) \
+  X(PMBUS_VOUT_OV_FAULT_LIMIT,    "VOUT_OV_FAULT_LIMIT",    XFER_WORD,  FMT_LIN16U,   UNIT_V,      MODEL_ALL,    REG_RW) \
+  X(PMBUS_VOUT_OV_FAULT_RESPONSE, "VOUT_OV_FAULT_RESPONSE", XFER_BYTE,  FMT_RESPONSE, UNIT_MS10,   MODEL_ALL,    REG_RW) \
+  X(PMBUS_VOUT_OV_WARN_LIMIT,     "VOUT_OV_WARN_LIMIT",     XFER_WORD,  FMT_LIN16U,   UNIT_V,      MODEL_ALL,    REG_RW) \
+  X(PMBUS_VOUT_UV_WARN_LIMIT,     "VOUT_UV_WARN_LIMIT",     XFER_WORD,  FMT_LIN16U,   UNIT_V,      MODEL_ALL,    REG_RW) \
+  X(PMBUS_VOUT_UV_FAULT_LIMIT,    "VOUT_UV_FAULT_LIMIT",    XFER_WORD,  FMT_LIN16U,   UNIT_V,      MODEL_ALL,    REG_RW) \
+  X(PMBUS_VOUT_UV_FAULT_RESPONSE, "VOUT_UV_FAULT_RESPONSE", XFER_BYTE,  FMT_RESPONSE, UNIT_MS10,   MODEL_ALL,    REG_RW) \
+  X(PMBUS_IOUT_OC_FAULT_LIMIT,    "IOUT_OC_FAULT_LIMIT",    XFER_WORD,  FMT_LIN11,    UNIT_A,      MODEL_ALL,    REG_RW) \
+  X(PMBUS_IOUT_OC_FAULT_RESPONSE, "IOUT_OC_FAULT_RESPONSE", XFER_BYTE,  FMT_RESPONSE, UNIT_MS10,   MODEL_ALL,    REG_RW) \
+  X(PMBUS_IOUT_OC_LV_FAULT_LIMIT, "IOUT_OC_LV_FAULT_LIMIT", XFER_WORD,  FMT_LIN16U,   UNIT_V,      MODEL_ALL,    REG_RW) \
+  X(PMBUS_IOUT_OC_WARN_LIMIT,     "IOUT_OC_WARN_LIMIT",     XFER_WORD,  FMT_LIN11,    UNIT_A,      MODEL_ALL,    REG_RW) \
+  X(PMBUS_OT_FAULT_LIMIT,         "OT_FAULT_LIMIT",         XFER_WORD,  FMT_LIN11,    UNIT_C,      MODEL_ALL,    REG_RW) \
+  X(PMBUS_OT_FAULT_RESPONSE,      "OT_FAULT_RESPONSE",      XFER_BYTE,  FMT_RESPONSE, UNIT_S_POW2, MODEL_ALL,    REG_RW) \
+  X(PMBUS_OT_WARN_LIMIT,          "OT_WARN_LIMIT",          XFER_WORD,  FMT_LIN11,    UNIT_C,      MODEL_ALL,    REG_RW) \
+  X(PMBUS_UT_WARN_LIMIT,          "UT_WARN_LIMIT",          XFER_WORD,  FMT_LIN11,    UNIT_C,      MODEL_ALL,    REG_RW) \
+  X(PMBUS_UT_FAULT_LIMIT,         "UT_FAULT_LIMIT",         XFER_WORD,  FMT_LIN11,    UNIT_C,      MODEL_ALL,    REG_RW) \
+  X(PMBUS_UT_FAULT_RESPONSE,      "UT_FAULT_RESPONSE",      XFER_BYTE,  FMT_RESPONSE, UNIT_S_POW2, MODEL_ALL,    REG_RW) \
+  X(PMBUS_VIN_OV_FAULT_LIMIT,     "VIN_OV_FAULT_LIMIT",     XFER_WORD,  FMT_LIN11,    UNIT_V,      MODEL_ALL,    REG_RW) \
+  X(PMBUS_VIN_OV_FAULT_RESPONSE,  "VIN_OV_FAULT_RESPONSE",  XFER_BYTE,  FMT_RESPONSE, UNIT_MS10,   MODEL_ALL,    REG_RW) \
+  X(PMBUS_VIN_OV_WARN_LIMIT,      "VIN_OV_WARN_LIMIT",      XFER_WORD,  FMT_LIN11,    UNIT_V,      MODEL_ALL,    REG_RW) \
+  X(PMBUS_VIN_UV_WARN_LIMIT,      "VIN_UV_WARN_LIMIT",      XFER_WORD,  FMT_LIN11,    UNIT_V,      MODEL_ALL,    REG_RW) \
+  X(PMBUS_VIN_UV_FAULT_LIMIT,     "VIN_UV_FAULT_LIMIT",     XFER_WORD,  FMT_LIN11,    UNIT_V,      MODEL_ALL,    REG_RW) \
+  X(PMBUS_VIN_UV_FAULT_RESPONSE,  "VIN_UV_FAULT_RESPONSE",  XFER_BYTE,  FMT_RESPONSE, UNIT_MS10,   MODEL_ALL,    REG_RW) \
+  X(PMBUS_POWER_GOOD_ON,          "POWER_GOOD_ON",          XFER_WORD,  FMT_LIN16U,   UNIT_V,      MODEL_ALL,    REG_RW) \
+  X(PMBUS_POWER_GOOD_OFF,         "POWER_GOOD_OFF",         XFER_WORD,  FMT_LIN16U,   UNIT_V,      MODEL_ALL,    REG_RW) \
+  X(PMBUS_TON_DELAY,              "TON_DELAY",              XFER_WORD,  FMT_U16,      UNIT_MS,     MODEL_ALL,    REG_RW) \
+  X(PMBUS_TON_RISE,               "TON_RISE",               XFER_WORD,  FMT_U16,      UNIT_MS,     MODEL_ALL,    REG_RW) \
+  X(PMBUS_TON_MAX_FAULT_LIMIT,    "TON_MAX_FAULT_LIMIT",    XFER_WORD,  FMT_U16,      UNIT_MS,     MODEL_ALL,    REG_RW) \
+  X(PMBUS_TON_MAX_FAULT_RESPONSE, "TON_MAX_FAULT_RESPONSE", XFER_BYTE,  FMT_RESPONSE, UNIT_MS10,   MODEL_ALL,    REG_RW) \
+  X(PMBUS_TOFF_DELAY,             "TOFF_DELAY",             XFER_WORD,  FMT_U16,      UNIT_MS,     MODEL_ALL,    REG_RW) \
+  X(PMBUS_TOFF_FALL,              "TOFF_FALL",              XFER_WORD,  FMT_U16,      UNIT_MS,     MODEL_ALL,    REG_RW) \
+  X(PMBUS_TOFF_MAX_WARN_LIMIT,    "TOFF_MAX_WARN_LIMIT",    XFER_WORD,  FMT_U16,      UNIT_MS,     MODEL_ALL,    REG_RW) \
+  X(PMBUS_STATUS_BYTE,            "STATUS_BYTE",            XFER_BYTE,  FMT_RAW,      UNIT_NONE,   MODEL_ALL,    REG_R | REG_VOLATILE) \
+  X(PMBUS_STATUS_WORD,            "STATUS_WORD",            XFER_WORD,  FMT_RAW,      UNIT_NONE,   MODEL_ALL,    REG_R | REG_VOLATILE) \
+  X(PMBUS_STATUS_VOUT,            "STATUS_VOUT",            XFER_BYTE,  FMT_RAW,      UNIT_NONE,   MODEL_ALL,    REG_R | REG_VOLATILE) \
+  X(PMBUS_STATUS_IOUT,            "STATUS_IOUT",            XFER_BYTE,  FMT_RAW,      UNIT_NONE,   MODEL_ALL,    REG_R | REG_VOLATILE) \
+  X(PMBUS_STATUS_INPUT,           "STATUS_INPUT",           XFER_BYTE,  FMT_RAW,      UNIT_NONE,   MODEL_ALL,    REG_R | REG_VOLATILE) \
+  X(PMBUS_STATUS_TEMPERATURE,     "STATUS_TEMPERATURE",     XFER_BYTE,  FMT_RAW,      UNIT_NONE,   MODEL_ALL,    REG_R | REG_VOLATILE) \
+  X(PMBUS_STATUS_CML,             "STATUS_CML",             XFER_BYTE,  FMT_RAW,      UNIT_NONE,   MODEL_ALL,    REG_R | REG_VOLATILE) \
+  X(PMBUS_OTHER,                  "STATUS_OTHER",           XFER_BYTE,  FMT_RAW,      UNIT_NONE,   MODEL_BMR456, REG_R | REG_VOLATILE) \
+  X(PMBUS_READ_VIN,               "READ_VIN",               XFER_WORD,  FMT_LIN11,    UNIT_V,      MODEL_ALL,    REG_R | REG_VOLATILE) \
+  X(PMBUS_READ_VOUT,              "READ_VOUT",              XFER_WORD,  FMT_LIN16U,   UNIT_V,      MODEL_ALL,    REG_R | REG_VOLATILE) \
+  X(PMBUS_READ_IOUT,              "READ_IOUT",              XFER_WORD,  FMT_LIN11,    UNIT_A,      MODEL_ALL,    REG_R | REG_VOLATILE) \
+  X(PMBUS_READ_TEMPERATURE_1,     "READ_TEMPERATURE_1",     XFER_WORD,  FMT_LIN11,    UNIT_C,      MODEL_ALL,    REG_R | REG_VOLATILE) \
+  X(PMBUS_READ_TEMPERATURE_2,     "READ_TEMPERATURE_2",     XFER_WORD,  FMT_LIN11,    UNIT_C,      MODEL_ALL,    REG_R | REG_VOLATILE) \
+  X(PMBUS_READ_TEMPERATURE_3,     "READ_TEMPERATURE_3",     XFER_WORD,  FMT_LIN11,    UNIT_C,      MODEL_ALL,    REG_R | REG_VOLATILE) \
+  X(PMBUS_READ_DUTY_CYCLE,        "READ_DUTY_CYCLE",        XFER_WORD,  FMT_LIN11,    UNIT_PCT,    MODEL_BMR685, REG_R | REG_VOLATILE) \
+  X(PMBUS_READ_FREQUENCY,         "READ_FREQUENCY",         XFER_WORD,  FMT_RAW,      UNIT_KHZ,    MODEL_BMR685, REG_R | REG_VOLATILE) \
+  X(PMBUS_PMBUS_REVISION,         "PMBUS_REVISION",         XFER_BYTE,  FMT_RAW,      UNIT_NONE,   MODEL_ALL,    REG_R) \
+  X(MFR_ID,                       "MFR_ID",                 XFER_BLOCK, FMT_ASCII,    UNIT_NONE,   MODEL_ALL,    REG_R) \
+  X(MFR_MODEL,                    "MFR_MODEL",              XFER_BLOCK, FMT_ASCII,    UNIT_NONE,   MODEL_ALL,    REG_R) \
+  X(MFR_REVISION,                 "MFR_REVISION",           XFER_BLOCK, FMT_ASCII,    UNIT_NONE,   MODEL_ALL,    REG_R) \
+  X(MFR_LOCATION,                 "MFR_LOCATION",           XFER_BLOCK, FMT_ASCII,    UNIT_NONE,   MODEL_ALL,    REG_R) \
+  X(MFR_DATE,                     "MFR_DATE",               XFER_BLOCK, FMT_ASCII,    UNIT_NONE,   MODEL_ALL,    REG_R) \
+  X(MFR_SERIAL,                   "MFR_SERIAL",             XFER_BLOCK, FMT_ASCII,    UNIT_NONE,   MODEL_ALL,    REG_R) \
+  X(MFR_USER_DATA_00,             "USER_DATA_00",           XFER_BLOCK, FMT_BLOCK,    UNIT_NONE,   MODEL_ALL,    REG_RW) \
+  X(MFR_VIN_OV_WARN_RESPONSE,     "MFR_VIN_OV_WARN_RESPONSE",     XFER_BYTE,  FMT_RAW,   UNIT_NONE, MODEL_BMR685, REG_RW) \
+  X(MFR_FAST_VIN_OFF_OFFSET,      "MFR_FAST_VIN_OFF_OFFSET",      XFER_WORD,  FMT_RAW,   UNIT_NONE, MODEL_BMR685, REG_RW) \
+  X(MFR_PGOOD_POLARITY,           "MFR_PGOOD_POLARITY",           XFER_BYTE,  FMT_RAW,   UNIT_NONE, MODEL_ALL,    REG_RW) \
+  X(MFR_FAST_OCP_CFG,             "MFR_FAST_OCP_CFG",             XFER_WORD,  FMT_RAW,   UNIT_NONE, MODEL_BMR685, REG_RW) \
+  X(MFR_RESPONSE_UNIT_CFG,        "MFR_RESPONSE_UNIT_CFG",        XFER_BYTE,  FMT_RAW,   UNIT_NONE, MODEL_BMR685, REG_RW) \
+  X(MFR_VIN_SCALE_MONITOR,        "MFR_VIN_SCALE_MONITOR",        XFER_WORD,  FMT_LIN11, UNIT_NONE, MODEL_ALL,    REG_RW) \
+  X(MFR_SNAPSHOT_CYCLES_SELECT,   "MFR_SNAPSHOT_CYCLES_SELECT",   XFER_BYTE,  FMT_RAW,   UNIT_NONE, MODEL_BMR685, REG_W) \
+  X(MFR_GET_SNAPSHOT,             "MFR_GET_SNAPSHOT",             XFER_BLOCK, FMT_BLOCK, UNIT_NONE, MODEL_BMR685, REG_R | REG_VOLATILE) \
+  X(MFR_TEMP_COMPENSATION,        "MFR_TEMP_COMPENSATION",        XFER_WORD,  FMT_RAW,   UNIT_NONE, MODEL_BMR685, REG_RW) \
+  X(MFR_SET_ROM_MODE,             "MFR_SET_ROM_MODE",             XFER_BLOCK, FMT_BLOCK, UNIT_NONE, MODEL_BMR685, REG_W | REG_CMD) \
+  X(MFR_GET_RAMP_DATA,            "MFR_GET_RAMP_DATA",            XFER_BLOCK, FMT_BLOCK, UNIT_NONE, MODEL_ALL,    REG_R | REG_VOLATILE) \
+  X(MFR_SELECT_TEMPERATURE_SENSOR,"MFR_SELECT_TEMPERATURE_SENSOR",XFER_BYTE,  FMT_RAW,   UNIT_NONE, MODEL_ALL,    REG_RW) \
+  X(MFR_VIN_OFFSET,               "MFR_VIN_OFFSET",               XFER_WORD,  FMT_LIN11, UNIT_V,    MODEL_ALL,    REG_RW) \
+  X(MFR_VOUT_OFFSET_MONITOR,      "MFR_VOUT_OFFSET_MONITOR",      XFER_WORD,  FMT_RAW,   UNIT_NONE, MODEL_ALL,    REG_RW) \
+  X(MFR_GET_STATUS_DATA,          "MFR_GET_STATUS_DATA",          XFER_BLOCK, FMT_BLOCK, UNIT_NONE, MODEL_ALL,    REG_R | REG_VOLATILE) \
+  X(MFR_SPECIAL_OPTIONS,          "MFR_SPECIAL_OPTIONS",          XFER_BYTE,  FMT_RAW,   UNIT_NONE, MODEL_BMR685, REG_RW) \
+  X(MFR_TEMP_OFFSET_INT,          "MFR_TEMP_OFFSET_INT",          XFER_WORD,  FMT_LIN11, UNIT_C,    MODEL_ALL,    REG_RW) \
+  X(MFR_REMOTE_TEMP_CAL,          "MFR_REMOTE_TEMP_CAL",          XFER_WORD,  FMT_RAW,   UNIT_NONE, MODEL_ALL,    REG_RW) \
+  X(MFR_REMOTE_CTRL,              "MFR_REMOTE_CTRL",              XFER_BYTE,  FMT_RAW,   UNIT_NONE, MODEL_ALL,    REG_RW) \
+  X(MFR_DEAD_BAND_DELAY,          "MFR_DEAD_BAND_DELAY",          XFER_WORD,  FMT_RAW,   UNIT_NONE, MODEL_BMR456, REG_RW) \
+  X(MFR_TEMP_COEFF,               "MFR_TEMP_COEFF",               XFER_WORD,  FMT_RAW,   UNIT_NONE, MODEL_ALL,    REG_RW) \
+  X(MFR_FILTER_COEFF,             "MFR_FILTER_COEFF",             XFER_BLOCK, FMT_BLOCK, UNIT_NONE, MODEL_BMR685, REG_RW) \
+  X(MFR_MIN_DUTY,                 "MFR_MIN_DUTY",                 XFER_WORD,  FMT_RAW,   UNIT_NONE, MODEL_BMR685, REG_RW) \
+  X(MFR_OFFSET_ADDRESS,           "MFR_OFFSET_ADDRESS",           XFER_BYTE,  FMT_RAW,   UNIT_NONE, MODEL_BMR685, REG_RW) \
+  X(MFR_DEBUG_BUFF,               "MFR_DEBUG_BUFF",               XFER_BLOCK, FMT_BLOCK, UNIT_NONE, MODEL_BMR456, REG_R | REG_VOLATILE) \
+  X(MFR_SETUP_PASSWORD,           "MFR_SETUP_PASSWORD",           XFER_BLOCK, FMT_BLOCK, UNIT_NONE, MODEL_ALL,    REG_W | REG_CMD) \
+  X(MFR_DISABLE_SECURITY_ONCE,    "MFR_DISABLE_SECURITY_ONCE",    XFER_BLOCK, FMT_BLOCK, UNIT_NONE, MODEL_BMR456, REG_W | REG_CMD) \
+  X(MFR_DEAD_BAND_IOUT_THRESHOLD, "MFR_DEAD_BAND_IOUT_THRESHOLD", XFER_WORD,  FMT_RAW,   UNIT_NONE, MODEL_BMR456, REG_RW) \
+  X(MFR_SECURITY_BIT_MASK,        "MFR_SECURITY_BIT_MASK",        XFER_BLOCK, FMT_BLOCK, UNIT_NONE, MODEL_ALL,    REG_R) \
+  X(MFR_PRIMARY_TURN,             "MFR_PRIMARY_TURN",             XFER_BYTE,  FMT_RAW,   UNIT_NONE, MODEL_BMR456, REG_RW) \
+  X(MFR_SECONDARY_TURN,           "MFR_SECONDARY_TURN",           XFER_BYTE,  FMT_RAW,   UNIT_NONE, MODEL_BMR456, REG_RW) \
+  X(MFR_ILIM_SOFTSTART,           "MFR_ILIM_SOFTSTART",           XFER_BYTE,  FMT_RAW,   UNIT_NONE, MODEL_ALL,    REG_RW) \
+  X(MFR_MULTI_PIN_CONFIG,         "MFR_MULTI_PIN_CONFIG",         XFER_BYTE,  FMT_RAW,   UNIT_NONE, MODEL_ALL,    REG_RW) \
+  X(MFR_DEAD_BAND_VIN_THRESHOLD,  "MFR_DEAD_BAND_VIN_THRESHOLD",  XFER_WORD,  FMT_RAW,   UNIT_NONE, MODEL_BMR456, REG_RW) \
+  X(MFR_DEAD_BAND_VIN_IOUT_HYS,   "MFR_DEAD_BAND_VIN_IOUT_HYS",   XFER_WORD,  FMT_RAW,   UNIT_NONE, MODEL_BMR456, REG_RW) \
+  X(MFR_FIRMWARE_DATA,            "MFR_FIRMWARE_DATA",            XFER_BLOCK, FMT_BLOCK, UNIT_NONE, MODEL_BMR685, REG_R) \
+  X(MFR_RESTART,                  "MFR_RESTART",                  XFER_BLOCK, FMT_BLOCK, UNIT_NONE, MODEL_ALL,    REG_W | REG_CMD)
+
+struct pmbus_reg {
+  const char *name;             /* NULL: opcode unknown to this tool */
+  enum pmbus_xfer xfer;
+  enum pmbus_fmt fmt;
+  enum pmbus_unit unit;
+  uint8_t models;
+  uint8_t flags;
+};
+
+extern const struct pmbus_reg pmbus_regs[256];
+
+static inline const struct pmbus_reg *
+pmbus_reg(uint8_t cmd) {
+  return pmbus_regs[cmd].name ? &pmbus_regs[cmd] : NULL;
+}
+
+/* unknown opcodes and unknown models (MODEL_ALL) are never filtered out */
+static inline bool
+pmbus_reg_supported(uint8_t cmd, unsigned model) {
+  const struct pmbus_reg *r = pmbus_reg(cmd);
+
+  return !r || (r->models & model) != 0;
+}
+
+/* configuration register: non-volatile, read/write, not a command, implemented by model */
+static inline bool
+pmbus_reg_config(uint8_t cmd, unsigned model) {
+  const struct pmbus_reg *r = pmbus_reg(cmd);
+
+  return r && (r->flags & REG_RW) == REG_RW && !(r->flags & (REG_CMD | REG_VOLATILE)) &&
+         (r->models & model) != 0;
+}
+
+const char *pmbus_unit_name(enum pmbus_unit u);
+
+/* MODEL_BMR685/MODEL_BMR456 from MFR_MODEL, MODEL_ALL if unreadable or unknown */
+unsigned pmbus_model(int fd);
+
+/* byte or word read per the table; <0 on error or for block/send commands */
+int pmbus_reg_rd(int fd, uint8_t cmd);
+
+/* byte or word write per the table; <0 on error or for block/send commands */
+int pmbus_reg_wr(int fd, uint8_t cmd, uint16_t val);
+
+/* opcode for a table name ("VOUT_COMMAND"), -1 if unknown */
+int pmbus_reg_by_name(const char *name);
+
+/* raw byte/word -> engineering units per the table (exp5 for LIN16U) */
+double pmbus_reg_to_units(uint8_t cmd, uint16_t raw, int exp5);
+
+/* engineering units -> nearest raw code per the table; non-LIN formats take v as the raw value */
+uint16_t pmbus_units_to_reg(uint8_t cmd, double v, int exp5);
@@ -1,149 +1,310 @@
 /* SPDX-License-Identifier: AGPL-3.0-or-later */
+#define _POSIX_C_SOURCE 200809L
 
 #include "pmbus_io.h"
+#include "pmbus_regs.h"
 #include "util_json.h"
 #include <jansson.h>
+#include <errno.h>
+#include <math.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
 
+/* "read <name>" -> JSON key and register; the encoding comes from pmbus_regs[] */
+static const struct read_field {
+  const char *name;
+  const char *key;
+  uint8_t reg;
+} READ_FIELDS[] = {
+  { "vin",   "vin_V",        PMBUS_READ_VIN },
+  { "vout",  "vout_V",       PMBUS_READ_VOUT },
+  { "iout",  "iout_A",       PMBUS_READ_IOUT },
+  { "temp1", "temp1_C",      PMBUS_READ_TEMPERATURE_1 },
+  { "temp2", "temp2_C",      PMBUS_READ_TEMPERATURE_2 },
+  { "duty",  "duty_pct",     PMBUS_READ_DUTY_CYCLE },
+  { "freq",  "freq_khz_raw", PMBUS_READ_FREQUENCY },
+};
+
+#define N_READ_FIELDS (sizeof READ_FIELDS / sizeof READ_FIELDS[0])
+
+/* READ_FIELDS[] slots the derived channels are computed from */
+enum { RF_VIN, RF_VOUT, RF_IOUT };
+
+#define READ_DEFAULT_EFF 0.90           /* for the input current estimate, no READ_IIN */
+#define READ_DEFAULT_SKEW_US 2000       /* ~7 word reads at 400 kHz take under 1 ms */
+
+static volatile sig_atomic_t read_stop;
+
 static void
-out_double(const char *k, double v, int pretty) {
-  json_t *o = json_object();
-  json_object_set_new(o, k, json_real(v));
-  json_print_or_pretty(o, pretty);
+read_on_signal(int sig) {
+  (void) sig;
+  read_stop = 1;
 }
 
-enum enc_t { ENC_LIN11, ENC_LIN16U, ENC_RAW_INT };
+static void
+usage_read(void) {
+  fprintf(stderr,
+"read [vin|vout|iout|temp1|temp2|duty|freq|all]\n"
+"read all [--coherent [--skew-us N]] [--derived [--eff PCT]] [--interval MS [--count N]]\n"
+"Notes:\n"
+"  --coherent reads all registers in one I2C_RDWR burst and adds its CLOCK_MONOTONIC\n"
+"  start/end; skew_ok is false if it took longer than --skew-us (default %d).\n"
+"  --derived adds pout_W, pin_est_W and iin_est_A (input side assumes --eff, default %.0f%%).\n"
+"  --interval repeats the read; with --derived it also integrates energy_Wh.\n"
+  , READ_DEFAULT_SKEW_US, READ_DEFAULT_EFF * 100.0);
+}
+
+/* one batch: every register read back to back before anything is decoded or printed */
+struct read_sample {
+  int w[N_READ_FIELDS];           /* <0: not supported or not read */
+  int64_t t_start_us, t_end_us;   /* CLOCK_MONOTONIC around the reads */
+  bool burst;                     /* all in one I2C_RDWR transfer */
+};
 
+/*
+ * coherent: one I2C_RDWR burst. A NACK anywhere fails the whole burst, and SMBus-only
+ * adapters cannot do it at all: both fall back to separate reads with burst = false.
+ */
 static void
-add_read_field(json_t *o, const char *key, int fd, uint8_t reg, enum enc_t enc, int exp5) {
-  int w = pmbus_rd_word(fd, reg);
-  if (w < 0)
-    return;
+read_sample(int fd, unsigned model, bool coherent, struct read_sample *s) {
+  uint8_t cmds[N_READ_FIELDS];
+  uint16_t words[N_READ_FIELDS];
+  int slot[N_READ_FIELDS], n = 0;
 
-  switch (enc) {
-  case ENC_LIN11:
-    json_object_set_new(o, key, json_real(pmbus_lin11_to_double((uint16_t)w)));
-    break;
-  case ENC_LIN16U:
-    json_object_set_new(o, key, json_real(pmbus_lin16u_to_double((uint16_t)w, exp5)));
-    break;
-  case ENC_RAW_INT:
-    json_object_set_new(o, key, json_integer(w));
-    break;
+  for (size_t i = 0; i < N_READ_FIELDS; i++) {
+    s->w[i] = -1;
+    /* e.g. READ_FREQUENCY on BMR456: don't spend a NACKed transfer on it */
+    if (pmbus_reg_supported(READ_FIELDS[i].reg, model)) {
+      cmds[n] = READ_FIELDS[i].reg;
+      slot[n++] = (int) i;
+    }
   }
+
+  s->t_start_us = pmbus_now_us();
+  s->burst = coherent && pmbus_rd_words_burst(fd, cmds, n, words) == 0;
+  if (s->burst) {
+    for (int k = 0; k < n; k++)
+      s->w[slot[k]] = words[k];
+  } else {
+    if (coherent)
+      s->t_start_us = pmbus_now_us();
+    for (int k = 0; k < n; k++)
+      s->w[slot[k]] = pmbus_reg_rd(fd, cmds[k]);
+  }
+  s->t_end_us = pmbus_now_us();
+}
+
+static void
+add_timing(json_t *o, const struct read_sample *s, int64_t skew_us) {
+  int64_t d = s->t_end_us - s->t_start_us;
+
+  json_object_set_new(o, "t_start_us", json_integer(s->t_start_us));
+  json_object_set_new(o, "t_end_us", json_integer(s->t_end_us));
+  json_object_set_new(o, "burst_us", json_integer(d));
+  json_object_set_new(o, "burst", json_boolean(s->burst));
+  json_object_set_new(o, "skew_ok", json_boolean(d <= skew_us));
+}
+
+static double
+read_units(const struct read_sample *s, int i, int exp5) {
+  return s->w[i] < 0 ? NAN : pmbus_reg_to_units(READ_FIELDS[i].reg, (uint16_t) s->w[i], exp5);
+}
+
+static json_t *
+read_value_json(uint8_t reg, uint16_t w, int exp5) {
+  const struct pmbus_reg *r = pmbus_reg(reg);
+
+  if (r && (r->fmt == FMT_LIN11 || r->fmt == FMT_LIN16U))
+    return json_real(pmbus_reg_to_units(reg, w, exp5));
+
+  return json_integer(w);
 }
 
 static json_t *
-build_read_all_json(int fd, int exp5) {
+build_read_all_json(const struct read_sample *s, int exp5) {
   json_t *o = json_object();
 
-  add_read_field(o, "vin_V",       fd, PMBUS_READ_VIN,            ENC_LIN11,  0);
-  add_read_field(o, "vout_V",      fd, PMBUS_READ_VOUT,           ENC_LIN16U, exp5);
-  add_read_field(o, "iout_A",      fd, PMBUS_READ_IOUT,           ENC_LIN11,  0);
-  add_read_field(o, "temp1_C",     fd, PMBUS_READ_TEMPERATURE_1,  ENC_LIN11,  0);
-  add_read_field(o, "temp2_C",     fd, PMBUS_READ_TEMPERATURE_2,  ENC_LIN11,  0);
-  add_read_field(o, "duty_pct",    fd, PMBUS_READ_DUTY_CYCLE,     ENC_LIN11,  0);
-  add_read_field(o, "freq_khz_raw",fd, PMBUS_READ_FREQUENCY,      ENC_RAW_INT,0);
+  for (size_t i = 0; i < N_READ_FIELDS; i++)
+    if (s->w[i] >= 0)
+      json_object_set_new(o, READ_FIELDS[i].key,
+                          read_value_json(READ_FIELDS[i].reg, (uint16_t) s->w[i], exp5));
 
   return o;
 }
 
-int
-cmd_read(int fd, int argc, char *const *argv, int pretty) {
-  const char *what = (argc >= 1) ? argv[0] : "all";
+/* POUT from the batch's own VOUT/IOUT; NAN if either read failed */
+static double
+read_pout(const struct read_sample *s, int exp5) {
+  return read_units(s, RF_VOUT, exp5) * read_units(s, RF_IOUT, exp5);
+}
 
-  int exp5 = 0;
-  pmbus_get_vout_mode_exp(fd, &exp5);
+static void
+add_derived(json_t *o, const struct read_sample *s, int exp5, double eff) {
+  double pout = read_pout(s, exp5);
+  double vin = read_units(s, RF_VIN, exp5);
 
-  if (!strcmp(what, "all")) {
-    json_t *o = build_read_all_json(fd, exp5);
+  if (!isfinite(pout))
+    return;
+  json_object_set_new(o, "pout_W", json_real(pout));
+  json_object_set_new(o, "pin_est_W", json_real(pout / eff));
+  if (isfinite(vin) && vin > 0.0)
+    json_object_set_new(o, "iin_est_A", json_real(pout / eff / vin));
+}
 
-    json_print_or_pretty(o, pretty);
+static int
+parse_pct(const char *s, double *out) {
+  char *end = NULL;
 
-    return 0;
-  }
+  errno = 0;
+  double v = strtod(s, &end);
+  if (errno || end == s || *end != '\0' || !(v > 0.0 && v <= 100.0))
+    return -1;
 
-  if (!strcmp(what, "vin")) {
-    int v = pmbus_rd_word(fd, PMBUS_READ_VIN);
-    if (v < 0) {
-      perror("READ_VIN");
-      return 1;
-    }
-    out_double("vin_V", pmbus_lin11_to_double((uint16_t) v), pretty);
+  *out = v / 100.0;
 
-    return 0;
-  }
+  return 0;
+}
 
-  if (!strcmp(what, "vout")) {
-    int v = pmbus_rd_word(fd, PMBUS_READ_VOUT);
-    if (v < 0) {
-      perror("READ_VOUT");
-      return 1;
-    }
-    out_double("vout_V", pmbus_lin16u_to_double((uint16_t) v, exp5), pretty);
+struct read_opts {
+  bool coherent, derived;
+  double eff;
+  int64_t skew_us;
+};
 
-    return 0;
-  }
+/*
+ * Repeated "read all" on absolute deadlines. Energy is the trapezoid integral of POUT over
+ * CLOCK_MONOTONIC between consecutive good samples, so wall-clock steps cannot corrupt it;
+ * an interval with a failed VOUT/IOUT read is bridged by the next good one.
+ */
+static int
+read_repeat(int fd, unsigned model, int exp5, const struct read_opts *ro, unsigned interval_ms,
+            long count, int pretty) {
+  struct sigaction sa = { .sa_handler = read_on_signal };
+  struct sigaction old_int, old_term;
 
-  if (!strcmp(what, "iout")) {
-    int v = pmbus_rd_word(fd, PMBUS_READ_IOUT);
-    if (v < 0) {
-      perror("READ_IOUT");
-      return 1;
-    }
-    out_double("iout_A", pmbus_lin11_to_double((uint16_t) v), pretty);
+  sigemptyset(&sa.sa_mask);
+  sigaction(SIGINT, &sa, &old_int);
+  sigaction(SIGTERM, &sa, &old_term);
 
-    return 0;
-  }
+  int64_t period_us = (int64_t) interval_ms * 1000;
+  int64_t start = pmbus_now_us(), next = start;
+  int64_t t_prev = 0;
+  double p_prev = NAN, energy_wh = 0.0;
 
-  if (!strcmp(what, "temp1")) {
-    int v = pmbus_rd_word(fd, PMBUS_READ_TEMPERATURE_1);
-    if (v < 0) {
-      perror("READ_TEMPERATURE_1");
-      return 1;
-    }
-    out_double("temp1_C", pmbus_lin11_to_double((uint16_t) v), pretty);
+  for (long n = 0; !read_stop && (count <= 0 || n < count); n++) {
+    pmbus_sleep_until_us(next);
+    if (read_stop)
+      break;
 
-    return 0;
-  }
+    struct read_sample s;
+    read_sample(fd, model, ro->coherent, &s);
 
-  if (!strcmp(what, "temp2")) {
-    int v = pmbus_rd_word(fd, PMBUS_READ_TEMPERATURE_2);
-    if (v < 0) {
-      perror("READ_TEMPERATURE_2");
-      return 1;
+    /* the middle of the batch is the best single timestamp for all of it */
+    int64_t t = (s.t_start_us + s.t_end_us) / 2;
+    json_t *o = build_read_all_json(&s, exp5);
+    json_object_set_new(o, "t_s", json_real((double) (t - start) / 1e6));
+    if (ro->coherent)
+      add_timing(o, &s, ro->skew_us);
+    if (ro->derived) {
+      double p = read_pout(&s, exp5);
+      if (isfinite(p)) {
+        if (isfinite(p_prev))
+          energy_wh += (p + p_prev) / 2.0 * (double) (t - t_prev) / 3.6e9;
+        p_prev = p;
+        t_prev = t;
+      }
+      add_derived(o, &s, exp5, ro->eff);
+      json_object_set_new(o, "energy_Wh", json_real(energy_wh));
     }
-    out_double("temp2_C", pmbus_lin11_to_double((uint16_t) v), pretty);
+    json_print_or_pretty(o, pretty);
+    fflush(stdout);
 
-    return 0;
+    next += period_us;
+    int64_t now = pmbus_now_us();
+    if (now > next + period_us)
+      next = now;
   }
 
-  if (!strcmp(what, "duty")) {
-    int v = pmbus_rd_word(fd, PMBUS_READ_DUTY_CYCLE);
-    if (v < 0) {
-      perror("READ_DUTY_CYCLE");
-      return 1;
+  sigaction(SIGINT, &old_int, NULL);
+  sigaction(SIGTERM, &old_term, NULL);
+
+  return 0;
+}
+
+int
+cmd_read(int fd, int argc, char *const *argv, int pretty) {
+  const char *what = (argc >= 1) ? argv[0] : "all";
+
+  int exp5 = 0;
+  pmbus_get_vout_mode_exp(fd, &exp5);
+
+  if (!strcmp(what, "all")) {
+    struct read_opts ro = { .eff = READ_DEFAULT_EFF, .skew_us = READ_DEFAULT_SKEW_US };
+    unsigned interval_ms = 0;
+    long count = 0;
+
+    for (int i = 1; i < argc; i++) {
+      if (!strcmp(argv[i], "--derived"))
+        ro.derived = true;
+      else if (!strcmp(argv[i], "--coherent"))
+        ro.coherent = true;
+      else if (!strcmp(argv[i], "--skew-us") && i + 1 < argc)
+        ro.skew_us = strtoll(argv[++i], NULL, 0);
+      else if (!strcmp(argv[i], "--eff") && i + 1 < argc) {
+        if (parse_pct(argv[++i], &ro.eff) < 0) {
+          usage_read();
+          return 2;
+        }
+      } else if (!strcmp(argv[i], "--interval") && i + 1 < argc)
+        interval_ms = (unsigned) strtoul(argv[++i], NULL, 0);
+      else if (!strcmp(argv[i], "--count") && i + 1 < argc)
+        count = strtol(argv[++i], NULL, 0);
+      else {
+        usage_read();
+        return 2;
+      }
     }
-    out_double("duty_pct", pmbus_lin11_to_double((uint16_t) v), pretty);
+
+    unsigned model = pmbus_model(fd);
+    if (interval_ms)
+      return read_repeat(fd, model, exp5, &ro, interval_ms, count, pretty);
+
+    struct read_sample s;
+    read_sample(fd, model, ro.coherent, &s);
+
+    json_t *o = build_read_all_json(&s, exp5);
+    if (ro.coherent)
+      add_timing(o, &s, ro.skew_us);
+    if (ro.derived)
+      add_derived(o, &s, exp5, ro.eff);
+    json_print_or_pretty(o, pretty);
 
     return 0;
   }
 
-  if (!strcmp(what, "freq")) {
-    int v = pmbus_rd_word(fd, PMBUS_READ_FREQUENCY);
+  for (size_t i = 0; i < N_READ_FIELDS; i++) {
+    const struct read_field *f = &READ_FIELDS[i];
+
+    if (strcmp(what, f->name))
+      continue;
+
+    int v = pmbus_reg_rd(fd, f->reg);
     if (v < 0) {
-      perror("READ_FREQUENCY");
+      perror(pmbus_reg(f->reg)->name);
       return 1;
     }
+
     json_t *o = json_object();
-    json_object_set_new(o, "freq_khz_raw", json_integer(v));
+    json_object_set_new(o, f->key, read_value_json(f->reg, (uint16_t) v, exp5));
     json_print_or_pretty(o, pretty);
 
     return 0;
   }
 
-  fprintf(stderr, "read [vin|vout|iout|temp1|temp2|duty|freq|all]\n");
+  usage_read();
 
   return 2;
 }
@@ -0,0 +1,396 @@
+/* SPDX-License-Identifier: AGPL-3.0-or-later */
+#define _POSIX_C_SOURCE 200809L
+
+#include "pmbus_io.h"
+#include "pmbus_regs.h"
+#include "util_json.h"
+
+#include <jansson.h>
+#include <errno.h>
+#include <math.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Continuous sampling with in-process rollups. Every --interval the word registers are read
+ * once; each value updates its register's window statistics in O(1) (Welford's running mean
+ * and sum of squared deviations, so stddev stays accurate over long windows). Only the
+ * window summaries are printed, one JSON document per --window, aligned to wall-clock
+ * multiples of the window so several hosts roll up the same minute.
+ *
+ * --threshold NAME>V / NAME<V: when a register crosses its limit, the last --burst samples
+ * of all registers (kept in a ring) plus the next --burst are printed as a raw event.
+ */
+
+#define ROLL_DEFAULT_INTERVAL_MS 10
+#define ROLL_DEFAULT_WINDOW_S 60
+#define ROLL_DEFAULT_BURST 50
+#define ROLL_MAX_BURST 10000
+#define ROLL_EVENT_SPAN 8             /* repeated crossings extend an event up to this many bursts */
+#define ROLL_MAX_REGS 16
+#define ROLL_MAX_TRIGGERS 8
+#define ROLL_DEFAULT_REGS "READ_VOUT,READ_IOUT"
+
+static volatile sig_atomic_t roll_stop;
+
+static void
+roll_on_signal(int sig) {
+  (void) sig;
+  roll_stop = 1;
+}
+
+static void
+usage_rollup(void) {
+  fprintf(stderr,
+"rollup [--regs NAME,...] [--interval MS] [--window S] [--count N]\n"
+"       [--threshold NAME>V|NAME<V]... [--burst N]\n"
+"Notes:\n"
+"  --regs defaults to " ROLL_DEFAULT_REGS "; threshold registers are added to it.\n"
+"  One JSON document per window: count, min, max, mean, stddev per register.\n"
+"  A threshold crossing prints --burst samples before and after it (default %d).\n"
+  , ROLL_DEFAULT_BURST);
+}
+
+struct roll_stat {
+  uint64_t n, failed;
+  double min, max, mean, m2;
+};
+
+static void
+roll_reset(struct roll_stat *s) {
+  *s = (struct roll_stat) { .min = INFINITY, .max = -INFINITY };
+}
+
+static void
+roll_add(struct roll_stat *s, double v) {
+  s->n++;
+  double d = v - s->mean;
+  s->mean += d / (double) s->n;
+  s->m2 += d * (v - s->mean);
+  if (v < s->min)
+    s->min = v;
+  if (v > s->max)
+    s->max = v;
+}
+
+struct roll_trig {
+  int col;                      /* index into the sampled registers */
+  bool below;                   /* NAME<V */
+  double limit;
+  int state;                    /* -1 unknown, 0 inside, 1 beyond the limit */
+};
+
+/* one sampling cycle: NAN where the read failed */
+struct roll_row {
+  int64_t t_ms;
+  double v[ROLL_MAX_REGS];
+};
+
+struct rollup {
+  uint8_t regs[ROLL_MAX_REGS];
+  int nregs;
+  struct roll_trig trig[ROLL_MAX_TRIGGERS];
+  int ntrig;
+  int exp5;
+  int pretty;
+
+  struct roll_stat st[ROLL_MAX_REGS];
+  int64_t window_ms, window_idx;
+  uint64_t window_crossings;
+
+  /* pre-trigger ring and the event being captured */
+  struct roll_row *ring;
+  unsigned burst, ring_len, ring_head;
+  json_t *event;
+  unsigned post_left;
+};
+
+static int
+roll_col(struct rollup *r, const char *name) {
+  int reg = pmbus_reg_by_name(name);
+
+  if (reg < 0 || pmbus_regs[reg].xfer != XFER_WORD || !(pmbus_regs[reg].flags & REG_R)) {
+    fprintf(stderr, "rollup: %s is not a readable word register\n", name);
+    return -1;
+  }
+  for (int i = 0; i < r->nregs; i++)
+    if (r->regs[i] == reg)
+      return i;
+  if (r->nregs == ROLL_MAX_REGS) {
+    fprintf(stderr, "rollup: at most %d registers\n", ROLL_MAX_REGS);
+    return -1;
+  }
+  r->regs[r->nregs] = (uint8_t) reg;
+
+  return r->nregs++;
+}
+
+static int
+parse_trigger(struct rollup *r, char *s) {
+  char *op = strpbrk(s, "<>");
+  char *end = NULL;
+
+  if (!op || r->ntrig == ROLL_MAX_TRIGGERS)
+    return -1;
+
+  struct roll_trig *t = &r->trig[r->ntrig];
+  t->below = *op == '<';
+  *op = '\0';
+
+  errno = 0;
+  t->limit = strtod(op + 1, &end);
+  if (errno || end == op + 1 || *end != '\0')
+    return -1;
+  if ((t->col = roll_col(r, s)) < 0)
+    return -1;
+  t->state = -1;
+  r->ntrig++;
+
+  return 0;
+}
+
+static json_t *
+num_or_null(double v) {
+  return isfinite(v) ? json_real(v) : json_null();
+}
+
+static json_t *
+row_json(const struct rollup *r, const struct roll_row *row) {
+  json_t *a = json_array();
+
+  json_array_append_new(a, json_integer(row->t_ms));
+  for (int i = 0; i < r->nregs; i++)
+    json_array_append_new(a, num_or_null(row->v[i]));
+
+  return a;
+}
+
+static void
+emit_window(struct rollup *r) {
+  json_t *o = json_object();
+  json_t *regs = json_object();
+
+  json_object_set_new(o, "t_start_ms", json_integer(r->window_idx * r->window_ms));
+  json_object_set_new(o, "window_ms", json_integer(r->window_ms));
+  for (int i = 0; i < r->nregs; i++) {
+    const struct roll_stat *s = &r->st[i];
+    json_t *e = json_object();
+
+    json_object_set_new(e, "unit", json_string(pmbus_unit_name(pmbus_regs[r->regs[i]].unit)));
+    json_object_set_new(e, "count", json_integer((json_int_t) s->n));
+    json_object_set_new(e, "failed", json_integer((json_int_t) s->failed));
+    json_object_set_new(e, "min", s->n ? json_real(s->min) : json_null());
+    json_object_set_new(e, "max", s->n ? json_real(s->max) : json_null());
+    json_object_set_new(e, "mean", s->n ? json_real(s->mean) : json_null());
+    json_object_set_new(e, "stddev", s->n ? json_real(sqrt(s->m2 / (double) s->n)) : json_null());
+    json_object_set_new(regs, pmbus_regs[r->regs[i]].name, e);
+  }
+  json_object_set_new(o, "regs", regs);
+  json_object_set_new(o, "crossings", json_integer((json_int_t) r->window_crossings));
+
+  json_print_or_pretty(o, r->pretty);
+  fflush(stdout);
+
+  for (int i = 0; i < r->nregs; i++)
+    roll_reset(&r->st[i]);
+  r->window_crossings = 0;
+}
+
+static void
+emit_event(struct rollup *r) {
+  json_print_or_pretty(r->event, r->pretty);
+  fflush(stdout);
+  r->event = NULL;
+}
+
+static void
+start_event(struct rollup *r, const struct roll_trig *t, bool enter, const struct roll_row *row) {
+  json_t *o = json_object();
+  json_t *cols = json_array();
+  json_t *rows = json_array();
+
+  json_object_set_new(o, "event", json_string("threshold"));
+  json_object_set_new(o, "reg", json_string(pmbus_regs[r->regs[t->col]].name));
+  json_object_set_new(o, "op", json_string(t->below ? "<" : ">"));
+  json_object_set_new(o, "limit", json_real(t->limit));
+  json_object_set_new(o, "edge", json_string(enter ? "enter" : "leave"));
+  json_object_set_new(o, "t_ms", json_integer(row->t_ms));
+  json_object_set_new(o, "crossings", json_integer(1));
+
+  json_array_append_new(cols, json_string("t_ms"));
+  for (int i = 0; i < r->nregs; i++)
+    json_array_append_new(cols, json_string(pmbus_regs[r->regs[i]].name));
+  json_object_set_new(o, "columns", cols);
+
+  /* ring holds the samples before this one, oldest at ring_head once it has wrapped */
+  unsigned first = r->ring_len < r->burst ? 0 : r->ring_head;
+  for (unsigned k = 0; k < r->ring_len; k++)
+    json_array_append_new(rows, row_json(r, &r->ring[(first + k) % r->burst]));
+  json_array_append_new(rows, row_json(r, row));
+  json_object_set_new(o, "rows", rows);
+
+  r->event = o;
+  r->post_left = r->burst;
+}
+
+static void
+roll_sample(struct rollup *r, const struct roll_row *row) {
+  int64_t idx = row->t_ms / r->window_ms;
+
+  if (idx != r->window_idx) {
+    if (r->window_idx >= 0)
+      emit_window(r);
+    r->window_idx = idx;
+  }
+
+  for (int i = 0; i < r->nregs; i++) {
+    if (isnan(row->v[i]))
+      r->st[i].failed++;
+    else
+      roll_add(&r->st[i], row->v[i]);
+  }
+
+  bool started = false;
+  for (int k = 0; k < r->ntrig; k++) {
+    struct roll_trig *t = &r->trig[k];
+    double v = row->v[t->col];
+
+    if (isnan(v))
+      continue;
+    int beyond = t->below ? v < t->limit : v > t->limit;
+    bool crossed = t->state >= 0 && beyond != t->state;
+    t->state = beyond;
+    if (!crossed)
+      continue;
+
+    r->window_crossings++;
+    if (!r->event) {
+      start_event(r, t, beyond, row);
+      started = true;
+      continue;
+    }
+
+    /* a crossing inside the capture keeps it open, so one transient is one event */
+    json_t *c = json_object_get(r->event, "crossings");
+    json_integer_set(c, json_integer_value(c) + 1);
+    if (json_array_size(json_object_get(r->event, "rows")) < ROLL_EVENT_SPAN * r->burst)
+      r->post_left = r->burst;
+  }
+
+  if (r->event && !started) {
+    json_array_append_new(json_object_get(r->event, "rows"), row_json(r, row));
+    r->post_left--;
+  }
+  if (r->event && r->post_left == 0)
+    emit_event(r);
+
+  if (r->burst) {
+    r->ring[r->ring_head] = *row;
+    r->ring_head = (r->ring_head + 1) % r->burst;
+    if (r->ring_len < r->burst)
+      r->ring_len++;
+  }
+}
+
+int
+cmd_rollup(int fd, int argc, char *const *argv, int pretty) {
+  static struct rollup r;
+  char list[512] = ROLL_DEFAULT_REGS;
+  unsigned interval_ms = ROLL_DEFAULT_INTERVAL_MS;
+  unsigned window_s = ROLL_DEFAULT_WINDOW_S;
+  long count = 0;
+
+  r = (struct rollup) { .pretty = pretty, .burst = ROLL_DEFAULT_BURST, .window_idx = -1 };
+
+  /* registers first, so --threshold adds to them rather than the other way round */
+  for (int i = 0; i < argc; i++) {
+    if (!strcmp(argv[i], "--regs") && i + 1 < argc &&
+        (size_t) snprintf(list, sizeof list, "%s", argv[i + 1]) >= sizeof list) {
+      usage_rollup();
+      return 2;
+    }
+  }
+  for (char *tok = strtok(list, ","); tok; tok = strtok(NULL, ","))
+    if (roll_col(&r, tok) < 0)
+      return 2;
+
+  for (int i = 0; i < argc; i++) {
+    if (!strcmp(argv[i], "--regs") && i + 1 < argc)
+      i++;
+    else if (!strcmp(argv[i], "--interval") && i + 1 < argc)
+      interval_ms = (unsigned) strtoul(argv[++i], NULL, 0);
+    else if (!strcmp(argv[i], "--window") && i + 1 < argc)
+      window_s = (unsigned) strtoul(argv[++i], NULL, 0);
+    else if (!strcmp(argv[i], "--count") && i + 1 < argc)
+      count = strtol(argv[++i], NULL, 0);
+    else if (!strcmp(argv[i], "--burst") && i + 1 < argc)
+      r.burst = (unsigned) strtoul(argv[++i], NULL, 0);
+    else if (!strcmp(argv[i], "--threshold") && i + 1 < argc) {
+      char spec[128];
+      if ((size_t) snprintf(spec, sizeof spec, "%s", argv[++i]) >= sizeof spec ||
+          parse_trigger(&r, spec) < 0) {
+        usage_rollup();
+        return 2;
+      }
+    } else {
+      usage_rollup();
+      return 2;
+    }
+  }
+  if (!interval_ms || !window_s || r.burst > ROLL_MAX_BURST || !r.nregs) {
+    usage_rollup();
+    return 2;
+  }
+  r.window_ms = (int64_t) window_s * 1000;
+
+  if (r.burst && !(r.ring = calloc(r.burst, sizeof r.ring[0]))) {
+    perror("calloc");
+    return 1;
+  }
+  for (int i = 0; i < r.nregs; i++)
+    roll_reset(&r.st[i]);
+  pmbus_get_vout_mode_exp(fd, &r.exp5);
+
+  struct sigaction sa = { .sa_handler = roll_on_signal };
+  struct sigaction old_int, old_term;
+
+  sigemptyset(&sa.sa_mask);
+  sigaction(SIGINT, &sa, &old_int);
+  sigaction(SIGTERM, &sa, &old_term);
+
+  int64_t period_us = (int64_t) interval_ms * 1000;
+  int64_t next = pmbus_now_us();
+
+  for (long n = 0; !roll_stop && (count <= 0 || n < count); n++) {
+    pmbus_sleep_until_us(next);
+    if (roll_stop)
+      break;
+
+    struct roll_row row = { .t_ms = pmbus_wall_ms() };
+    for (int i = 0; i < r.nregs; i++) {
+      int w = pmbus_rd_word(fd, r.regs[i]);
+      row.v[i] = w < 0 ? NAN : pmbus_reg_to_units(r.regs[i], (uint16_t) w, r.exp5);
+    }
+    roll_sample(&r, &row);
+
+    /* a whole period behind: skip ahead rather than burst reads to catch up */
+    next += period_us;
+    int64_t now = pmbus_now_us();
+    if (now > next + period_us)
+      next = now;
+  }
+
+  if (r.event)
+    emit_event(&r);
+  if (r.window_idx >= 0)
+    emit_window(&r);
+
+  sigaction(SIGINT, &old_int, NULL);
+  sigaction(SIGTERM, &old_term, NULL);
+  free(r.ring);
+
+  return 0;
+}
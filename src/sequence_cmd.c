@@ -0,0 +1,489 @@
+/* SPDX-License-Identifier: AGPL-3.0-or-later */
+#define _POSIX_C_SOURCE 200809L
+
+#include "pmbus_io.h"
+#include "pmbus_regs.h"
+#include "decoders.h"
+#include "util_json.h"
+
+#include <jansson.h>
+#include <sys/timerfd.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/*
+ * Multi-rail sequencing: OPERATION on/off across many devices at fixed offsets from a common
+ * start, e.g.
+ *
+ *   { "on_fault": "rollback",
+ *     "rails": [ { "name": "vcore", "device": "/dev/i2c-1:0x40", "up_ms": 0,  "down_ms": 10 },
+ *                { "name": "vio",   "device": "/dev/i2c-1:0x41", "up_ms": 5,  "down_ms": 5 },
+ *                { "name": "vddr",  "device": "/dev/i2c-2:0x20", "up_ms": 10, "down_ms": 0 } ] }
+ *
+ * All device state (OPERATION, TON/TOFF timing) is read before the start, so the timeline only
+ * carries the OPERATION writes and the STATUS_WORD polls. Deadlines are absolute on
+ * CLOCK_MONOTONIC through one timerfd: a late write does not shift the ones after it.
+ */
+
+#define SEQ_LEAD_US 2000              /* start offset: first write lands on schedule */
+#define SEQ_DEFAULT_POLL_MS 1
+#define SEQ_TIMEOUT_MARGIN_MS 50      /* added to TON_DELAY + TON_MAX_FAULT_LIMIT */
+#define SEQ_DEFAULT_TIMEOUT_MS 1000   /* TON_MAX_FAULT_LIMIT 0 (disabled) or unreadable */
+#define SEQ_OPERATION_ON 0x80
+
+#define STATUS_WORD_VOUT BIT(15)
+#define STATUS_WORD_POWER_GOOD_N BIT(11)
+#define STATUS_WORD_OFF BIT(6)
+#define STATUS_VOUT_TON_MAX_FAULT BIT(2)
+
+enum seq_state : uint8_t {
+  SEQ_IDLE,                     /* not issued yet */
+  SEQ_PENDING,                  /* OPERATION written, waiting for STATUS_WORD */
+  SEQ_DONE,                     /* power good (up) / off (down) */
+  SEQ_TON_MAX_FAULT,
+  SEQ_TIMEOUT,
+  SEQ_ERROR,                    /* OPERATION write failed */
+};
+
+static const char *const seq_state_names[] = {
+  [SEQ_IDLE] = "skipped",
+  [SEQ_PENDING] = "pending",
+  [SEQ_DONE] = "done",
+  [SEQ_TON_MAX_FAULT] = "ton_max_fault",
+  [SEQ_TIMEOUT] = "timeout",
+  [SEQ_ERROR] = "error",
+};
+
+struct seq_rail {
+  const char *name;
+  char dev[300];
+  int fd;
+  uint8_t op;                   /* OPERATION before the sequence, margin bits kept */
+  int64_t at_us;                /* offset from start */
+  int64_t timeout_us;           /* from the write to power good / off */
+  int64_t issued_us;            /* absolute, 0 if not issued */
+  int64_t done_us;
+  int status_word;              /* last STATUS_WORD read, -1 if none */
+  int nack;                     /* failed STATUS_WORD reads */
+  enum seq_state state;
+  bool rolled_back;
+};
+
+struct seq {
+  struct seq_rail *r;
+  int n;
+  bool up;
+  bool rollback;
+  int64_t poll_us;
+};
+
+static void
+usage_sequence(void) {
+  fprintf(stderr,
+"sequence up|down FILE.json [--on-fault abort|rollback] [--poll-ms N]\n"
+"Notes:\n"
+"  FILE: {\"on_fault\": ..., \"rails\": [{\"name\", \"device\": \"BUS:ADDR\", \"up_ms\", \"down_ms\",\n"
+"         \"timeout_ms\"}, ...]}; down_ms defaults to the reverse of up_ms.\n"
+"  up: a TON_MAX_FAULT or power-good timeout stops the sequence; with rollback (default)\n"
+"      the rails already turned on are turned off again, last on first off.\n"
+"  down: never stops early, every rail is turned off.\n"
+  );
+}
+
+/* TON/TOFF words are plain milliseconds (see the register table), -1 on error */
+static double
+seq_reg_ms(int fd, uint8_t cmd) {
+  int w = pmbus_reg_rd(fd, cmd);
+
+  return w >= 0 ? pmbus_reg_to_units(cmd, (uint16_t) w, 0) : -1.0;
+}
+
+/* timeout for one rail: explicit, else what the device itself allows before it faults */
+static int64_t
+seq_timeout_us(const struct seq_rail *r, bool up, json_t *explicit) {
+  if (json_is_number(explicit))
+    return (int64_t) (json_number_value(explicit) * 1000.0);
+
+  double delay = seq_reg_ms(r->fd, up ? PMBUS_TON_DELAY : PMBUS_TOFF_DELAY);
+  double ramp = seq_reg_ms(r->fd, up ? PMBUS_TON_MAX_FAULT_LIMIT : PMBUS_TOFF_FALL);
+  if (!(ramp > 0))
+    return SEQ_DEFAULT_TIMEOUT_MS * 1000;
+
+  return (int64_t) (((delay > 0 ? delay : 0) + ramp + SEQ_TIMEOUT_MARGIN_MS) * 1000.0);
+}
+
+static int
+seq_load(const char *path, struct seq *s, json_t **root_out) {
+  json_error_t err;
+  json_t *root = json_load_file(path, 0, &err);
+
+  if (!root) {
+    fprintf(stderr, "%s:%d: %s\n", path, err.line, err.text);
+    return -1;
+  }
+  *root_out = root;
+
+  json_t *rails = json_object_get(root, "rails");
+  json_t *pol = json_object_get(root, "on_fault");
+  if (!json_is_array(rails) || !json_array_size(rails)) {
+    fprintf(stderr, "%s: \"rails\" must be a non-empty array\n", path);
+    return -1;
+  }
+  if (json_is_string(pol))
+    s->rollback = strcmp(json_string_value(pol), "abort") != 0;
+
+  s->n = (int) json_array_size(rails);
+  s->r = calloc((size_t) s->n, sizeof s->r[0]);
+  for (int k = 0; k < s->n; k++)
+    s->r[k].fd = -1;
+
+  int64_t max_up = 0;
+  size_t i;
+  json_t *e;
+
+  json_array_foreach(rails, i, e) {
+    json_t *up = json_object_get(e, "up_ms");
+    if (json_is_number(up) && json_number_value(up) * 1000.0 > (double) max_up)
+      max_up = (int64_t) (json_number_value(up) * 1000.0);
+  }
+
+  json_array_foreach(rails, i, e) {
+    struct seq_rail *r = &s->r[i];
+    const char *dev = json_string_value(json_object_get(e, "device"));
+    json_t *up = json_object_get(e, "up_ms");
+    json_t *down = json_object_get(e, "down_ms");
+    const char *bus;
+    int addr;
+
+    r->status_word = -1;
+    r->name = json_string_value(json_object_get(e, "name"));
+    if (!dev || strlen(dev) >= sizeof r->dev) {
+      fprintf(stderr, "%s: rail %zu: \"device\": \"BUS:ADDR\" required\n", path, i);
+      return -1;
+    }
+    snprintf(r->dev, sizeof r->dev, "%s", dev);
+    if (!r->name)
+      r->name = r->dev;
+
+    char *copy = strdup(dev);
+    if (pmbus_parse_dev(copy, &bus, &addr) < 0) {
+      fprintf(stderr, "%s: rail %zu: bad device '%s'\n", path, i, dev);
+      free(copy);
+      return -1;
+    }
+
+    /* down_ms defaults to the mirror image of up_ms: first on, last off */
+    int64_t up_us = json_is_number(up) ? (int64_t) (json_number_value(up) * 1000.0) : 0;
+    r->at_us = s->up ? up_us :
+               json_is_number(down) ? (int64_t) (json_number_value(down) * 1000.0) : max_up - up_us;
+    if (r->at_us < 0) {
+      fprintf(stderr, "%s: rail %s: negative offset\n", path, r->name);
+      free(copy);
+      return -1;
+    }
+
+    r->fd = pmbus_open(bus, addr);
+    free(copy);
+    if (r->fd < 0) {
+      perror(r->dev);
+      return -1;
+    }
+
+    int op = pmbus_rd_byte(r->fd, PMBUS_OPERATION);
+    if (op < 0) {
+      fprintf(stderr, "%s: OPERATION: %s\n", r->dev, strerror(errno));
+      return -1;
+    }
+    r->op = (uint8_t) op;
+    r->timeout_us = seq_timeout_us(r, s->up, json_object_get(e, "timeout_ms"));
+  }
+
+  return 0;
+}
+
+static int
+seq_issue(struct seq_rail *r, bool on) {
+  uint8_t op = on ? (uint8_t) (r->op | SEQ_OPERATION_ON) : (uint8_t) (r->op & ~SEQ_OPERATION_ON);
+
+  return pmbus_wr_byte(r->fd, PMBUS_OPERATION, op);
+}
+
+/* one STATUS_WORD read of a pending rail; STATUS_VOUT only when the VOUT summary bit is set */
+static void
+seq_check(struct seq_rail *r, bool up, int64_t now) {
+  int sw = pmbus_rd_word(r->fd, PMBUS_STATUS_WORD);
+
+  if (sw < 0) {
+    r->nack++;
+  } else {
+    r->status_word = sw;
+    if (up && (sw & STATUS_WORD_VOUT)) {
+      int sv = pmbus_rd_byte(r->fd, PMBUS_STATUS_VOUT);
+      if (sv >= 0 && (sv & STATUS_VOUT_TON_MAX_FAULT)) {
+        r->state = SEQ_TON_MAX_FAULT;
+        r->done_us = now;
+        return;
+      }
+    }
+    if (up ? !(sw & STATUS_WORD_POWER_GOOD_N) : (sw & STATUS_WORD_OFF) != 0) {
+      r->state = SEQ_DONE;
+      r->done_us = now;
+      return;
+    }
+  }
+
+  if (now - r->issued_us > r->timeout_us) {
+    r->state = SEQ_TIMEOUT;
+    r->done_us = now;
+  }
+}
+
+/* everything that was turned on goes off again, in reverse issue order, as fast as the bus allows */
+static void
+seq_rollback(struct seq *s) {
+  int *ord = malloc((size_t) s->n * sizeof ord[0]);
+  int k = 0;
+
+  for (int i = 0; i < s->n; i++)
+    if (s->r[i].issued_us)
+      ord[k++] = i;
+  for (int i = 1; i < k; i++)
+    for (int j = i; j > 0 && s->r[ord[j - 1]].issued_us > s->r[ord[j]].issued_us; j--) {
+      int t = ord[j];
+      ord[j] = ord[j - 1];
+      ord[j - 1] = t;
+    }
+
+  for (int i = k - 1; i >= 0; i--)
+    s->r[ord[i]].rolled_back = seq_issue(&s->r[ord[i]], false) == 0;
+
+  free(ord);
+}
+
+static int
+seq_arm(int tfd, int64_t t_us) {
+  struct itimerspec its = {
+    .it_value = { .tv_sec = t_us / 1000000, .tv_nsec = (long) (t_us % 1000000) * 1000L },
+  };
+  uint64_t expirations;
+
+  if (timerfd_settime(tfd, TFD_TIMER_ABSTIME, &its, NULL) < 0)
+    return -1;
+  while (read(tfd, &expirations, sizeof expirations) < 0)
+    if (errno != EINTR)
+      return -1;
+
+  return 0;
+}
+
+static int
+seq_next_rail(const struct seq *s) {
+  int best = -1;
+
+  for (int i = 0; i < s->n; i++)
+    if (s->r[i].state == SEQ_IDLE && (best < 0 || s->r[i].at_us < s->r[best].at_us))
+      best = i;
+
+  return best;
+}
+
+/*
+ * Event loop: the next deadline is the earlier of the next scheduled write and the next poll
+ * of the rails still pending. Each poll reads STATUS_WORD of every pending rail back to back.
+ * Returns the index of the rail that stopped the sequence, -1 when it ran through, or -2
+ * if the timer failed.
+ */
+static int
+seq_run(struct seq *s, int64_t t0) {
+  int tfd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+  int64_t next_poll = 0;
+  int pending = 0;
+  int failed = -1;
+
+  if (tfd < 0) {
+    perror("timerfd_create");
+    return -2;
+  }
+
+  for (;;) {
+    int nx = failed < 0 ? seq_next_rail(s) : -1;
+    if (nx < 0 && !pending)
+      break;
+
+    int64_t deadline = nx >= 0 ? t0 + s->r[nx].at_us : next_poll;
+    if (pending && next_poll < deadline)
+      deadline = next_poll;
+    if (seq_arm(tfd, deadline) < 0) {
+      perror("timerfd");
+      failed = -2;
+      break;
+    }
+
+    int64_t now = pmbus_now_us();
+    for (; nx >= 0 && t0 + s->r[nx].at_us <= now; nx = seq_next_rail(s)) {
+      struct seq_rail *r = &s->r[nx];
+
+      r->issued_us = pmbus_now_us();
+      if (seq_issue(r, s->up) < 0) {
+        r->state = SEQ_ERROR;
+        r->issued_us = 0;
+        if (s->up) {
+          failed = nx;
+          break;
+        }
+        continue;
+      }
+      r->state = SEQ_PENDING;
+      if (!pending++)
+        next_poll = r->issued_us + s->poll_us;
+    }
+
+    now = pmbus_now_us();
+    if (pending && now >= next_poll) {
+      for (int i = 0; i < s->n; i++) {
+        struct seq_rail *r = &s->r[i];
+
+        if (r->state != SEQ_PENDING)
+          continue;
+        seq_check(r, s->up, pmbus_now_us());
+        if (r->state == SEQ_PENDING)
+          continue;
+        pending--;
+        if (s->up && r->state != SEQ_DONE && failed < 0)
+          failed = i;
+      }
+      next_poll = now + s->poll_us;
+    }
+
+    if (failed >= 0)
+      break;
+  }
+
+  close(tfd);
+
+  /* a timer failure mid power-up leaves rails on just like a rail fault does */
+  if (failed != -1 && s->up && s->rollback)
+    seq_rollback(s);
+
+  return failed;
+}
+
+static double
+seq_ms(int64_t us) {
+  return (double) us / 1000.0;
+}
+
+static void
+seq_print(const struct seq *s, int64_t t0, int failed, int pretty) {
+  json_t *o = json_object();
+  json_t *arr = json_array();
+  int64_t end = t0;
+  bool ok = failed == -1;
+
+  for (int i = 0; i < s->n; i++) {
+    const struct seq_rail *r = &s->r[i];
+    json_t *e = json_object();
+
+    json_object_set_new(e, "name", json_string(r->name));
+    json_object_set_new(e, "device", json_string(r->dev));
+    json_object_set_new(e, "state", json_string(seq_state_names[r->state]));
+    json_object_set_new(e, "at_ms", json_real(seq_ms(r->at_us)));
+    if (r->issued_us) {
+      json_object_set_new(e, "issued_ms", json_real(seq_ms(r->issued_us - t0)));
+      json_object_set_new(e, "late_us", json_integer((json_int_t) (r->issued_us - t0 - r->at_us)));
+    }
+    if (r->done_us) {
+      json_object_set_new(e, s->up ? "power_good_ms" : "off_ms", r->state == SEQ_DONE ?
+                          json_real(seq_ms(r->done_us - r->issued_us)) : json_null());
+      if (r->done_us > end)
+        end = r->done_us;
+    }
+    if (r->status_word >= 0) {
+      char w[STATUS_WORD_FLAGS_MAX];
+
+      status_word_flags((uint16_t) r->status_word, w, sizeof w);
+      json_object_set_new(e, "status_word", json_string(w));
+    }
+    if (r->nack)
+      json_object_set_new(e, "nack", json_integer(r->nack));
+    if (r->rolled_back)
+      json_object_set_new(e, "rolled_back", json_true());
+    if (r->state != SEQ_DONE)
+      ok = false;
+    json_array_append_new(arr, e);
+  }
+
+  json_object_set_new(o, "direction", json_string(s->up ? "up" : "down"));
+  json_object_set_new(o, "ok", json_boolean(ok));
+  json_object_set_new(o, "on_fault", json_string(s->rollback ? "rollback" : "abort"));
+  json_object_set_new(o, "stopped_by", failed >= 0 ? json_string(s->r[failed].name) : json_null());
+  json_object_set_new(o, "total_ms", json_real(seq_ms(end - t0)));
+  json_object_set_new(o, "rails", arr);
+
+  json_print_or_pretty(o, pretty);
+}
+
+int
+cmd_sequence(int fd, int argc, char *const *argv, int pretty) {
+  struct seq s = { .rollback = true, .poll_us = SEQ_DEFAULT_POLL_MS * 1000 };
+  const char *policy = NULL;
+  long poll_ms = -1;
+
+  (void) fd;                    /* every rail names its own device */
+
+  if (argc < 2 || (strcmp(argv[0], "up") && strcmp(argv[0], "down"))) {
+    usage_sequence();
+    return 2;
+  }
+  s.up = !strcmp(argv[0], "up");
+
+  for (int i = 2; i < argc; i++) {
+    if (!strcmp(argv[i], "--on-fault") && i + 1 < argc)
+      policy = argv[++i];
+    else if (!strcmp(argv[i], "--poll-ms") && i + 1 < argc)
+      poll_ms = strtol(argv[++i], NULL, 0);
+    else {
+      usage_sequence();
+      return 2;
+    }
+  }
+  if ((policy && strcmp(policy, "abort") && strcmp(policy, "rollback")) || (poll_ms >= 0 && poll_ms < 1)) {
+    usage_sequence();
+    return 2;
+  }
+
+  json_t *root = NULL;
+  int rc = 0;
+
+  if (seq_load(argv[1], &s, &root) < 0) {
+    rc = 2;
+    goto out;
+  }
+  if (policy)
+    s.rollback = !strcmp(policy, "rollback");
+  if (poll_ms > 0)
+    s.poll_us = poll_ms * 1000;
+
+  int64_t t0 = pmbus_now_us() + SEQ_LEAD_US;
+  int failed = seq_run(&s, t0);
+
+  /* after a timer failure too: the report shows what was issued and rolled back */
+  seq_print(&s, t0, failed, pretty);
+  if (failed == -2)
+    rc = 1;
+  for (int i = 0; i < s.n; i++)
+    if (s.r[i].state != SEQ_DONE)
+      rc = 1;
+
+out:
+  for (int i = 0; i < s.n; i++)
+    pmbus_close(s.r[i].fd);
+  free(s.r);
+  json_decref(root);
+
+  return rc;
+}
@@ -1,41 +1,191 @@
 /* SPDX-License-Identifier: AGPL-3.0-or-later */
 
 #include "pmbus_io.h"
+#include "pmbus_regs.h"
 #include "decoders.h"
+#include "mfr_hrr.h"
 #include "util_json.h"
 #include <jansson.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
 
-int
-cmd_status(int fd, int argc, char *const *argv, int pretty) {
-  (void)argc;
-  (void)argv;
+/* read order; also the order of the read-and-clear group */
+static const struct status_def {
+  const char *name;
+  uint8_t reg;
+  uint8_t len;
+  enum status_reg sreg;             /* --compact table; unused for STATUS_WORD */
+  json_t *(*decode)(uint8_t v);     /* NULL: STATUS_WORD */
+} STATUS_DEFS[] = {
+  { "STATUS_BYTE",        PMBUS_STATUS_BYTE,        1, SREG_BYTE,        decode_status_byte },
+  { "STATUS_WORD",        PMBUS_STATUS_WORD,        2, SREG_COUNT,       NULL },
+  { "STATUS_VOUT",        PMBUS_STATUS_VOUT,        1, SREG_VOUT,        decode_status_vout },
+  { "STATUS_IOUT",        PMBUS_STATUS_IOUT,        1, SREG_IOUT,        decode_status_iout },
+  { "STATUS_INPUT",       PMBUS_STATUS_INPUT,       1, SREG_INPUT,       decode_status_input },
+  { "STATUS_TEMPERATURE", PMBUS_STATUS_TEMPERATURE, 1, SREG_TEMPERATURE, decode_status_temperature },
+  { "STATUS_CML",         PMBUS_STATUS_CML,         1, SREG_CML,         decode_status_cml },
+};
+
+#define N_STATUS_DEFS (sizeof STATUS_DEFS / sizeof STATUS_DEFS[0])
+#define SD_WORD 1                   /* STATUS_DEFS[] slot of STATUS_WORD */
+
+static json_t *
+word_json(uint16_t w, bool compact) {
+  char wbuf[STATUS_WORD_FLAGS_MAX * 2];
+
+  if (!compact)
+    return decode_status_word(w);
+  status_word_flags(w, wbuf, sizeof wbuf);
 
+  return json_string(wbuf);
+}
+
+/*
+ * Registers that failed to read (<0) are left out. --compact: active flag names only, "A|B",
+ * from the precomputed tables.
+ */
+static json_t *
+status_json(const int v[N_STATUS_DEFS], bool compact) {
   json_t *o = json_object();
 
-  int sb = pmbus_rd_byte(fd, PMBUS_STATUS_BYTE);
-  int sw = pmbus_rd_word(fd, PMBUS_STATUS_WORD);
-  int sv = pmbus_rd_byte(fd, PMBUS_STATUS_VOUT);
-  int si = pmbus_rd_byte(fd, PMBUS_STATUS_IOUT);
-  int siu = pmbus_rd_byte(fd, PMBUS_STATUS_INPUT);
-  int st = pmbus_rd_byte(fd, PMBUS_STATUS_TEMPERATURE);
-  int sc = pmbus_rd_byte(fd, PMBUS_STATUS_CML);
-
-  if (sb >= 0)
-    json_object_set_new(o, "STATUS_BYTE", decode_status_byte((uint8_t) sb));
-  if (sw >= 0)
-    json_object_set_new(o, "STATUS_WORD", decode_status_word((uint16_t) sw));
-  if (sv >= 0)
-    json_object_set_new(o, "STATUS_VOUT", decode_status_vout((uint8_t) sv));
-  if (si >= 0)
-    json_object_set_new(o, "STATUS_IOUT", decode_status_iout((uint8_t) si));
-  if (siu >= 0)
-    json_object_set_new(o, "STATUS_INPUT", decode_status_input((uint8_t) siu));
-  if (st >= 0)
-    json_object_set_new(o, "STATUS_TEMPERATURE", decode_status_temperature((uint8_t) st));
-  if (sc >= 0)
-    json_object_set_new(o, "STATUS_CML", decode_status_cml((uint8_t) sc));
+  for (size_t i = 0; i < N_STATUS_DEFS; i++) {
+    const struct status_def *d = &STATUS_DEFS[i];
+
+    if (v[i] < 0)
+      continue;
+    if (!d->decode)
+      json_object_set_new(o, d->name, word_json((uint16_t) v[i], compact));
+    else if (compact)
+      json_object_set_new(o, d->name, json_string(status_flags(d->sreg, (uint8_t) v[i])));
+    else
+      json_object_set_new(o, d->name, d->decode((uint8_t) v[i]));
+  }
+
+  return o;
+}
+
+static int
+status_rd(int fd, uint8_t reg, uint8_t len) {
+  return len == 2 ? pmbus_rd_word(fd, reg) : pmbus_rd_byte(fd, reg);
+}
+
+/* MFR_SPECIAL_OPTIONS says the device wants PEC, which the I2C_RDWR group does not add */
+static bool
+status_pec_required(int fd, unsigned model) {
+  if (!pmbus_reg_supported(MFR_SPECIAL_OPTIONS, model))
+    return false;
+
+  int v = pmbus_rd_byte(fd, MFR_SPECIAL_OPTIONS);
+
+  return v >= 0 && (v & MFR_SPECIAL_OPTIONS_PEC);
+}
+
+/*
+ * Read every STATUS register and CLEAR_FAULTS as one I2C_RDWR group. CLEAR_FAULTS is its
+ * last message, so its STOP comes right after it (the device acts on a write at the STOP),
+ * and no other master can get between the record and the clear. STATUS_WORD is then read
+ * again in a transfer of its own. Decoding waits until all of it is done.
+ *
+ * The separate SMBus transfers are used instead on SMBus-only adapters, when the device
+ * requires PEC, and when the group was NACKed: the adapter stops at the NACK, so the clear
+ * was not accepted. Any other failure of the group is an error: the clear may have happened.
+ */
+static int
+status_clear(int fd, bool compact, int pretty) {
+  struct pmbus_op x[N_STATUS_DEFS + 1];
+  int slot[N_STATUS_DEFS], v[N_STATUS_DEFS];
+  unsigned model = pmbus_model(fd);
+  int n = 0;
+
+  for (size_t i = 0; i < N_STATUS_DEFS; i++) {
+    v[i] = -1;
+    slot[i] = -1;
+    /* one NACK would fail the whole group */
+    if (pmbus_reg_supported(STATUS_DEFS[i].reg, model)) {
+      slot[i] = n;
+      x[n++] = (struct pmbus_op) { .cmd = STATUS_DEFS[i].reg, .len = STATUS_DEFS[i].len };
+    }
+  }
+  x[n++] = (struct pmbus_op) { .cmd = PMBUS_CLEAR_FAULTS };
+
+  bool pec = status_pec_required(fd, model);
+  bool batched = !pec && pmbus_ops_burst(fd, x, n) == 0;
+  if (!batched) {
+    if (!pec && errno != EOPNOTSUPP && errno != ENXIO && errno != EREMOTEIO) {
+      perror("status --clear");
+      return 1;
+    }
+    for (int k = 0; k < n; k++) {
+      if (!x[k].len && pmbus_send_byte(fd, x[k].cmd) < 0) {
+        perror("CLEAR_FAULTS");
+        return 1;
+      }
+      if (x[k].len)
+        x[k].val = status_rd(fd, x[k].cmd, x[k].len);
+    }
+  }
+  int after = pmbus_rd_word(fd, PMBUS_STATUS_WORD);
+
+  for (size_t i = 0; i < N_STATUS_DEFS; i++)
+    if (slot[i] >= 0)
+      v[i] = x[slot[i]].val;
+
+  json_t *o = status_json(v, compact);
+  json_object_set_new(o, "batched", json_boolean(batched));
+  if (pec)
+    json_object_set_new(o, "pec_required", json_true());
+
+  int before = v[SD_WORD];
+  json_t *a = json_object();
+  if (after >= 0)
+    json_object_set_new(a, "STATUS_WORD", word_json((uint16_t) after, compact));
+  json_object_set_new(o, "after", a);
+
+  /* latched: gone with the clear; present: still (or again) set after it */
+  if (before >= 0 && after >= 0) {
+    char buf[STATUS_WORD_FLAGS_MAX * 2];
+
+    status_word_flags((uint16_t) (before & ~after), buf, sizeof buf);
+    json_object_set_new(o, "latched", json_string(buf));
+    status_word_flags((uint16_t) after, buf, sizeof buf);
+    json_object_set_new(o, "present", json_string(buf));
+  }
 
   json_print_or_pretty(o, pretty);
 
   return 0;
 }
+
+static void
+usage_status(void) {
+  fprintf(stderr, "status [--compact] [--clear]\n");
+}
+
+int
+cmd_status(int fd, int argc, char *const *argv, int pretty) {
+  bool compact = false, clear = false;
+
+  for (int i = 0; i < argc; i++) {
+    if (!strcmp(argv[i], "--compact"))
+      compact = true;
+    else if (!strcmp(argv[i], "--clear"))
+      clear = true;
+    else {
+      usage_status();
+      return 2;
+    }
+  }
+
+  if (clear)
+    return status_clear(fd, compact, pretty);
+
+  int v[N_STATUS_DEFS];
+
+  for (size_t i = 0; i < N_STATUS_DEFS; i++)
+    v[i] = status_rd(fd, STATUS_DEFS[i].reg, STATUS_DEFS[i].len);
+  json_print_or_pretty(status_json(v, compact), pretty);
+
+  return 0;
+}
@@ -2,6 +2,7 @@
 
 #include "pmbus_io.h"
 #include "util_json.h"
+#include "util_lin.h"
 
 #include <jansson.h>
 #include <ctype.h>
@@ -12,89 +13,6 @@
 #include <stdlib.h>
 #include <string.h>
 
-/*
- * Linear11: 5-bit signed exponent (E), 11-bit signed mantissa (Y), value = Y * 2^E
- *   raw[15:11] = E (two's complement), raw[10:0] = Y (two's complement)
- */
-
-static inline long
-lround_compat(double d) {
-  return (long) ((d >= 0.0) ? (d + 0.5) : (d - 0.5));
-}
-
-static inline int32_t
-sign_extend(int32_t v, unsigned bits) {
-  int32_t m = 1u << (bits - 1);
-
-  v = v & ((1u << bits) - 1);
-  return (v ^ m) - m;
-}
-
-static double
-lin11_to_double(uint16_t raw) {
-  int8_t E = (int8_t) sign_extend((raw >> 11) & 0x1F, 5);
-  int16_t Y = (int16_t) sign_extend(raw & 0x7FF, 11);
-
-  double val = (double) Y;
-  if (E >= 0) {
-    val *= (double) (1u << E);
-  } else {
-    val /= (double) (1u << (-E));
-  }
-
-  return val;
-}
-
-static uint16_t
-double_to_lin11(double v) {
-  if (v == 0.0)
-    return 0;
-
-  /* Choose E in [-16..15] so Y fits in [-1024..1023] with best resolution. */
-  int bestE = 0;
-  long bestY = 0;
-  long bestAbsY = -1;
-
-  for (int E = -16; E <= 15; ++E) {
-    double scaled = (E >= 0) ? (v / (double) (1u << E)) : (v * (double) (1u << (-E)));
-    long Y = lround_compat(scaled);
-    if (Y < -1024 || Y > 1023)
-      continue;
-    long a = (Y >= 0) ? Y : -Y;
-    if (a > bestAbsY) {
-      bestAbsY = a;
-      bestE = E;
-      bestY = Y;
-      if (bestAbsY == 1023)
-        break;
-    }
-  }
-
-  /* If nothing fit (huge magnitude), clamp using the nearest legal E. */
-  if (bestAbsY < 0) {
-    /* pick E to bring into range */
-    int E = 0;
-    long Y = 0;
-    for (E = 15; E >= -16; --E) {
-      double scaled = (E >= 0) ? (v / (double) (1u << E)) : (v * (double) (1u << (-E)));
-      Y = lround_compat(scaled);
-      if (Y >= -1024 && Y <= 1023)
-        break;
-    }
-    if (Y < -1024)
-      Y = -1024;
-    if (Y > 1023)
-      Y = 1023;
-    bestE = E;
-    bestY = Y;
-  }
-
-  uint16_t Ebits = (uint16_t) (bestE & 0x1F);
-  uint16_t Ybits = (uint16_t) (bestY & 0x7FF);
-
-  return (uint16_t) ((Ebits << 11) | Ybits);
-}
-
 /* Parse temperatures: accepts:  "85", "85C", "-40C", "358K", "185F" (C default) */
 static int
 parse_temp_celsius(const char *s, double *outC) {
@@ -147,9 +65,9 @@ put_temp_limit(json_t *dst, const char *key, int fd, uint8_t cmd) {
 
   if (w >= 0) {
     uint16_t raw = (uint16_t) w;
-    double C = lin11_to_double(raw);
-    int8_t E = (int8_t) sign_extend((raw >> 11) & 0x1F, 5);
-    int16_t Y = (int16_t) sign_extend(raw & 0x7FF, 11);
+    double C = lin11_to_units(raw);
+    int8_t E = lin11_exponent(raw);
+    int16_t Y = lin11_mantissa(raw);
 
     json_object_set_new(o, "raw", json_integer(raw));
     json_object_set_new(o, "C", json_real(C));
@@ -169,9 +87,9 @@ put_temp_read(json_t *dst, const char *key, int fd, uint8_t cmd) {
 
   if (w >= 0) {
     uint16_t raw = (uint16_t) w;
-    double C = lin11_to_double(raw);
-    int8_t E = (int8_t) sign_extend((raw >> 11) & 0x1F, 5);
-    int16_t Y = (int16_t) sign_extend(raw & 0x7FF, 11);
+    double C = lin11_to_units(raw);
+    int8_t E = lin11_exponent(raw);
+    int16_t Y = lin11_mantissa(raw);
 
     json_object_set_new(o, "raw", json_integer(raw));
     json_object_set_new(o, "C", json_real(C));
@@ -236,7 +154,7 @@ write_one_limit(int fd, const char *label, uint8_t cmd, const char *val_s, json_
     fprintf(stderr, "bad value for %s\n", label);
     return 2;
   }
-  uint16_t raw = double_to_lin11(C);
+  uint16_t raw = units_to_lin11(C);
   int rc = pmbus_wr_word(fd, cmd, raw);
 
   json_t *wo = json_object();
@@ -247,7 +165,7 @@ write_one_limit(int fd, const char *label, uint8_t cmd, const char *val_s, json_
   int rbw = pmbus_rd_word(fd, cmd);
   if (rbw >= 0) {
     uint16_t r = (uint16_t) rbw;
-    double C2 = lin11_to_double(r);
+    double C2 = lin11_to_units(r);
     json_t *rbo = json_object();
     json_object_set_new(rbo, "C", json_real(C2));
     json_object_set_new(rbo, "raw", json_integer(r));
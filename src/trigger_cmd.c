@@ -0,0 +1,434 @@
+/* SPDX-License-Identifier: AGPL-3.0-or-later */
+#define _POSIX_C_SOURCE 200809L
+
+#include "pmbus_io.h"
+#include "pmbus_regs.h"
+#include "decoders.h"
+#include "mfr_snapshot.h"
+#include "util_json.h"
+
+#include <jansson.h>
+#include <errno.h>
+#include <math.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Trigger capture, like a scope in normal mode: sample continuously into a ring of raw words,
+ * and when a --when condition becomes true, print the --pre samples before it, the trigger
+ * sample and the --post samples after it as one event. MFR_GET_SNAPSHOT is read right at the
+ * trigger, before the post samples, so the device's own record is of the same moment.
+ *
+ * Conditions fire on the edge (false -> true), not while they stay true:
+ *   NAME>V, NAME<V          value of a word register in engineering units
+ *   NAME/s>V, NAME/s<V      rate of change between consecutive samples, units per second
+ *   STATUS_REG[:BIT]        a STATUS bit (any named bit of the register without :BIT) sets
+ */
+
+#define TRIG_DEFAULT_INTERVAL_MS 10
+#define TRIG_DEFAULT_PRE 100
+#define TRIG_DEFAULT_POST 100
+#define TRIG_MAX_SAMPLES 100000
+#define TRIG_MAX_COLS 16
+#define TRIG_MAX_CONDS 8
+#define TRIG_SPEC_LEN 64
+#define TRIG_DEFAULT_REGS "READ_VOUT,READ_IOUT,READ_TEMPERATURE_1"
+
+static volatile sig_atomic_t trig_stop;
+
+static void
+trig_on_signal(int sig) {
+  (void) sig;
+  trig_stop = 1;
+}
+
+static void
+usage_trigger(void) {
+  fprintf(stderr,
+"trigger --when COND [--when COND]... [--regs NAME,...] [--interval MS]\n"
+"        [--pre N] [--post N] [--holdoff MS] [--events N] [--count N] [--no-snapshot]\n"
+"COND:\n"
+"  NAME>V | NAME<V         value, e.g. READ_IOUT>25 or READ_VOUT<0.95\n"
+"  NAME/s>V | NAME/s<V     rate of change per second, e.g. READ_TEMPERATURE_1/s>5\n"
+"  STATUS_REG[:BIT]        STATUS bit sets, e.g. STATUS_VOUT:VOUT_UV_FAULT or STATUS_IOUT\n"
+"Notes:\n"
+"  --regs defaults to " TRIG_DEFAULT_REGS "; condition registers are added.\n"
+"  Conditions fire on the false -> true edge. MFR_GET_SNAPSHOT is read at the trigger.\n"
+  );
+}
+
+enum trig_kind : uint8_t {
+  TRIG_VALUE,
+  TRIG_RATE,
+  TRIG_STATUS,
+};
+
+struct trig_cond {
+  char spec[TRIG_SPEC_LEN];
+  enum trig_kind kind;
+  int col;
+  bool below;
+  double limit;
+  uint16_t mask;
+  bool was;                     /* true on the previous sample */
+};
+
+/* raw words: decoding waits until an event is printed */
+struct trig_row {
+  int64_t t_ms, t_us;
+  int w[TRIG_MAX_COLS];         /* <0: read failed */
+};
+
+struct trigger {
+  uint8_t cols[TRIG_MAX_COLS];
+  int ncols;
+  struct trig_cond cond[TRIG_MAX_CONDS];
+  int ncond;
+  int exp5;
+
+  struct trig_row *ring;        /* the last --pre rows */
+  unsigned pre, post, ring_len, ring_head;
+  bool have_prev;
+  struct trig_row prev;
+};
+
+static int
+trig_col(struct trigger *t, uint8_t reg) {
+  for (int i = 0; i < t->ncols; i++)
+    if (t->cols[i] == reg)
+      return i;
+  if (t->ncols == TRIG_MAX_COLS) {
+    fprintf(stderr, "trigger: at most %d registers\n", TRIG_MAX_COLS);
+    return -1;
+  }
+  t->cols[t->ncols] = reg;
+
+  return t->ncols++;
+}
+
+static int
+trig_word_col(struct trigger *t, const char *name) {
+  int reg = pmbus_reg_by_name(name);
+
+  if (reg < 0 || pmbus_regs[reg].xfer != XFER_WORD || !(pmbus_regs[reg].flags & REG_R)) {
+    fprintf(stderr, "trigger: %s is not a readable word register\n", name);
+    return -1;
+  }
+
+  return trig_col(t, (uint8_t) reg);
+}
+
+static int
+parse_cond(struct trigger *t, const char *arg) {
+  if (t->ncond == TRIG_MAX_CONDS)
+    return -1;
+
+  struct trig_cond *c = &t->cond[t->ncond];
+  char s[TRIG_SPEC_LEN];
+
+  if ((size_t) snprintf(s, sizeof s, "%s", arg) >= sizeof s)
+    return -1;
+  snprintf(c->spec, sizeof c->spec, "%s", arg);
+
+  char *op = strpbrk(s, "<>");
+  if (!op) {
+    uint8_t reg;
+    if (status_bit_parse(s, &reg, &c->mask) < 0) {
+      fprintf(stderr, "trigger: unknown status bit %s\n", s);
+      return -1;
+    }
+    c->kind = TRIG_STATUS;
+    if ((c->col = trig_col(t, reg)) < 0)
+      return -1;
+    t->ncond++;
+    return 0;
+  }
+
+  char *end = NULL;
+  c->below = *op == '<';
+  *op = '\0';
+  errno = 0;
+  c->limit = strtod(op + 1, &end);
+  if (errno || end == op + 1 || *end != '\0')
+    return -1;
+
+  size_t n = strlen(s);
+  c->kind = TRIG_VALUE;
+  if (n > 2 && !strcmp(s + n - 2, "/s")) {
+    c->kind = TRIG_RATE;
+    s[n - 2] = '\0';
+  }
+  if ((c->col = trig_word_col(t, s)) < 0)
+    return -1;
+  t->ncond++;
+
+  return 0;
+}
+
+static bool
+is_status(uint8_t reg) {
+  return reg >= PMBUS_STATUS_BYTE && reg <= PMBUS_STATUS_CML;
+}
+
+static double
+row_units(const struct trigger *t, const struct trig_row *r, int col) {
+  return r->w[col] < 0 ? NAN : pmbus_reg_to_units(t->cols[col], (uint16_t) r->w[col], t->exp5);
+}
+
+static void
+trig_read(int fd, const struct trigger *t, struct trig_row *r) {
+  r->t_ms = pmbus_wall_ms();
+  r->t_us = pmbus_now_us();
+  for (int i = 0; i < t->ncols; i++)
+    r->w[i] = pmbus_reg_rd(fd, t->cols[i]);
+}
+
+static bool
+cond_now(const struct trigger *t, const struct trig_cond *c, const struct trig_row *r) {
+  switch (c->kind) {
+  case TRIG_STATUS:
+    return r->w[c->col] >= 0 && (r->w[c->col] & c->mask);
+  case TRIG_RATE: {
+    if (!t->have_prev || r->t_us <= t->prev.t_us)
+      return false;
+    double d = row_units(t, r, c->col) - row_units(t, &t->prev, c->col);
+    double rate = d * 1e6 / (double) (r->t_us - t->prev.t_us);
+    return isfinite(rate) && (c->below ? rate < c->limit : rate > c->limit);
+  }
+  case TRIG_VALUE:
+  default: {
+    double v = row_units(t, r, c->col);
+    return isfinite(v) && (c->below ? v < c->limit : v > c->limit);
+  }
+  }
+}
+
+/* index of the first condition that fired on this sample, -1 if none */
+static int
+trig_eval(struct trigger *t, const struct trig_row *r, json_t *fired) {
+  int first = -1;
+
+  for (int k = 0; k < t->ncond; k++) {
+    struct trig_cond *c = &t->cond[k];
+    bool now = cond_now(t, c, r);
+
+    if (now && !c->was) {
+      if (first < 0)
+        first = k;
+      if (fired)
+        json_array_append_new(fired, json_string(c->spec));
+    }
+    c->was = now;
+  }
+  t->prev = *r;
+  t->have_prev = true;
+
+  return first;
+}
+
+static void
+ring_push(struct trigger *t, const struct trig_row *r) {
+  if (!t->pre)
+    return;
+  t->ring[t->ring_head] = *r;
+  t->ring_head = (t->ring_head + 1) % t->pre;
+  if (t->ring_len < t->pre)
+    t->ring_len++;
+}
+
+static json_t *
+row_json(const struct trigger *t, const struct trig_row *r) {
+  json_t *a = json_array();
+
+  json_array_append_new(a, json_integer(r->t_ms));
+  for (int i = 0; i < t->ncols; i++) {
+    if (r->w[i] < 0)
+      json_array_append_new(a, json_null());
+    else if (is_status(t->cols[i]))
+      json_array_append_new(a, json_integer(r->w[i]));
+    else
+      json_array_append_new(a, json_real(row_units(t, r, i)));
+  }
+
+  return a;
+}
+
+/* cycle 0 is the newest record: select it, a snapshot walk may have left an old one selected */
+static json_t *
+snapshot_now(int fd, int exp5) {
+  struct snapshot_rec r;
+  json_t *o = json_object();
+
+  snapshot_fetch(fd, 0, &r);
+  json_object_set_new(o, "cycle", json_integer(r.cycle));
+  if (r.n < 0) {
+    json_object_set_new(o, "error", json_string(strerror(errno)));
+    return o;
+  }
+  json_object_set_new(o, "len", json_integer(r.n));
+  json_add_hex_ascii(o, "hex", r.blk, (size_t) r.n);
+  if (r.n >= 32)
+    json_object_set_new(o, "decoded", decode_snapshot_block(r.blk, r.n, exp5, true));
+
+  return o;
+}
+
+/* header, pre-trigger rows from the ring and the trigger row; post rows are appended later */
+static json_t *
+event_start(struct trigger *t, int k, const struct trig_row *r, json_t *fired) {
+  json_t *o = json_object();
+  json_t *cols = json_array();
+  json_t *rows = json_array();
+
+  json_object_set_new(o, "event", json_string("trigger"));
+  json_object_set_new(o, "when", json_string(t->cond[k].spec));
+  json_object_set_new(o, "t_ms", json_integer(r->t_ms));
+  json_object_set_new(o, "fired", fired);
+
+  json_array_append_new(cols, json_string("t_ms"));
+  for (int i = 0; i < t->ncols; i++)
+    json_array_append_new(cols, json_string(pmbus_regs[t->cols[i]].name));
+  json_object_set_new(o, "columns", cols);
+
+  unsigned first = t->ring_len < t->pre ? 0 : t->ring_head;
+  for (unsigned i = 0; i < t->ring_len; i++)
+    json_array_append_new(rows, row_json(t, &t->ring[(first + i) % t->pre]));
+  json_object_set_new(o, "trigger_index", json_integer(t->ring_len));
+  json_array_append_new(rows, row_json(t, r));
+  json_object_set_new(o, "rows", rows);
+
+  return o;
+}
+
+int
+cmd_trigger(int fd, int argc, char *const *argv, int pretty) {
+  static struct trigger t;
+  char list[512] = TRIG_DEFAULT_REGS;
+  unsigned interval_ms = TRIG_DEFAULT_INTERVAL_MS;
+  unsigned holdoff_ms = 0;
+  long events = 0, count = 0;
+  bool snapshot = true;
+
+  t = (struct trigger) { .pre = TRIG_DEFAULT_PRE, .post = TRIG_DEFAULT_POST };
+
+  /* --regs first: they come before the condition registers in the columns */
+  for (int i = 0; i < argc; i++)
+    if (!strcmp(argv[i], "--regs") && i + 1 < argc &&
+        (size_t) snprintf(list, sizeof list, "%s", argv[i + 1]) >= sizeof list) {
+      usage_trigger();
+      return 2;
+    }
+  for (char *tok = strtok(list, ","); tok; tok = strtok(NULL, ","))
+    if (trig_word_col(&t, tok) < 0)
+      return 2;
+
+  for (int i = 0; i < argc; i++) {
+    if (!strcmp(argv[i], "--regs") && i + 1 < argc)
+      i++;
+    else if (!strcmp(argv[i], "--when") && i + 1 < argc) {
+      if (parse_cond(&t, argv[++i]) < 0) {
+        usage_trigger();
+        return 2;
+      }
+    } else if (!strcmp(argv[i], "--interval") && i + 1 < argc)
+      interval_ms = (unsigned) strtoul(argv[++i], NULL, 0);
+    else if (!strcmp(argv[i], "--pre") && i + 1 < argc)
+      t.pre = (unsigned) strtoul(argv[++i], NULL, 0);
+    else if (!strcmp(argv[i], "--post") && i + 1 < argc)
+      t.post = (unsigned) strtoul(argv[++i], NULL, 0);
+    else if (!strcmp(argv[i], "--holdoff") && i + 1 < argc)
+      holdoff_ms = (unsigned) strtoul(argv[++i], NULL, 0);
+    else if (!strcmp(argv[i], "--events") && i + 1 < argc)
+      events = strtol(argv[++i], NULL, 0);
+    else if (!strcmp(argv[i], "--count") && i + 1 < argc)
+      count = strtol(argv[++i], NULL, 0);
+    else if (!strcmp(argv[i], "--no-snapshot"))
+      snapshot = false;
+    else {
+      usage_trigger();
+      return 2;
+    }
+  }
+  if (!t.ncond || !interval_ms || t.pre > TRIG_MAX_SAMPLES || t.post > TRIG_MAX_SAMPLES) {
+    usage_trigger();
+    return 2;
+  }
+
+  if (t.pre && !(t.ring = calloc(t.pre, sizeof t.ring[0]))) {
+    perror("calloc");
+    return 1;
+  }
+  pmbus_get_vout_mode_exp(fd, &t.exp5);
+
+  struct sigaction sa = { .sa_handler = trig_on_signal };
+  struct sigaction old_int, old_term;
+
+  sigemptyset(&sa.sa_mask);
+  sigaction(SIGINT, &sa, &old_int);
+  sigaction(SIGTERM, &sa, &old_term);
+
+  int64_t period_us = (int64_t) interval_ms * 1000;
+  int64_t next = pmbus_now_us();
+  int64_t armed_at = next;
+  json_t *ev = NULL;
+  unsigned post_left = 0;
+  long nevents = 0;
+
+  for (long n = 0; !trig_stop && (count <= 0 || n < count); n++) {
+    pmbus_sleep_until_us(next);
+    if (trig_stop)
+      break;
+
+    struct trig_row r;
+    trig_read(fd, &t, &r);
+
+    if (ev) {
+      /* conditions keep being tracked so their edges stay correct after the capture */
+      trig_eval(&t, &r, json_object_get(ev, "fired"));
+      json_array_append_new(json_object_get(ev, "rows"), row_json(&t, &r));
+      post_left--;
+    } else {
+      json_t *fired = json_array();
+      int k = trig_eval(&t, &r, fired);
+
+      if (k >= 0 && r.t_us >= armed_at) {
+        ev = event_start(&t, k, &r, fired);
+        if (snapshot)
+          json_object_set_new(ev, "snapshot", snapshot_now(fd, t.exp5));
+        post_left = t.post;
+      } else
+        json_decref(fired);
+    }
+
+    if (ev && !post_left) {
+      json_print_or_pretty(ev, pretty);
+      fflush(stdout);
+      ev = NULL;
+      armed_at = r.t_us + (int64_t) holdoff_ms * 1000;
+      if (events > 0 && ++nevents >= events)
+        break;
+    }
+    ring_push(&t, &r);
+
+    /* a whole period behind: skip ahead rather than burst reads to catch up */
+    next += period_us;
+    int64_t now = pmbus_now_us();
+    if (now > next + period_us)
+      next = now;
+  }
+
+  /* interrupted during the post window: the partial capture is still worth having */
+  if (ev) {
+    json_object_set_new(ev, "truncated", json_true());
+    json_print_or_pretty(ev, pretty);
+  }
+
+  sigaction(SIGINT, &old_int, NULL);
+  sigaction(SIGTERM, &old_term, NULL);
+  free(t.ring);
+
+  return 0;
+}
@@ -0,0 +1,145 @@
+/* SPDX-License-Identifier: AGPL-3.0-or-later */
+
+#include "util_lin.h"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+const double lin11_exp2[32] = {
+  0x1p0,   0x1p1,   0x1p2,   0x1p3,   0x1p4,   0x1p5,   0x1p6,   0x1p7,
+  0x1p8,   0x1p9,   0x1p10,  0x1p11,  0x1p12,  0x1p13,  0x1p14,  0x1p15,
+  0x1p-16, 0x1p-15, 0x1p-14, 0x1p-13, 0x1p-12, 0x1p-11, 0x1p-10, 0x1p-9,
+  0x1p-8,  0x1p-7,  0x1p-6,  0x1p-5,  0x1p-4,  0x1p-3,  0x1p-2,  0x1p-1,
+};
+
+static void
+lin11_decode_scalar(const uint16_t *raw, double *out, size_t n) {
+  for (size_t i = 0; i < n; i++)
+    out[i] = lin11_to_units(raw[i]);
+}
+
+#if defined(__x86_64__)
+
+/*
+ * SSE2 has no gather, so 2^E is built in place: (E + 1023) << 52 is the IEEE-754
+ * bit pattern of 2^E for every E in [-16..15]. Only lanes 0 and 1 of e32 are used.
+ */
+static inline __m128d
+sse2_exp2_pd(__m128i e32) {
+  __m128i b = _mm_add_epi32(e32, _mm_set1_epi32(1023));
+
+  b = _mm_unpacklo_epi32(b, _mm_setzero_si128());
+
+  return _mm_castsi128_pd(_mm_slli_epi64(b, 52));
+}
+
+static void
+lin11_decode_sse2(const uint16_t *raw, double *out, size_t n) {
+  size_t i = 0;
+
+  for (; i + 8 <= n; i += 8) {
+    __m128i w = _mm_loadu_si128((const __m128i *) &raw[i]);
+    /* Y: move the 11-bit mantissa to the top, shift back arithmetically; E: same for 5 bits */
+    __m128i y = _mm_srai_epi16(_mm_slli_epi16(w, 5), 5);
+    __m128i e = _mm_srai_epi16(w, 11);
+
+    __m128i ylo = _mm_srai_epi32(_mm_unpacklo_epi16(y, y), 16);
+    __m128i yhi = _mm_srai_epi32(_mm_unpackhi_epi16(y, y), 16);
+    __m128i elo = _mm_srai_epi32(_mm_unpacklo_epi16(e, e), 16);
+    __m128i ehi = _mm_srai_epi32(_mm_unpackhi_epi16(e, e), 16);
+
+    _mm_storeu_pd(&out[i + 0], _mm_mul_pd(_mm_cvtepi32_pd(ylo), sse2_exp2_pd(elo)));
+    _mm_storeu_pd(&out[i + 2], _mm_mul_pd(_mm_cvtepi32_pd(_mm_shuffle_epi32(ylo, 0xEE)),
+                                          sse2_exp2_pd(_mm_shuffle_epi32(elo, 0xEE))));
+    _mm_storeu_pd(&out[i + 4], _mm_mul_pd(_mm_cvtepi32_pd(yhi), sse2_exp2_pd(ehi)));
+    _mm_storeu_pd(&out[i + 6], _mm_mul_pd(_mm_cvtepi32_pd(_mm_shuffle_epi32(yhi, 0xEE)),
+                                          sse2_exp2_pd(_mm_shuffle_epi32(ehi, 0xEE))));
+  }
+
+  lin11_decode_scalar(raw + i, out + i, n - i);
+}
+
+/* AVX2: the raw exponent field indexes lin11_exp2[] directly through a gather. */
+__attribute__((target("avx2")))
+static void
+lin11_decode_avx2(const uint16_t *raw, double *out, size_t n) {
+  size_t i = 0;
+
+  for (; i + 8 <= n; i += 8) {
+    __m128i w = _mm_loadu_si128((const __m128i *) &raw[i]);
+    __m256i y = _mm256_cvtepi16_epi32(_mm_srai_epi16(_mm_slli_epi16(w, 5), 5));
+    __m256i idx = _mm256_cvtepu16_epi32(_mm_srli_epi16(w, 11));
+
+    __m256d v0 = _mm256_mul_pd(_mm256_cvtepi32_pd(_mm256_castsi256_si128(y)),
+                               _mm256_i32gather_pd(lin11_exp2, _mm256_castsi256_si128(idx), 8));
+    __m256d v1 = _mm256_mul_pd(_mm256_cvtepi32_pd(_mm256_extracti128_si256(y, 1)),
+                               _mm256_i32gather_pd(lin11_exp2, _mm256_extracti128_si256(idx, 1), 8));
+
+    _mm256_storeu_pd(&out[i + 0], v0);
+    _mm256_storeu_pd(&out[i + 4], v1);
+  }
+
+  lin11_decode_scalar(raw + i, out + i, n - i);
+}
+
+#elif defined(__aarch64__)
+
+/* NEON: same in-place 2^E construction as SSE2, two doubles per q register. */
+static inline float64x2_t
+neon_lin11_pair(int32x2_t y, int32x2_t e) {
+  int64x2_t b = vaddq_s64(vmovl_s32(e), vdupq_n_s64(1023));
+  float64x2_t p = vreinterpretq_f64_s64(vshlq_n_s64(b, 52));
+
+  return vmulq_f64(vcvtq_f64_s64(vmovl_s32(y)), p);
+}
+
+static void
+lin11_decode_neon(const uint16_t *raw, double *out, size_t n) {
+  size_t i = 0;
+
+  for (; i + 8 <= n; i += 8) {
+    int16x8_t w = vreinterpretq_s16_u16(vld1q_u16(&raw[i]));
+    int16x8_t y = vshrq_n_s16(vshlq_n_s16(w, 5), 5);
+    int16x8_t e = vshrq_n_s16(w, 11);
+
+    int32x4_t ylo = vmovl_s16(vget_low_s16(y));
+    int32x4_t yhi = vmovl_high_s16(y);
+    int32x4_t elo = vmovl_s16(vget_low_s16(e));
+    int32x4_t ehi = vmovl_high_s16(e);
+
+    vst1q_f64(&out[i + 0], neon_lin11_pair(vget_low_s32(ylo), vget_low_s32(elo)));
+    vst1q_f64(&out[i + 2], neon_lin11_pair(vget_high_s32(ylo), vget_high_s32(elo)));
+    vst1q_f64(&out[i + 4], neon_lin11_pair(vget_low_s32(yhi), vget_low_s32(ehi)));
+    vst1q_f64(&out[i + 6], neon_lin11_pair(vget_high_s32(yhi), vget_high_s32(ehi)));
+  }
+
+  lin11_decode_scalar(raw + i, out + i, n - i);
+}
+
+#endif
+
+void
+lin11_decode_n(const uint16_t *raw, double *out, size_t n) {
+#if defined(__x86_64__)
+  if (__builtin_cpu_supports("avx2"))
+    lin11_decode_avx2(raw, out, n);
+  else
+    lin11_decode_sse2(raw, out, n);
+#elif defined(__aarch64__)
+  lin11_decode_neon(raw, out, n);
+#else
+  lin11_decode_scalar(raw, out, n);
+#endif
+}
+
+/* LIN16U has a single exponent for the whole run: one multiply per word, left to the auto-vectorizer. */
+void
+lin16u_decode_n(const uint16_t *raw, double *out, size_t n, int expN) {
+  const double scale = ldexp(1.0, expN);
+
+  for (size_t i = 0; i < n; i++)
+    out[i] = (double) raw[i] * scale;
+}
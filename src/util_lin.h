@@ -2,6 +2,7 @@
 
 #pragma once
 
+#include <stddef.h>
 #include <stdint.h>
 #include <math.h> /* ldexp: no need of libm */
 
@@ -29,3 +30,76 @@ lin16u_to_units(uint16_t y, int expN) {
 static inline uint16_t units_to_lin16u(double units, int expN) {
   return u16_round_sat_pos(ldexp(units, -expN));
 }
+
+/*
+ * Linear11: raw[15:11] = E (5-bit two's complement), raw[10:0] = Y (11-bit two's complement),
+ * units = Y * 2^E.
+ *
+ * lin11_exp2[] is indexed by the raw exponent field (raw >> 11): 0..15 -> 2^0..2^15 and
+ * 16..31 -> 2^-16..2^-1, so the exponent never needs to be sign-extended.
+ */
+extern const double lin11_exp2[32];
+
+static inline int16_t
+lin11_mantissa(uint16_t raw) {
+  return (int16_t) (((raw & 0x7FF) ^ 0x400) - 0x400);
+}
+
+static inline int8_t
+lin11_exponent(uint16_t raw) {
+  return (int8_t) ((((raw >> 11) & 0x1F) ^ 0x10) - 0x10);
+}
+
+static inline double
+lin11_to_units(uint16_t raw) {
+  return (double) lin11_mantissa(raw) * lin11_exp2[raw >> 11];
+}
+
+/* Round half away from zero without libm; |x| must fit in a long. */
+static inline long
+round_half_away(double x) {
+  long t = (long) x;
+  double r = x - (double) t;
+
+  return t + (r >= 0.5) - (r <= -0.5);
+}
+
+static inline uint16_t
+lin11_pack(int E, long Y) {
+  return (uint16_t) ((((unsigned) E & 0x1F) << 11) | ((unsigned long) Y & 0x7FF));
+}
+
+/*
+ * units -> Linear11 with the finest exponent E in [-16..15] whose rounded mantissa still fits
+ * [-1024..1023]; saturates to +/-max at E=15, and NaN encodes as 0.
+ *
+ * frexp() gives |v| in [2^(e-1), 2^e), so E = e - 10 puts a positive mantissa in [512..1024] and
+ * E = e - 11 a negative one in [-2048..-1024]: at most one step up is needed when rounding
+ * lands outside the 11-bit range.
+ */
+static inline uint16_t
+units_to_lin11(double v) {
+  if (isnan(v) || v == 0.0)
+    return 0;
+
+  int e = 0;
+  frexp(v, &e);
+
+  int E = e - 10 - (v < 0.0);
+  if (E > 15 || isinf(v))
+    return lin11_pack(15, (v > 0.0) ? 1023 : -1024);
+  if (E < -16)
+    E = -16;
+
+  long Y = round_half_away(ldexp(v, -E));
+  if ((Y > 1023 || Y < -1024) && E < 15)
+    Y = round_half_away(ldexp(v, -++E));
+
+  Y = (Y > 1023) ? 1023 : ((Y < -1024) ? -1024 : Y);
+
+  return Y ? lin11_pack(E, Y) : 0;
+}
+
+/* Bulk decoders (util_lin.c): SIMD where the target has it, scalar otherwise. */
+void lin11_decode_n(const uint16_t *raw, double *out, size_t n);
+void lin16u_decode_n(const uint16_t *raw, double *out, size_t n, int expN);
@@ -0,0 +1,135 @@
+/* SPDX-License-Identifier: AGPL-3.0-or-later */
+
+#include "util_state.h"
+#include "pmbus_io.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static int
+mkdir_p(char *path) {
+  for (char *p = path + 1; *p; p++) {
+    if (*p != '/')
+      continue;
+    *p = '\0';
+    int rc = mkdir(path, 0700);
+    *p = '/';
+    if (rc < 0 && errno != EEXIST)
+      return -1;
+  }
+  if (mkdir(path, 0700) < 0 && errno != EEXIST)
+    return -1;
+
+  return 0;
+}
+
+/* <state dir>/<kind>-<serial>, with the state dir created */
+static int
+state_base(int fd, const char *kind, char *path, size_t len) {
+  uint8_t b[64];
+  int n = pmbus_rd_block(fd, MFR_SERIAL, b, (int) sizeof b - 1);
+
+  if (n <= 0) {
+    perror("MFR_SERIAL");
+    return -1;
+  }
+
+  /* serial strings are vendor-defined: keep them file-name safe */
+  char serial[64];
+  int k = 0;
+  for (int i = 0; i < n; i++) {
+    if (isalnum(b[i]) || b[i] == '-' || b[i] == '_')
+      serial[k++] = (char) b[i];
+    else if (b[i] && b[i] != ' ')
+      serial[k++] = '_';
+  }
+  serial[k] = '\0';
+  if (!k) {
+    fprintf(stderr, "MFR_SERIAL: empty\n");
+    return -1;
+  }
+
+  char dir[STATE_PATH_LEN];
+  const char *xdg = getenv("XDG_STATE_HOME");
+  const char *home = getenv("HOME");
+
+  if (xdg && *xdg)
+    snprintf(dir, sizeof dir, "%s/bmr", xdg);
+  else if (home && *home)
+    snprintf(dir, sizeof dir, "%s/.local/state/bmr", home);
+  else {
+    fprintf(stderr, "no XDG_STATE_HOME or HOME for the state file\n");
+    return -1;
+  }
+
+  if (mkdir_p(dir) < 0) {
+    perror(dir);
+    return -1;
+  }
+
+  if ((size_t) snprintf(path, len, "%s/%s-%s", dir, kind, serial) >= len) {
+    fprintf(stderr, "state path too long\n");
+    return -1;
+  }
+
+  return 0;
+}
+
+int
+state_path(int fd, const char *kind, char *path, size_t len) {
+  if (state_base(fd, kind, path, len) < 0)
+    return -1;
+
+  size_t n = strlen(path);
+  if (n + sizeof ".json" > len) {
+    fprintf(stderr, "state path too long\n");
+    return -1;
+  }
+  memcpy(path + n, ".json", sizeof ".json");
+
+  return 0;
+}
+
+int
+state_dir(int fd, const char *kind, char *path, size_t len) {
+  if (state_base(fd, kind, path, len) < 0)
+    return -1;
+
+  return state_mkdir(path);
+}
+
+int
+state_mkdir(const char *path) {
+  char tmp[STATE_PATH_LEN];
+
+  if ((size_t) snprintf(tmp, sizeof tmp, "%s", path) >= sizeof tmp || mkdir_p(tmp) < 0) {
+    perror(path);
+    return -1;
+  }
+
+  return 0;
+}
+
+json_t *
+state_load(const char *path) {
+  return json_load_file(path, 0, NULL);
+}
+
+int
+state_save(const char *path, json_t *o) {
+  char tmp[STATE_PATH_LEN + 8];
+
+  snprintf(tmp, sizeof tmp, "%s.tmp", path);
+  if (json_dump_file(o, tmp, JSON_INDENT(2) | JSON_SORT_KEYS) < 0 || rename(tmp, path) < 0) {
+    perror(path);
+    unlink(tmp);
+    return -1;
+  }
+
+  return 0;
+}
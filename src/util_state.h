@@ -0,0 +1,27 @@
+/* SPDX-License-Identifier: AGPL-3.0-or-later */
+#pragma once
+
+#include <jansson.h>
+#include <stddef.h>
+
+/*
+ * Per-device state files: small JSON documents keyed by MFR_SERIAL, kept in
+ * $XDG_STATE_HOME/bmr (falling back to ~/.local/state/bmr).
+ */
+
+#define STATE_PATH_LEN 512
+
+/* <state dir>/<kind>-<serial>.json, creating the directory; <0 with a message on error */
+int state_path(int fd, const char *kind, char *path, size_t len);
+
+/* <state dir>/<kind>-<serial>/, created with its parents; for stores of more than one file */
+int state_dir(int fd, const char *kind, char *path, size_t len);
+
+/* mkdir -p; <0 with a message on error */
+int state_mkdir(const char *path);
+
+/* NULL if missing or unparsable */
+json_t *state_load(const char *path);
+
+/* atomic replace through <path>.tmp; does not take the reference */
+int state_save(const char *path, json_t *o);
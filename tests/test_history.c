@@ -0,0 +1,196 @@
+/* SPDX-License-Identifier: AGPL-3.0-or-later */
+#define _POSIX_C_SOURCE 200809L
+
+#include "history_store.h"
+#include "pmbus_regs.h"
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static int failures;
+
+#define CHECK(cond, ...)                        \
+  do {                                          \
+    if (!(cond)) {                              \
+      fprintf(stderr, __VA_ARGS__);             \
+      failures++;                               \
+    }                                           \
+  } while (0)
+
+#define N_SAMPLES 150000
+#define MAX_CHUNKS 256
+#define REG PMBUS_READ_VOUT
+#define EXP5 (-12)
+
+static int64_t t_in[N_SAMPLES];
+static uint16_t v_in[N_SAMPLES];
+static size_t chunk_first[MAX_CHUNKS + 1];      /* first sample of each chunk, then N_SAMPLES */
+static size_t n_chunks;
+
+struct scan {
+  size_t next;                  /* index of the sample expected next */
+  size_t skip;                  /* chunk expected to be missing, n_chunks for none */
+  size_t got;
+  int bad;
+};
+
+static uint32_t
+lcg(void) {
+  static uint32_t s = 12345;
+
+  s = s * 1103515245u + 12345u;
+  return s >> 8;
+}
+
+/*
+ * 100 ms polling with up to +-3 ms of jitter, a 60 s backwards clock step halfway, a slowly
+ * wandering word with the odd large jump (across the 16-bit wrap too).
+ */
+static void
+gen(void) {
+  int64_t t = 1700000000000;
+  uint16_t v = 0x2000;
+
+  for (size_t i = 0; i < N_SAMPLES; i++) {
+    t += 100 + (int64_t) (lcg() % 7) - 3;
+    if (i == N_SAMPLES / 2)
+      t -= 60000;
+    if (lcg() % 1000 == 0)
+      v = (uint16_t) lcg();
+    else
+      v = (uint16_t) (v + (int) (lcg() % 5) - 2);
+    t_in[i] = t;
+    v_in[i] = v;
+  }
+}
+
+static int
+store(const char *dir) {
+  static struct hist_chunk c;
+
+  n_chunks = 0;
+  chunk_first[n_chunks++] = 0;
+  hist_chunk_start(&c, REG, EXP5, t_in[0], v_in[0]);
+  for (size_t i = 1; i < N_SAMPLES; i++) {
+    if (hist_chunk_add(&c, t_in[i], v_in[i]))
+      continue;
+    if (hist_append(dir, &c) < 0 || n_chunks == MAX_CHUNKS)
+      return -1;
+    chunk_first[n_chunks++] = i;
+    hist_chunk_start(&c, REG, EXP5, t_in[i], v_in[i]);
+  }
+  chunk_first[n_chunks] = N_SAMPLES;
+
+  return hist_append(dir, &c);
+}
+
+static bool
+scan_cb(void *ctx, int64_t t_ms, uint16_t raw, int exp5) {
+  struct scan *s = ctx;
+
+  if (s->skip < n_chunks && s->next == chunk_first[s->skip])
+    s->next = chunk_first[s->skip + 1];
+  if (s->next >= N_SAMPLES || t_ms != t_in[s->next] || raw != v_in[s->next] || exp5 != EXP5) {
+    if (!s->bad++)
+      fprintf(stderr, "sample %zu: got %lld/0x%04x/%d\n", s->next, (long long) t_ms, raw, exp5);
+    return false;
+  }
+  s->next++;
+  s->got++;
+
+  return true;
+}
+
+static void
+scan_all(const char *dir, size_t skip, const char *what) {
+  struct scan s = { .skip = skip };
+  size_t want = N_SAMPLES;
+
+  if (skip < n_chunks) {
+    want -= chunk_first[skip + 1] - chunk_first[skip];
+    if (s.next == chunk_first[skip])
+      s.next = chunk_first[skip + 1];
+  }
+  CHECK(hist_scan(dir, REG, INT64_MIN, INT64_MAX, scan_cb, &s) == 0, "%s: scan failed\n", what);
+  CHECK(!s.bad && s.got == want, "%s: %zu of %zu samples\n", what, s.got, want);
+}
+
+static int
+path(char *p, size_t len, const char *dir, const char *ext) {
+  return snprintf(p, len, "%s/%s.%s", dir, pmbus_regs[REG].name, ext) < (int) len ? 0 : -1;
+}
+
+/* a crash while appending an index record leaves a short record at the end */
+static void
+torn_index(const char *dir) {
+  char idx[512];
+  uint8_t part[HIST_IDX_LEN / 2] = { 0 };
+
+  CHECK(path(idx, sizeof idx, dir, "idx") == 0, "idx path\n");
+  int fd = open(idx, O_WRONLY | O_APPEND);
+  CHECK(fd >= 0 && write(fd, part, sizeof part) == (ssize_t) sizeof part, "torn idx write\n");
+  if (fd >= 0)
+    close(fd);
+
+  scan_all(dir, n_chunks, "torn index");
+}
+
+/* a chunk whose header no longer matches is skipped, its neighbours still decode */
+static void
+corrupt_chunk(const char *dir, size_t k) {
+  char dat[512], idx[512];
+  uint8_t rec[HIST_IDX_LEN], bad = 'X';
+
+  CHECK(path(dat, sizeof dat, dir, "dat") == 0 && path(idx, sizeof idx, dir, "idx") == 0,
+        "dat path\n");
+  int fi = open(idx, O_RDONLY);
+  CHECK(fi >= 0 && pread(fi, rec, sizeof rec, (off_t) (k * HIST_IDX_LEN)) == (ssize_t) sizeof rec,
+        "idx read\n");
+  if (fi >= 0)
+    close(fi);
+
+  uint64_t off = 0;
+  for (int i = 7; i >= 0; i--)
+    off = off << 8 | rec[16 + i];
+
+  int fd = open(dat, O_WRONLY);
+  CHECK(fd >= 0 && pwrite(fd, &bad, 1, (off_t) off) == 1, "dat write\n");
+  if (fd >= 0)
+    close(fd);
+
+  scan_all(dir, k, "corrupt chunk");
+}
+
+int
+main(void) {
+  char dir[] = "/tmp/bmr-test-history-XXXXXX";
+
+  if (!mkdtemp(dir)) {
+    perror("mkdtemp");
+    return 1;
+  }
+
+  gen();
+  CHECK(store(dir) == 0, "store failed\n");
+  CHECK(n_chunks > 2, "only %zu chunks\n", n_chunks);
+
+  scan_all(dir, n_chunks, "round trip");
+  torn_index(dir);
+  corrupt_chunk(dir, n_chunks / 2);
+
+  char p[512];
+  if (path(p, sizeof p, dir, "dat") == 0)
+    unlink(p);
+  if (path(p, sizeof p, dir, "idx") == 0)
+    unlink(p);
+  rmdir(dir);
+
+  if (failures)
+    fprintf(stderr, "%d failures\n", failures);
+
+  return failures ? 1 : 0;
+}
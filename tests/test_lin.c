@@ -0,0 +1,61 @@
+/* SPDX-License-Identifier: AGPL-3.0-or-later */
+
+#include "util_lin.h"
+
+#include <math.h>
+#include <stdio.h>
+
+static int failures;
+
+#define CHECK(cond, ...)                        \
+  do {                                          \
+    if (!(cond)) {                              \
+      fprintf(stderr, __VA_ARGS__);             \
+      failures++;                               \
+    }                                           \
+  } while (0)
+
+/* every code decodes to a value the encoder maps back to the same value */
+static void
+lin11_round_trip(void) {
+  for (unsigned c = 0; c <= 0xFFFF; c++) {
+    double v = lin11_to_units((uint16_t) c);
+    double r = lin11_to_units(units_to_lin11(v));
+
+    CHECK(r == v, "lin11 0x%04x: %g -> %g\n", c, v, r);
+  }
+}
+
+static void
+lin11_edges(void) {
+  CHECK(units_to_lin11(NAN) == 0, "lin11 NaN\n");
+  CHECK(units_to_lin11(0.0) == 0, "lin11 0\n");
+  CHECK(units_to_lin11(1e9) == lin11_pack(15, 1023), "lin11 +sat\n");
+  CHECK(units_to_lin11(-1e9) == lin11_pack(15, -1024), "lin11 -sat\n");
+  CHECK(units_to_lin11(INFINITY) == lin11_pack(15, 1023), "lin11 +inf\n");
+  CHECK(units_to_lin11(-INFINITY) == lin11_pack(15, -1024), "lin11 -inf\n");
+  CHECK(units_to_lin11(1e-9) == 0, "lin11 underflow\n");
+  /* rounding carries 1023.5 * 2^-16 out of 11 bits: one exponent step up */
+  CHECK(lin11_to_units(units_to_lin11(ldexp(1023.5, -6))) == ldexp(512.0, -5), "lin11 carry\n");
+}
+
+static void
+lin16u_edges(void) {
+  CHECK(units_to_lin16u(NAN, -12) == 0, "lin16u NaN\n");
+  CHECK(units_to_lin16u(20.0, -12) == 0xFFFF, "lin16u sat\n");
+  CHECK(units_to_lin16u(1.0, -12) == 0x1000, "lin16u 1.0\n");
+  for (unsigned c = 0; c <= 0xFFFF; c++)
+    CHECK(units_to_lin16u(lin16u_to_units((uint16_t) c, -12), -12) == c, "lin16u 0x%04x\n", c);
+}
+
+int
+main(void) {
+  lin11_round_trip();
+  lin11_edges();
+  lin16u_edges();
+
+  if (failures)
+    fprintf(stderr, "%d failures\n", failures);
+
+  return failures ? 1 : 0;
+}
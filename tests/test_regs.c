@@ -0,0 +1,45 @@
+/* SPDX-License-Identifier: AGPL-3.0-or-later */
+
+#include "pmbus_regs.h"
+
+#include <stdio.h>
+
+static int failures;
+
+#define CHECK(cond, ...)                        \
+  do {                                          \
+    if (!(cond)) {                              \
+      fprintf(stderr, __VA_ARGS__);             \
+      failures++;                               \
+    }                                           \
+  } while (0)
+
+/*
+ * TON/TOFF words are plain milliseconds: sequence derives its power-good timeout from them,
+ * so a limit of 1024 ms or more must not pick up a LIN11 sign or exponent.
+ */
+static void
+timing_words_ms(void) {
+  static const uint8_t regs[] = {
+    PMBUS_TON_DELAY, PMBUS_TON_RISE, PMBUS_TON_MAX_FAULT_LIMIT,
+    PMBUS_TOFF_DELAY, PMBUS_TOFF_FALL, PMBUS_TOFF_MAX_WARN_LIMIT,
+  };
+  static const uint16_t raw[] = { 0, 10, 1023, 1024, 2047, 2048, 5000, 0xFFFF };
+
+  for (size_t i = 0; i < sizeof regs / sizeof regs[0]; i++)
+    for (size_t k = 0; k < sizeof raw / sizeof raw[0]; k++) {
+      double ms = pmbus_reg_to_units(regs[i], raw[k], 0);
+
+      CHECK(ms == raw[k], "0x%02x: %u -> %g ms\n", regs[i], raw[k], ms);
+    }
+}
+
+int
+main(void) {
+  timing_words_ms();
+
+  if (failures)
+    fprintf(stderr, "%d failures\n", failures);
+
+  return failures ? 1 : 0;
+}